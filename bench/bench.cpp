@@ -0,0 +1,357 @@
+#include "program_generator.hpp"
+#include "kernels.hpp"
+
+#include "tokenizer.hpp"
+#include "parser.hpp"
+#include "generator.hpp"
+#include "compiler.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <limits>
+#include <memory>
+#include <cstdlib>
+
+#include <unistd.h>
+
+// Compiler throughput and generated-code benchmarks over synthetic programs.
+//
+// Every scale multiplies the function count of the base shape, so one run
+// yields a scaling curve. The numeric kernels measure generated code on
+// arithmetic loops. Results are printed as JSON, one object per run.
+
+namespace {
+
+struct Options {
+    ProgramShape shape;
+    std::vector<int> scales{ 1, 2, 4, 8 };
+    int repeat = 5;
+    unsigned jobs = 1;
+    bool end_to_end = true;
+    bool kernels = true;
+    long long input = 1000;
+    std::string output_path;
+    std::string emit_path;
+};
+
+struct Result {
+    int scale = 0;
+    int functions = 0;
+    size_t source_bytes = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    size_t instructions = 0;
+    size_t asm_bytes = 0;
+    double tokenize_ms = 0;
+    double parse_ms = 0;
+    double generate_ms = 0;
+    double compile_ms = 0;
+    double write_ms = 0;
+    bool ran = false;
+    double run_ms = 0;
+    std::string run_output;
+};
+
+struct KernelResult {
+    std::string name;
+    size_t instructions = 0;
+    bool ran = false;
+    double run_ms = 0;
+    std::string run_output;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Fastest of `repeat` runs, which is the least noisy estimate of the cost.
+template <typename Body>
+double bestMillis(int repeat, Body&& body) {
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < repeat; ++i) {
+        auto start = Clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+double perSecond(double amount, double millis) {
+    return millis > 0 ? amount * 1000.0 / millis : 0;
+}
+
+bool haveTool(const std::string& name) {
+    return std::system(("command -v " + name + " >/dev/null 2>&1").c_str()) == 0;
+}
+
+// Assembles and links asm_code, then times the executable with `input` on stdin.
+bool runExecutable(const AsmBuffer& asm_code, const Options& options, double& run_ms, std::string& run_output) {
+    namespace fs = std::filesystem;
+
+    auto dir = fs::temp_directory_path() / ("hydro_bench_" + std::to_string(getpid()));
+    fs::create_directories(dir);
+
+    auto asm_path = dir / "prog.asm";
+    auto obj_path = dir / "prog.o";
+    auto exe_path = dir / "prog";
+    auto in_path = dir / "input.txt";
+    auto out_path = dir / "output.txt";
+
+    asm_code.writeFile(asm_path.string());
+    std::ofstream(in_path) << options.input << "\n";
+
+    auto build = "nasm -felf64 '" + asm_path.string() + "' -o '" + obj_path.string() + "' && ld -o '"
+        + exe_path.string() + "' '" + obj_path.string() + "'";
+    bool ok = std::system(build.c_str()) == 0;
+
+    if (ok) {
+        auto run = "'" + exe_path.string() + "' < '" + in_path.string() + "' > '" + out_path.string() + "'";
+        run_ms = bestMillis(options.repeat, [&] { std::system(run.c_str()); });
+
+        std::stringstream ss;
+        ss << std::ifstream(out_path).rdbuf();
+        run_output = ss.str();
+        while (!run_output.empty() && run_output.back() == '\n') run_output.pop_back();
+    }
+
+    std::error_code ignored;
+    fs::remove_all(dir, ignored);
+    return ok;
+}
+
+Result runScale(const Options& options, int scale, ThreadPool* pool) {
+    Result result;
+    result.scale = scale;
+
+    auto shape = options.shape;
+    shape.functions *= scale;
+    result.functions = shape.functions;
+
+    std::string code = ProgramGenerator(shape).generate();
+    result.source_bytes = code.size();
+
+    if (!options.emit_path.empty()) {
+        std::ofstream(options.emit_path + "." + std::to_string(scale) + ".hy") << code;
+    }
+
+    std::vector<Token> tokens;
+    result.tokenize_ms = bestMillis(options.repeat, [&] { tokens = Tokenizer(code).tokenize(); });
+    result.tokens = tokens.size();
+
+    std::unique_ptr<TreeNode> root;
+    result.parse_ms = bestMillis(options.repeat, [&] { root = Parser(tokens).parseProgram(); });
+    result.nodes = CompileStats::countNodes(root.get());
+
+    AsmBuffer asm_code;
+    result.generate_ms = bestMillis(options.repeat, [&] { asm_code = Generator(root, pool).generateAsm64(); });
+    result.instructions = CompileStats::countInstructions(asm_code);
+
+    // The whole pipeline, optimizations included, as the driver runs it.
+    std::ostream null_log(nullptr);
+    CompileOptions compile_options;
+    compile_options.pool = pool;
+    result.compile_ms = bestMillis(options.repeat, [&] { asm_code = compileSource(code, compile_options, null_log).value(); });
+    result.asm_bytes = asm_code.size();
+
+    auto write_path = std::filesystem::temp_directory_path() / ("hydro_bench_" + std::to_string(getpid()) + ".asm");
+    result.write_ms = bestMillis(options.repeat, [&] { asm_code.writeFile(write_path.string()); });
+    std::filesystem::remove(write_path);
+
+    if (options.end_to_end) {
+        result.ran = runExecutable(asm_code, options, result.run_ms, result.run_output);
+    }
+
+    return result;
+}
+
+KernelResult runKernel(const Options& options, const Kernel& kernel, ThreadPool* pool) {
+    KernelResult result;
+    result.name = kernel.name;
+
+    std::ostream null_log(nullptr);
+    CompileOptions compile_options;
+    compile_options.pool = pool;
+    std::string code(kernel.source);
+    auto asm_code = compileSource(code, compile_options, null_log).value();
+    result.instructions = CompileStats::countInstructions(asm_code);
+
+    if (options.end_to_end) {
+        result.ran = runExecutable(asm_code, options, result.run_ms, result.run_output);
+    }
+
+    return result;
+}
+
+void printJson(std::ostream& out, const Options& options, const std::vector<Result>& results, const std::vector<KernelResult>& kernels) {
+    auto& shape = options.shape;
+
+    out << std::fixed;
+    out << "{\n";
+    out << "  \"benchmark\": \"hydro_bench\",\n";
+    out << "  \"compiler\": \"" << compilerVersion() << "\",\n";
+    out << "  \"shape\": {\"functions\": " << shape.functions << ", \"statements\": " << shape.statements
+        << ", \"expression_depth\": " << shape.expression_depth << ", \"nesting\": " << shape.nesting
+        << ", \"loop_trips\": " << shape.loop_trips << ", \"seed\": " << shape.seed << "},\n";
+    out << "  \"repeat\": " << options.repeat << ",\n";
+    out << "  \"jobs\": " << options.jobs << ",\n";
+    out << "  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        double mb = r.source_bytes / 1e6;
+
+        out << "    {\n";
+        out << "      \"scale\": " << r.scale << ", \"functions\": " << r.functions
+            << ", \"source_bytes\": " << r.source_bytes << ", \"tokens\": " << r.tokens
+            << ", \"nodes\": " << r.nodes << ", \"instructions\": " << r.instructions
+            << ", \"asm_bytes\": " << r.asm_bytes << ",\n";
+        out << "      \"tokenize\": {\"ms\": " << r.tokenize_ms << ", \"tokens_per_s\": " << perSecond(r.tokens, r.tokenize_ms)
+            << ", \"mb_per_s\": " << perSecond(mb, r.tokenize_ms) << "},\n";
+        out << "      \"parse\": {\"ms\": " << r.parse_ms << ", \"nodes_per_s\": " << perSecond(r.nodes, r.parse_ms)
+            << ", \"tokens_per_s\": " << perSecond(r.tokens, r.parse_ms) << "},\n";
+        out << "      \"generate\": {\"ms\": " << r.generate_ms << ", \"nodes_per_s\": " << perSecond(r.nodes, r.generate_ms)
+            << ", \"instructions_per_s\": " << perSecond(r.instructions, r.generate_ms) << "},\n";
+        out << "      \"compile\": {\"ms\": " << r.compile_ms << ", \"mb_per_s\": " << perSecond(mb, r.compile_ms) << "},\n";
+        out << "      \"write\": {\"ms\": " << r.write_ms << ", \"mb_per_s\": " << perSecond(r.asm_bytes / 1e6, r.write_ms) << "},\n";
+
+        if (r.ran) {
+            out << "      \"run\": {\"ms\": " << r.run_ms << ", \"output\": \"" << r.run_output << "\"}\n";
+        } else {
+            out << "      \"run\": null\n";
+        }
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ],\n";
+
+    out << "  \"kernels\": [\n";
+    for (size_t i = 0; i < kernels.size(); ++i) {
+        auto& k = kernels[i];
+        out << "    {\"name\": \"" << k.name << "\", \"instructions\": " << k.instructions << ", \"run\": ";
+        if (k.ran) {
+            out << "{\"ms\": " << k.run_ms << ", \"output\": \"" << k.run_output << "\"}";
+        } else {
+            out << "null";
+        }
+        out << "}" << (i + 1 < kernels.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+std::vector<int> parseList(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        values.push_back(std::stoi(item));
+    }
+    return values;
+}
+
+void printUsage() {
+    std::cerr << "Usage: hydro_bench [options]\n"
+        << "  --functions=N    functions at scale 1 (default 200)\n"
+        << "  --statements=N   statements per function body (default 8)\n"
+        << "  --depth=N        expression depth (default 3)\n"
+        << "  --nesting=N      if/while nesting (default 2)\n"
+        << "  --trips=N        iterations per loop (default 4)\n"
+        << "  --seed=N         program seed (default 1)\n"
+        << "  --scales=A,B,..  function count multipliers (default 1,2,4,8)\n"
+        << "  --repeat=N       runs per measurement, the best is kept (default 5)\n"
+        << "  --jobs=N         threads for the compiler (default 1)\n"
+        << "  --input=N        number fed to the compiled programs (default 1000)\n"
+        << "  --no-run         skip assembling and running the programs\n"
+        << "  --no-kernels     skip the numeric kernels\n"
+        << "  --emit=PREFIX    also write the programs to PREFIX.<scale>.hy\n"
+        << "  --out=FILE       write JSON to FILE instead of stdout\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&](const std::string& prefix) { return arg.substr(prefix.size()); };
+
+            if (arg.rfind("--functions=", 0) == 0) options.shape.functions = std::stoi(value("--functions="));
+            else if (arg.rfind("--statements=", 0) == 0) options.shape.statements = std::stoi(value("--statements="));
+            else if (arg.rfind("--depth=", 0) == 0) options.shape.expression_depth = std::stoi(value("--depth="));
+            else if (arg.rfind("--nesting=", 0) == 0) options.shape.nesting = std::stoi(value("--nesting="));
+            else if (arg.rfind("--trips=", 0) == 0) options.shape.loop_trips = std::stoi(value("--trips="));
+            else if (arg.rfind("--seed=", 0) == 0) options.shape.seed = std::stoull(value("--seed="));
+            else if (arg.rfind("--scales=", 0) == 0) options.scales = parseList(value("--scales="));
+            else if (arg.rfind("--repeat=", 0) == 0) options.repeat = std::max(1, std::stoi(value("--repeat=")));
+            else if (arg.rfind("--jobs=", 0) == 0) options.jobs = std::stoul(value("--jobs="));
+            else if (arg.rfind("--input=", 0) == 0) options.input = std::stoll(value("--input="));
+            else if (arg == "--no-run") options.end_to_end = false;
+            else if (arg == "--no-kernels") options.kernels = false;
+            else if (arg.rfind("--emit=", 0) == 0) options.emit_path = value("--emit=");
+            else if (arg.rfind("--out=", 0) == 0) options.output_path = value("--out=");
+            else {
+                printUsage();
+                return arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+        }
+    }
+    catch (const std::exception&) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    if (options.end_to_end && !(haveTool("nasm") && haveTool("ld"))) {
+        std::cerr << "nasm or ld not found, skipping end-to-end runs.\n";
+        options.end_to_end = false;
+    }
+
+    if (options.jobs == 0) {
+        options.jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::unique_ptr<ThreadPool> pool;
+    if (options.jobs > 1) {
+        pool = std::make_unique<ThreadPool>(options.jobs - 1);
+    }
+
+    std::vector<Result> results;
+    for (int scale : options.scales) {
+        try {
+            results.push_back(runScale(options, scale, pool.get()));
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Scale " << scale << ": " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        std::cerr << "scale " << scale << " done\n";
+    }
+
+    std::vector<KernelResult> kernels;
+    if (options.kernels) {
+        for (auto& kernel : numeric_kernels) {
+            try {
+                kernels.push_back(runKernel(options, kernel, pool.get()));
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Kernel " << kernel.name << ": " << e.what() << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        std::cerr << "kernels done\n";
+    }
+
+    if (options.output_path.empty()) {
+        printJson(std::cout, options, results, kernels);
+    } else {
+        std::ofstream fout(options.output_path);
+        printJson(fout, options, results, kernels);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string_view>
+
+// Fixed numeric programs for the generated-code benchmarks. The same
+// Mandelbrot set is counted with floats and with ints scaled by 4096, the
+// way hydro programs computed fractions before they had floats.
+struct Kernel {
+    std::string_view name;
+    std::string_view source;
+};
+
+inline constexpr Kernel numeric_kernels[] = {
+    { "mandelbrot_float", R"hydro(
+int main() {
+    int total = 0;
+    int y = 0;
+    while (y < 300) {
+        float ci = y * 0.008 - 1.2;
+        int x = 0;
+        while (x < 400) {
+            float cr = x * 0.0075 - 2.1;
+            float zr = 0.0;
+            float zi = 0.0;
+            int n = 0;
+            while (n < 200 && zr * zr + zi * zi <= 4.0) {
+                float t = zr * zr - zi * zi + cr;
+                zi = 2.0 * zr * zi + ci;
+                zr = t;
+                n += 1;
+            }
+            total += n;
+            x += 1;
+        }
+        y += 1;
+    }
+    print_int(total);
+    return 0;
+}
+)hydro" },
+    { "mandelbrot_fixed", R"hydro(
+int main() {
+    int total = 0;
+    int y = 0;
+    while (y < 300) {
+        int ci = y * 4096 * 8 / 1000 - 4915;
+        int x = 0;
+        while (x < 400) {
+            int cr = x * 4096 * 75 / 10000 - 8602;
+            int zr = 0;
+            int zi = 0;
+            int n = 0;
+            while (n < 200 && zr * zr + zi * zi <= 4 * 4096 * 4096) {
+                int t = (zr * zr - zi * zi) / 4096 + cr;
+                zi = 2 * zr * zi / 4096 + ci;
+                zr = t;
+                n += 1;
+            }
+            total += n;
+            x += 1;
+        }
+        y += 1;
+    }
+    print_int(total);
+    return 0;
+}
+)hydro" },
+    { "leibniz_pi", R"hydro(
+int main() {
+    float sum = 0.0;
+    float sign = 1.0;
+    int k = 0;
+    while (k < 20000000) {
+        sum += sign / (2 * k + 1);
+        sign = -sign;
+        k += 1;
+    }
+    print_float(4.0 * sum);
+    return 0;
+}
+)hydro" },
+};
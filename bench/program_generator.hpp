@@ -0,0 +1,211 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <algorithm>
+
+// Shape of a synthetic Hydro program.
+struct ProgramShape {
+    int functions = 200;        // functions besides main
+    int statements = 8;         // statements per function body, half that in nested blocks
+    int expression_depth = 3;   // operator levels per expression
+    int nesting = 2;            // if/while levels inside a function
+    int loop_trips = 4;         // iterations of every generated loop
+    uint64_t seed = 1;
+};
+
+// Generates deterministic, terminating Hydro programs of a given shape.
+//
+// Every function takes (a, b), works on a few locals and calls the function
+// before it once in its return statement, so all of them stay reachable and
+// the running time grows linearly with the function count. main reads its
+// input with read_int, which keeps the optimizer from evaluating the whole
+// program at compile time.
+class ProgramGenerator {
+public:
+    explicit ProgramGenerator(ProgramShape shape) : shape(shape), state(shape.seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    std::string generate() {
+        out.str("");
+
+        for (int i = 0; i < shape.functions; ++i) {
+            generateFunction(i);
+        }
+
+        out << "int main() {\n";
+        out << "    int n = read_int();\n";
+        if (shape.functions > 0) {
+            out << "    print_int(f" << shape.functions - 1 << "(n, 3));\n";
+        } else {
+            out << "    print_int(n);\n";
+        }
+        out << "    return 0;\n";
+        out << "}\n";
+
+        return out.str();
+    }
+
+private:
+    static constexpr int local_count = 4;
+
+    ProgramShape shape;
+    uint64_t state;
+    std::stringstream out;
+    int declared_locals = 0;    // locals a leaf may refer to
+
+    // xorshift64*, so the programs are the same on every platform.
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    int pick(int count) {
+        return static_cast<int>(next() % static_cast<uint64_t>(count));
+    }
+
+    void indent(int level) {
+        for (int i = 0; i < level; ++i) out << "    ";
+    }
+
+    void generateFunction(int index) {
+        out << "int f" << index << "(int a, int b) {\n";
+
+        declared_locals = 0;
+        for (int i = 0; i < local_count; ++i) {
+            out << "    int v" << i << " = ";
+            generateExpression(shape.expression_depth);
+            out << ";\n";
+            ++declared_locals;
+        }
+        for (int i = 0; i < shape.nesting; ++i) {
+            out << "    int l" << i << " = 0;\n";
+        }
+
+        generateBlock(1, 0);
+
+        out << "    return ";
+        generateExpression(shape.expression_depth);
+        if (index > 0) {
+            out << " + f" << index - 1 << "(a, v" << pick(local_count) << ")";
+        }
+        out << ";\n";
+        out << "}\n";
+    }
+
+    void generateBlock(int level, int depth) {
+        int statements = depth == 0 ? shape.statements : std::max(1, shape.statements / 2);
+
+        for (int i = 0; i < statements; ++i) {
+            int kind = depth < shape.nesting ? pick(8) : pick(6);
+
+            if (kind < 6) {
+                generateAssignment(level);
+            } else if (kind == 6) {
+                generateIf(level, depth);
+            } else {
+                generateWhile(level, depth);
+            }
+        }
+    }
+
+    void generateAssignment(int level) {
+        static const char* operators[] = { "=", "+=", "-=" };
+
+        indent(level);
+        out << "v" << pick(local_count) << " " << operators[pick(3)] << " ";
+        generateExpression(shape.expression_depth);
+        out << ";\n";
+    }
+
+    void generateIf(int level, int depth) {
+        indent(level);
+        out << "if (";
+        generateComparison();
+        out << ") {\n";
+        generateBlock(level + 1, depth + 1);
+        indent(level);
+        out << "} else {\n";
+        generateBlock(level + 1, depth + 1);
+        indent(level);
+        out << "}\n";
+    }
+
+    // Loop counters are only written by their own loop, so every loop terminates.
+    void generateWhile(int level, int depth) {
+        indent(level);
+        out << "l" << depth << " = 0;\n";
+        indent(level);
+        out << "while (l" << depth << " < " << shape.loop_trips << ") {\n";
+        generateBlock(level + 1, depth + 1);
+        indent(level + 1);
+        out << "l" << depth << " += 1;\n";
+        indent(level);
+        out << "}\n";
+    }
+
+    void generateComparison() {
+        static const char* operators[] = { "<", "<=", "==", ">", ">=" };
+
+        generateExpression(shape.expression_depth - 1);
+        out << " " << operators[pick(5)] << " ";
+        generateExpression(shape.expression_depth - 1);
+    }
+
+    void generateLeaf() {
+        switch (pick(4)) {
+        case 0: out << "a"; break;
+        case 1: out << "b"; break;
+        case 2:
+            if (declared_locals > 0) {
+                out << "v" << pick(declared_locals);
+                break;
+            }
+            [[fallthrough]];
+        default: out << pick(100); break;
+        }
+    }
+
+    // Division and remainder only use non-zero literal divisors.
+    void generateExpression(int depth) {
+        if (depth <= 0) {
+            generateLeaf();
+            return;
+        }
+
+        switch (pick(6)) {
+        case 0:
+        case 1:
+            out << "(";
+            generateExpression(depth - 1);
+            out << " + ";
+            generateExpression(depth - 1);
+            out << ")";
+            break;
+        case 2:
+            out << "(";
+            generateExpression(depth - 1);
+            out << " - ";
+            generateExpression(depth - 1);
+            out << ")";
+            break;
+        case 3:
+            out << "(";
+            generateExpression(depth - 1);
+            out << " * ";
+            generateLeaf();
+            out << ")";
+            break;
+        case 4:
+            out << "(";
+            generateExpression(depth - 1);
+            out << (pick(2) ? " / " : " % ") << 1 + pick(9) << ")";
+            break;
+        default:
+            generateLeaf();
+            break;
+        }
+    }
+};
@@ -0,0 +1,41 @@
+# Generates a header with every runtime routine from src/asm_lib embedded as a string.
+#
+# Usage: cmake -DOUTPUT=<header> -DSOURCES=<a.asm;b.asm;...> -P embed_runtime.cmake
+#
+# Each routine is named after its file. A line of the form
+#   ; depends: name other_name
+# lists the routines that have to be linked in before it.
+
+set(content "#pragma once\n\n#include <string_view>\n\n")
+string(APPEND content "// Generated from src/asm_lib by cmake/embed_runtime.cmake. Do not edit.\n\n")
+string(APPEND content "struct RuntimeRoutine {\n")
+string(APPEND content "    std::string_view name;\n")
+string(APPEND content "    std::string_view dependencies; // space separated routine names\n")
+string(APPEND content "    std::string_view code;\n")
+string(APPEND content "};\n\n")
+string(APPEND content "inline constexpr RuntimeRoutine runtime_routines[] = {\n")
+
+list(SORT SOURCES)
+foreach(source IN LISTS SOURCES)
+    get_filename_component(name "${source}" NAME_WE)
+    file(READ "${source}" code)
+
+    set(dependencies "")
+    string(REGEX MATCH "; depends:[^\n]*" depends_line "${code}")
+    if(depends_line)
+        string(REGEX REPLACE "; depends:[ ]*" "" dependencies "${depends_line}")
+        string(STRIP "${dependencies}" dependencies)
+    endif()
+
+    string(APPEND content "    { \"${name}\", \"${dependencies}\", R\"hydro_asm(${code})hydro_asm\" },\n")
+endforeach()
+
+string(APPEND content "};\n")
+
+# Only touch the header when it changes, so unrelated edits don't rebuild the compiler.
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" previous)
+endif()
+if(NOT "${previous}" STREQUAL "${content}")
+    file(WRITE "${OUTPUT}" "${content}")
+endif()
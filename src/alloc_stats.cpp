@@ -0,0 +1,46 @@
+#include "alloc_stats.hpp"
+
+#include <new>
+#include <cstdlib>
+
+// Replacement allocation functions feeding AllocationCounters. The array and
+// nothrow forms forward to these by default.
+
+void* operator new(std::size_t size) {
+    AllocationCounters::count.fetch_add(1, std::memory_order_relaxed);
+    AllocationCounters::bytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    AllocationCounters::count.fetch_add(1, std::memory_order_relaxed);
+    AllocationCounters::bytes.fetch_add(size, std::memory_order_relaxed);
+
+    // aligned_alloc wants a non-zero multiple of the alignment.
+    auto align = static_cast<std::size_t>(alignment);
+    auto rounded = size == 0 ? align : (size + align - 1) / align * align;
+    if (void* ptr = std::aligned_alloc(align, rounded)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Process-wide allocation counters, updated by the replacement operator new
+// in alloc_stats.cpp. Only allocations are counted, frees are not.
+struct AllocationCounters {
+    static inline std::atomic<uint64_t> count{ 0 };
+    static inline std::atomic<uint64_t> bytes{ 0 };
+};
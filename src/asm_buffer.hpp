@@ -0,0 +1,197 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include <charconv>
+#include <type_traits>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Append-only text buffer for generated assembly.
+//
+// Text is appended to chunks whose bytes never move, so a growing buffer
+// never copies what it already holds, and appending another buffer takes
+// over its large chunks instead of copying them. Integers are formatted
+// with std::to_chars. The chunks are written out with writev, so a whole
+// program is never joined into one string.
+class AsmBuffer {
+public:
+    AsmBuffer() = default;
+
+    // Takes over a string, like a cached program, as the only chunk.
+    explicit AsmBuffer(std::string text) {
+        if (!text.empty()) {
+            total_size = text.size();
+            chunks.push_back(std::move(text));
+        }
+    }
+
+    AsmBuffer& operator<<(std::string_view text) {
+        append(text);
+        return *this;
+    }
+
+    AsmBuffer& operator<<(char c) {
+        append(std::string_view(&c, 1));
+        return *this;
+    }
+
+    template <typename T>
+        requires (std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>)
+    AsmBuffer& operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        append(std::string_view(digits, result.ptr - digits));
+        return *this;
+    }
+
+    AsmBuffer& operator<<(const AsmBuffer& other) {
+        for (auto& chunk : other.chunks) {
+            append(chunk);
+        }
+        return *this;
+    }
+
+    AsmBuffer& operator<<(AsmBuffer&& other) {
+        for (auto& chunk : other.chunks) {
+            if (chunk.size() >= adopted_chunk_size) {
+                total_size += chunk.size();
+                chunks.push_back(std::move(chunk));
+            } else {
+                append(chunk);
+            }
+        }
+        other.clear();
+        return *this;
+    }
+
+    size_t size() const { return total_size; }
+    bool empty() const { return total_size == 0; }
+
+    void clear() {
+        chunks.clear();
+        total_size = 0;
+        next_chunk_size = first_chunk_size;
+    }
+
+    std::string str() const {
+        std::string text;
+        text.reserve(total_size);
+        for (auto& chunk : chunks) {
+            text += chunk;
+        }
+        return text;
+    }
+
+    // Calls f with every line, without its newline. A line may span chunks.
+    template <typename F>
+    void forEachLine(F f) const {
+        std::string carry;
+
+        for (auto& chunk : chunks) {
+            std::string_view rest = chunk;
+
+            for (size_t end; (end = rest.find('\n')) != std::string_view::npos; rest.remove_prefix(end + 1)) {
+                if (carry.empty()) {
+                    f(rest.substr(0, end));
+                } else {
+                    carry += rest.substr(0, end);
+                    f(std::string_view(carry));
+                    carry.clear();
+                }
+            }
+            carry += rest;
+        }
+
+        if (!carry.empty()) f(std::string_view(carry));
+    }
+
+    // Writes everything to a file descriptor, IOV_MAX chunks per writev.
+    bool writeTo(int fd) const {
+        std::vector<iovec> pending;
+        for (auto& chunk : chunks) {
+            if (!chunk.empty()) {
+                pending.push_back(iovec{ const_cast<char*>(chunk.data()), chunk.size() });
+            }
+        }
+
+        size_t next = 0;
+        while (next < pending.size()) {
+            int count = std::min<size_t>(pending.size() - next, IOV_MAX);
+            ssize_t written = writev(fd, pending.data() + next, count);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+
+            // A short write leaves the rest of a chunk for the next call.
+            while (written > 0) {
+                auto& io = pending[next];
+                if (size_t(written) >= io.iov_len) {
+                    written -= io.iov_len;
+                    ++next;
+                } else {
+                    io.iov_base = static_cast<char*>(io.iov_base) + written;
+                    io.iov_len -= written;
+                    written = 0;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Creates or truncates the file, with the permissions std::ofstream would give it.
+    bool writeFile(const std::string& path) const {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) return false;
+
+        bool written = writeTo(fd);
+        return close(fd) == 0 && written;
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const AsmBuffer& buffer) {
+        for (auto& chunk : buffer.chunks) {
+            out.write(chunk.data(), chunk.size());
+        }
+        return out;
+    }
+
+private:
+    // Chunks start small, as most functions are, and double up to a limit.
+    static constexpr size_t first_chunk_size = 1 << 10;
+    static constexpr size_t max_chunk_size = 1 << 20;
+    // Smaller chunks of an appended buffer are copied, which keeps the
+    // chunk count, and so the number of writev calls, low.
+    static constexpr size_t adopted_chunk_size = 4 << 10;
+
+    std::vector<std::string> chunks;
+    size_t total_size = 0;
+    size_t next_chunk_size = first_chunk_size;
+
+    void append(std::string_view text) {
+        total_size += text.size();
+
+        if (!chunks.empty()) {
+            auto& last = chunks.back();
+            size_t room = last.capacity() - last.size();
+            if (text.size() <= room) {
+                last.append(text);
+                return;
+            }
+
+            last.append(text.substr(0, room));
+            text.remove_prefix(room);
+        }
+
+        std::string chunk;
+        chunk.reserve(std::max(text.size(), next_chunk_size));
+        next_chunk_size = std::min(next_chunk_size * 2, max_chunk_size);
+        chunk.append(text);
+        chunks.push_back(std::move(chunk));
+    }
+};
@@ -0,0 +1,40 @@
+
+; CPU features the generated code dispatches on, detected once from _start.
+; hydro_avx2 is 1 when AVX2 can be used: the CPU has it and the OS saves
+; the YMM registers on context switches.
+
+section .bss
+hydro_avx2: resq 1
+
+section .text
+_cpu_features:
+    push rbx                ; CPUID clobbers RBX
+
+    xor eax, eax
+    cpuid
+    cmp eax, 7
+    jb cpu_features_L0      ; No leaf 7, no AVX2
+
+    mov eax, 1
+    cpuid
+    and ecx, (1 << 27) | (1 << 28)
+    cmp ecx, (1 << 27) | (1 << 28)
+    jne cpu_features_L0     ; Needs OSXSAVE and AVX
+
+    xor ecx, ecx
+    xgetbv                  ; XCR0 into EDX:EAX
+    and eax, 6
+    cmp eax, 6
+    jne cpu_features_L0     ; XMM and YMM state enabled by the OS
+
+    mov eax, 7
+    xor ecx, ecx
+    cpuid
+    bt ebx, 5
+    jnc cpu_features_L0
+
+    mov qword [rel hydro_avx2], 1
+
+cpu_features_L0:
+    pop rbx
+    ret
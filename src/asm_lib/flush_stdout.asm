@@ -0,0 +1,32 @@
+
+; Output buffer shared by the printing routines.
+; Flushed when a routine runs out of room and once more from _start on exit.
+HYDRO_OUT_CAP equ 65536
+
+section .bss
+hydro_out_buf: resb HYDRO_OUT_CAP
+hydro_out_len: resq 1
+
+section .text
+_flush_stdout:
+    lea rsi, [rel hydro_out_buf]
+    mov rdx, [rel hydro_out_len]
+
+flush_stdout_L0:
+    test rdx, rdx
+    jz flush_stdout_L1
+
+    mov rax, 1              ; syscall number for write
+    mov rdi, 1              ; file descriptor 1 (stdout)
+    syscall                 ; RSI and RDX survive the syscall
+
+    test rax, rax
+    jle flush_stdout_L1     ; Give up on errors instead of spinning
+
+    add rsi, rax            ; Partial write, continue with the rest
+    sub rdx, rax
+    jmp flush_stdout_L0
+
+flush_stdout_L1:
+    mov qword [rel hydro_out_len], 0
+    ret
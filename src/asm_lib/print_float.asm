@@ -0,0 +1,141 @@
+
+; depends: flush_stdout
+
+section .rodata
+print_float_ten:     dq 10.0
+print_float_million: dq 1000000.0
+print_float_two_63:  dq 0x43E0000000000000  ; 2^63, the first value without an int part
+
+section .text
+_print_float:
+    ; Make room for a sign, 19 digits, a point, 6 decimals, an exponent and a newline
+    cmp qword [rel hydro_out_len], HYDRO_OUT_CAP - 64
+    jbe print_float_L0
+    call _flush_stdout
+
+print_float_L0:
+    mov rax, [rsp + 8]      ; RAX = Bits of the number
+    lea r8, [rel hydro_out_buf]
+    add r8, [rel hydro_out_len] ; R8 = Write position in the output buffer
+
+    mov rdx, rax
+    btr rdx, 63             ; RDX = Bits of the absolute value
+    mov rcx, 0x7FF0000000000000
+    cmp rdx, rcx
+    ja print_float_nan
+
+    test rax, rax
+    jns print_float_L1
+    mov byte [r8], '-'
+    inc r8
+
+print_float_L1:
+    cmp rdx, rcx
+    je print_float_inf
+
+    movq xmm0, rdx          ; XMM0 = Absolute value
+    xor r9d, r9d            ; R9 = Decimal exponent
+
+    ; Values too large for an int part are scaled to one digit before the point
+    ucomisd xmm0, [rel print_float_two_63]
+    jb print_float_L3
+
+print_float_L2:
+    divsd xmm0, [rel print_float_ten]
+    inc r9
+    ucomisd xmm0, [rel print_float_ten]
+    jae print_float_L2
+
+print_float_L3:
+    cvttsd2si rax, xmm0     ; RAX = Int part
+    pxor xmm1, xmm1
+    cvtsi2sd xmm1, rax
+    subsd xmm0, xmm1
+    mulsd xmm0, [rel print_float_million]
+    cvtsd2si r10, xmm0      ; R10 = Six decimals, rounded to nearest
+    cmp r10, 1000000
+    jb print_float_L4
+    sub r10, 1000000        ; Rounding carried into the int part
+    inc rax
+
+    test r9, r9
+    jz print_float_L4
+    cmp rax, 10
+    jb print_float_L4
+    mov eax, 1              ; 9.9999999e+N rounds to 1.000000e+N+1
+    inc r9
+
+print_float_L4:
+    call print_float_digits
+
+    mov byte [r8], '.'
+    inc r8
+    mov rax, r10
+    mov ecx, 10
+    lea rsi, [r8 + 6]       ; Decimals are written backwards, zero padded
+
+print_float_L5:
+    xor edx, edx
+    div rcx
+    add dl, '0'
+    dec rsi
+    mov [rsi], dl
+    cmp rsi, r8
+    ja print_float_L5
+    add r8, 6
+
+    test r9, r9
+    jz print_float_L6
+    mov word [r8], 'e+'
+    add r8, 2
+    mov rax, r9
+    call print_float_digits
+
+print_float_L6:
+    mov byte [r8], 10       ; Newline
+    inc r8
+
+print_float_L7:
+    lea rax, [rel hydro_out_buf]
+    sub r8, rax
+    mov [rel hydro_out_len], r8
+    ret
+
+print_float_nan:
+    mov dword [r8], `nan\n`
+    add r8, 4
+    jmp print_float_L7
+
+print_float_inf:
+    mov dword [r8], `inf\n`
+    add r8, 4
+    jmp print_float_L7
+
+; Writes the digits of the unsigned number in RAX at R8 and advances R8.
+; Clobbers RAX, RCX, RDX and RSI.
+print_float_digits:
+    sub rsp, 24             ; Scratch buffer, digits are written backwards
+    lea rsi, [rsp + 24]
+    mov ecx, 10
+
+print_float_digits_L0:
+    xor edx, edx
+    div rcx
+    add dl, '0'
+    dec rsi
+    mov [rsi], dl
+    test rax, rax
+    jnz print_float_digits_L0
+
+    lea rcx, [rsp + 24]
+
+print_float_digits_L1:
+    mov al, [rsi]
+    mov [r8], al
+    inc rsi
+    inc r8
+    cmp rsi, rcx
+    jb print_float_digits_L1
+
+    add rsp, 24
+    ret
@@ -1,65 +1,90 @@
 
+; depends: flush_stdout
+
+section .rodata
+print_int_digits:           ; "00" "01" ... "99", two ASCII digits per entry
+    db "00010203040506070809"
+    db "10111213141516171819"
+    db "20212223242526272829"
+    db "30313233343536373839"
+    db "40414243444546474849"
+    db "50515253545556575859"
+    db "60616263646566676869"
+    db "70717273747576777879"
+    db "80818283848586878889"
+    db "90919293949596979899"
+
+section .text
 _print_int:
-    push rbp
-    mov rbp, rsp
-    sub rsp, 25             ; Allocate buffer
-    
-    mov byte [rbp - 25], 0
-    mov rax, [rbp + 16]     ; RAX = Number
+    ; Make room for a sign, 20 digits, a newline and the 32 byte copy below
+    cmp qword [rel hydro_out_len], HYDRO_OUT_CAP - 64
+    jbe print_int_L0
+    call _flush_stdout
 
-    shr rax, 63
-    cmp rax, 0
-    mov rax, [rbp + 16]
-    jz print_int_L1
+print_int_L0:
+    mov rax, [rsp + 8]      ; RAX = Number
+    lea r8, [rel hydro_out_buf]
+    add r8, [rel hydro_out_len] ; R8 = Write position in the output buffer
 
-    not rax
-    inc rax
-    mov byte [rbp - 25], 1
+    test rax, rax
+    jns print_int_L1
+    mov byte [r8], '-'
+    inc r8
+    neg rax                 ; Unsigned from here on, so INT64_MIN works too
 
 print_int_L1:
-    mov rbx, 10             ; RBX = 10
-    
-    ; R8 will track the position of the last digit (End of buffer)
-    mov r8, rbp
-    sub r8, 1               ; R8 points to RSP + 23 (The end of the buffer)
+    sub rsp, 24             ; Scratch buffer, digits are written backwards
+    lea rcx, [rsp + 24]     ; RCX = Start of the digits written so far
+    lea r9, [rel print_int_digits]
+    mov r10, 0x28F5C28F5C28F5C3
 
-    mov rcx, r8             ; RCX is the writing pointer
-    mov byte [rcx], 10      ; Store byte
-    dec rcx
+print_int_L2:
+    cmp rax, 100
+    jb print_int_L3
 
-print_int_L0:
-    xor rdx, rdx            
-    div rbx                 ; RDX = digit
-    
-    add dl, '0'             ; Convert to ASCII
-    mov byte [rcx], dl      ; Store byte
-    dec rcx                 ; Move back
-    
-    cmp rax, 0
-    jnz print_int_L0
+    ; RDX = RAX / 100 by reciprocal multiplication, RDI = RAX % 100
+    mov rdi, rax
+    shr rax, 2
+    mul r10
+    shr rdx, 2
+    imul rax, rdx, 100
+    sub rdi, rax
 
-    mov al, [rbp - 25]
-    cmp al, 0
-    jz print_int_L2
-    mov byte [rcx], '-'      ; Store byte
+    movzx eax, word [r9 + rdi * 2]
+    sub rcx, 2
+    mov [rcx], ax           ; Two digits at a time
+    mov rax, rdx
+    jmp print_int_L2
+
+print_int_L3:
+    cmp rax, 10
+    jb print_int_L4
+
+    movzx eax, word [r9 + rax * 2]
+    sub rcx, 2
+    mov [rcx], ax
+    jmp print_int_L5
+
+print_int_L4:
+    add al, '0'
     dec rcx
+    mov [rcx], al
 
-print_int_L2:
-    inc rcx                 ; RCX now points to the first digit ('1')
+print_int_L5:
+    ; Copy at most 20 digits with two unaligned 16 byte moves
+    movdqu xmm0, [rcx]
+    movdqu xmm1, [rcx + 16]
+    movdqu [r8], xmm0
+    movdqu [r8 + 16], xmm1
+
+    lea rdx, [rsp + 24]
+    sub rdx, rcx            ; RDX = Number of digits
+    add r8, rdx
+    mov byte [r8], 10       ; Newline
+    inc r8
 
-    ; --- Syscall to print the number ---
-    mov rax, 1              ; syscall number for write
-    mov rdi, 1              ; file descriptor 1 (stdout)
-    mov rsi, rcx            ; RSI = Start of the string
-    
-    ; RDX = Length = R8 (last digit pos) - RCX (first digit pos) + 1
-    mov rdx, r8             
-    sub rdx, rsi            
-    inc rdx                 
-    
-    syscall                 ; Print the string
-    
-    ; --- Cleanup ---
-    mov rsp, rbp            
-    pop rbp
+    add rsp, 24
+    lea rax, [rel hydro_out_buf]
+    sub r8, rax
+    mov [rel hydro_out_len], r8
     ret
@@ -0,0 +1,90 @@
+
+; Buffered stdin, refilled with one read syscall per HYDRO_IN_CAP bytes.
+HYDRO_IN_CAP equ 65536
+
+section .bss
+hydro_in_buf: resb HYDRO_IN_CAP
+hydro_in_pos: resq 1
+hydro_in_len: resq 1
+
+section .text
+; Returns the next input byte in RAX, or -1 at end of input.
+; Clobbers RCX, RDX, RSI, RDI and R11.
+read_int_next:
+    mov rcx, [rel hydro_in_pos]
+    cmp rcx, [rel hydro_in_len]
+    jb read_int_L0
+
+    xor eax, eax            ; syscall number for read
+    xor edi, edi            ; file descriptor 0 (stdin)
+    lea rsi, [rel hydro_in_buf]
+    mov rdx, HYDRO_IN_CAP
+    syscall
+
+    xor ecx, ecx
+    mov [rel hydro_in_pos], rcx
+    test rax, rax
+    jle read_int_L1
+    mov [rel hydro_in_len], rax
+
+read_int_L0:
+    lea rsi, [rel hydro_in_buf]
+    movzx eax, byte [rsi + rcx]
+    inc rcx
+    mov [rel hydro_in_pos], rcx
+    ret
+
+read_int_L1:
+    mov qword [rel hydro_in_len], 0
+    mov rax, -1
+    ret
+
+; Reads the next decimal integer from stdin, skipping anything before it.
+; Returns 0 at end of input.
+_read_int:
+    xor r8, r8              ; R8 = Value
+    xor r9, r9              ; R9 = 1 if negative
+
+read_int_L2:
+    call read_int_next
+    cmp rax, -1
+    je read_int_L6
+
+    cmp rax, '-'
+    je read_int_L3
+    cmp rax, '0'
+    jb read_int_L2
+    cmp rax, '9'
+    ja read_int_L2
+    jmp read_int_L4
+
+read_int_L3:
+    mov r9, 1
+    call read_int_next
+
+read_int_L4:
+    cmp rax, '0'
+    jb read_int_L5
+    cmp rax, '9'
+    ja read_int_L5
+
+    sub rax, '0'
+    imul r8, r8, 10
+    add r8, rax
+    call read_int_next
+    jmp read_int_L4
+
+read_int_L5:
+    ; Put back the byte that ended the number
+    cmp rax, -1
+    je read_int_L6
+    dec qword [rel hydro_in_pos]
+
+read_int_L6:
+    mov rax, r8
+    test r9, r9
+    jz read_int_L7
+    neg rax
+
+read_int_L7:
+    ret
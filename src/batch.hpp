@@ -0,0 +1,169 @@
+#pragma once
+
+#include "compiler.hpp"
+#include "thread_pool.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <iomanip>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <functional>
+
+// Compiles many files in one process, sharing one thread pool between files
+// and the per-file parallel phases. Each input gets <output_dir>/<stem>.asm
+// for the code and <output_dir>/<stem>.log for its dumps and pass reports.
+class BatchCompiler {
+public:
+    // Reads a source by its input path; the file is read when empty.
+    std::function<std::string(const std::string&)> read_source;
+    // Failures and the timing summary.
+    std::ostream* err = &std::cerr;
+    std::ostream* log = &std::clog;
+
+    BatchCompiler(std::string output_dir, CompileOptions options) : output_dir(std::move(output_dir)), options(options) {}
+
+    // One path per line. Blank lines and lines starting with '#' are skipped.
+    static std::vector<std::string> readManifest(const std::string& manifest_path) {
+        std::ifstream fin(manifest_path);
+        if (!fin) {
+            throw std::runtime_error("Unable to open manifest: " + manifest_path);
+        }
+        return parseManifest(fin);
+    }
+
+    static std::vector<std::string> parseManifest(std::istream& in) {
+        std::vector<std::string> inputs;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            inputs.push_back(line);
+        }
+        return inputs;
+    }
+
+    // Returns EXIT_SUCCESS only if every input compiled.
+    int run(const std::vector<std::string>& inputs) {
+        namespace fs = std::filesystem;
+
+        std::unordered_map<std::string, std::string> outputs;
+        for (auto& input : inputs) {
+            auto stem = fs::path(input).stem().string();
+            auto [it, inserted] = outputs.emplace(stem, input);
+            if (!inserted) {
+                *err << "Inputs '" << it->second << "' and '" << input << "' would both be written to " << stem << ".asm\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        fs::create_directories(output_dir);
+
+        results = std::vector<Result>(inputs.size());
+        auto start = std::chrono::steady_clock::now();
+
+        auto compile = [&](size_t i) {
+            compileOne(inputs[i], results[i]);
+        };
+
+        if (options.pool != nullptr) {
+            options.pool->parallelFor(inputs.size(), compile);
+        } else {
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                compile(i);
+            }
+        }
+
+        auto wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return printSummary(inputs, wall_ms);
+    }
+
+private:
+    struct Result {
+        bool ok = false;
+        double millis = 0;
+        std::string error;
+    };
+
+    std::string output_dir;
+    CompileOptions options;
+    std::vector<Result> results;
+
+    void compileOne(const std::string& input, Result& result) {
+        namespace fs = std::filesystem;
+
+        auto start = std::chrono::steady_clock::now();
+        auto stem = fs::path(input).stem().string();
+        std::stringstream log;
+
+        try {
+            std::string code;
+            if (read_source) {
+                code = read_source(input);
+            } else {
+                std::ifstream fin(input);
+                if (!fin) {
+                    throw std::runtime_error("Unable to open file: " + input);
+                }
+                std::stringstream ss;
+                ss << fin.rdbuf();
+                code = ss.str();
+            }
+
+            auto asm_code = compileSource(code, options, log, input);
+            if (!asm_code) {
+                throw std::runtime_error("Empty program");
+            }
+
+            auto output_path = fs::path(output_dir) / (stem + ".asm");
+            if (!asm_code->writeFile(output_path.string())) {
+                throw std::runtime_error("Unable to write " + output_path.string());
+            }
+
+            result.ok = true;
+        }
+        catch (const std::exception& e) {
+            result.error = e.what();
+        }
+
+        if (std::ofstream flog{ fs::path(output_dir) / (stem + ".log") }) {
+            flog << log.rdbuf();
+        }
+
+        result.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int printSummary(const std::vector<std::string>& inputs, double wall_ms) {
+        int failed = 0;
+        double total_ms = 0;
+
+        // Diagnostics in input order, whatever order the files finished in.
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (!results[i].ok) {
+                *err << inputs[i] << ": " << results[i].error << "\n";
+                ++failed;
+            }
+        }
+
+        *log << std::fixed << std::setprecision(2);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            *log << std::setw(10) << results[i].millis << " ms  "
+                << (results[i].ok ? "ok    " : "FAILED") << "  " << inputs[i] << "\n";
+            total_ms += results[i].millis;
+        }
+
+        *log << inputs.size() - failed << " compiled, " << failed << " failed. "
+            << total_ms << " ms compile time, " << wall_ms << " ms wall time.\n";
+
+        if (options.cache != nullptr) {
+            *log << options.cache->sessionHits() << " cache hits, "
+                << options.cache->sessionMisses() << " cache misses.\n";
+        }
+
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+};
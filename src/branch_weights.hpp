@@ -0,0 +1,94 @@
+#pragma once
+
+#include "sha256.hpp"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <unordered_map>
+#include <cstdint>
+#include <stdexcept>
+
+// Branch and loop counts of an instrumented (--profile) run, as written by
+// `hydro_prof --weights`. Lines look like
+//   branch <function> <line> <executed> <taken>
+//   loop <function> <line> <entries> <iterations>
+// Counts of several branches or loops on one line are added up.
+class BranchWeights {
+public:
+    struct Branch {
+        uint64_t executed = 0;
+        uint64_t taken = 0;
+    };
+
+    struct Loop {
+        uint64_t entries = 0;
+        uint64_t iterations = 0;
+    };
+
+    static BranchWeights load(const std::string& path) {
+        std::ifstream fin(path);
+        if (!fin) {
+            throw std::runtime_error("Unable to open branch weights: " + path);
+        }
+
+        std::stringstream ss;
+        ss << fin.rdbuf();
+        std::string content = ss.str();
+
+        BranchWeights weights;
+        weights.content_digest = Sha256::hash(content);
+
+        std::stringstream lines(content);
+        std::string line;
+        int line_number = 0;
+
+        while (std::getline(lines, line)) {
+            ++line_number;
+            if (line.empty() || line[0] == '#') continue;
+
+            std::stringstream fields(line);
+            std::string kind, function;
+            int source_line;
+            uint64_t first, second;
+
+            if (!(fields >> kind >> function >> source_line >> first >> second) || (kind != "branch" && kind != "loop")) {
+                throw std::runtime_error("Malformed branch weights in " + path + " at line:" + std::to_string(line_number));
+            }
+
+            if (kind == "branch") {
+                auto& branch = weights.branches[key(function, source_line)];
+                branch.executed += first;
+                branch.taken += second;
+            } else {
+                auto& loop = weights.loops[key(function, source_line)];
+                loop.entries += first;
+                loop.iterations += second;
+            }
+        }
+
+        return weights;
+    }
+
+    const Branch* branch(const std::string& function, int line) const {
+        auto it = branches.find(key(function, line));
+        return it == branches.end() ? nullptr : &it->second;
+    }
+
+    const Loop* loop(const std::string& function, int line) const {
+        auto it = loops.find(key(function, line));
+        return it == loops.end() ? nullptr : &it->second;
+    }
+
+    // Identifies the weights in cache keys.
+    const std::string& digest() const { return content_digest; }
+
+private:
+    std::unordered_map<std::string, Branch> branches;
+    std::unordered_map<std::string, Loop> loops;
+    std::string content_digest;
+
+    static std::string key(const std::string& function, int line) {
+        return function + ":" + std::to_string(line);
+    }
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "sha256.hpp"
+#include "asm_buffer.hpp"
+
+#include <string>
+#include <optional>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// On-disk cache of generated assembly, keyed by a SHA-256 of everything that
+// determines the output: the compiler version, the options and the source.
+//
+// Entries are written to a temporary file and renamed into place, so readers
+// never see partial entries. A hit refreshes the entry's mtime, which is the
+// LRU order used when the cache grows beyond its size cap. Eviction and the
+// hit/miss counters are serialized across processes with flock on a lock file.
+class CompileCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    CompileCache(std::string dir, uint64_t max_bytes) : dir(std::move(dir)), max_bytes(max_bytes) {
+        std::filesystem::create_directories(this->dir);
+    }
+
+    static std::string makeKey(std::string_view version, std::string_view options, std::string_view source) {
+        return Sha256()
+            .update(version).update(std::string_view("\0", 1))
+            .update(options).update(std::string_view("\0", 1))
+            .update(source)
+            .hexDigest();
+    }
+
+    std::optional<std::string> lookup(const std::string& key) {
+        auto path = entryPath(key);
+
+        std::ifstream fin(path, std::ios::binary);
+        if (!fin) {
+            ++session_misses;
+            updateCounters(0, 1);
+            return std::nullopt;
+        }
+
+        std::stringstream ss;
+        ss << fin.rdbuf();
+
+        std::error_code ignored;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ignored);
+
+        ++session_hits;
+        updateCounters(1, 0);
+        return ss.str();
+    }
+
+    void store(const std::string& key, const AsmBuffer& content) {
+        namespace fs = std::filesystem;
+
+        auto path = entryPath(key);
+        fs::create_directories(path.parent_path());
+
+        auto tmp_path = path;
+        tmp_path += ".tmp" + std::to_string(getpid()) + "_" + std::to_string(temp_counter++);
+
+        if (!content.writeFile(tmp_path.string())) {
+            std::error_code ignored;
+            fs::remove(tmp_path, ignored);
+            return;
+        }
+
+        std::error_code error;
+        fs::rename(tmp_path, path, error);
+        if (error) {
+            fs::remove(tmp_path, error);
+            return;
+        }
+
+        evictIfNeeded();
+    }
+
+    Stats stats() {
+        Stats stats;
+        Lock lock(lockPath());
+        readCounters(stats.hits, stats.misses);
+
+        for (auto& entry : listEntries()) {
+            ++stats.entries;
+            stats.bytes += entry.size;
+        }
+        return stats;
+    }
+
+    uint64_t sessionHits() const { return session_hits; }
+    uint64_t sessionMisses() const { return session_misses; }
+
+private:
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type last_used;
+        uint64_t size;
+    };
+
+    // Exclusive flock held for the lifetime of the object.
+    class Lock {
+    public:
+        explicit Lock(const std::string& path) {
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd >= 0) flock(fd, LOCK_EX);
+        }
+        ~Lock() {
+            if (fd >= 0) {
+                flock(fd, LOCK_UN);
+                close(fd);
+            }
+        }
+    private:
+        int fd;
+    };
+
+    std::string dir;
+    uint64_t max_bytes;
+    std::atomic<uint64_t> session_hits{ 0 };
+    std::atomic<uint64_t> session_misses{ 0 };
+    std::atomic<uint64_t> temp_counter{ 0 };
+
+    std::filesystem::path entryPath(const std::string& key) const {
+        return std::filesystem::path(dir) / key.substr(0, 2) / (key.substr(2) + ".asm");
+    }
+
+    std::string lockPath() const {
+        return (std::filesystem::path(dir) / "lock").string();
+    }
+
+    std::filesystem::path countersPath() const {
+        return std::filesystem::path(dir) / "stats";
+    }
+
+    void readCounters(uint64_t& hits, uint64_t& misses) {
+        std::ifstream fin(countersPath());
+        if (!(fin >> hits >> misses)) {
+            hits = misses = 0;
+        }
+    }
+
+    void updateCounters(uint64_t hits, uint64_t misses) {
+        Lock lock(lockPath());
+
+        uint64_t total_hits, total_misses;
+        readCounters(total_hits, total_misses);
+
+        std::ofstream fout(countersPath(), std::ios::trunc);
+        fout << total_hits + hits << ' ' << total_misses + misses << '\n';
+    }
+
+    std::vector<Entry> listEntries() {
+        namespace fs = std::filesystem;
+
+        std::vector<Entry> entries;
+        std::error_code error;
+
+        for (auto it = fs::recursive_directory_iterator(dir, error); !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+            if (!it->is_regular_file(error) || it->path().extension() != ".asm") continue;
+
+            auto size = it->file_size(error);
+            auto last_used = it->last_write_time(error);
+            if (error) {
+                // Removed by another process while listing.
+                error.clear();
+                continue;
+            }
+            entries.push_back(Entry{ it->path(), last_used, size });
+        }
+
+        return entries;
+    }
+
+    // Drops least recently used entries until the cache is at 90% of its cap.
+    void evictIfNeeded() {
+        Lock lock(lockPath());
+
+        auto entries = listEntries();
+        uint64_t total = 0;
+        for (auto& entry : entries) total += entry.size;
+
+        if (total <= max_bytes) return;
+
+        std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.last_used < b.last_used; });
+
+        uint64_t target = max_bytes / 10 * 9;
+        for (auto& entry : entries) {
+            if (total <= target) break;
+
+            std::error_code error;
+            if (std::filesystem::remove(entry.path, error)) {
+                total -= entry.size;
+            }
+        }
+    }
+};
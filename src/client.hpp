@@ -0,0 +1,249 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// The client side of the compile server. It is kept free of iostreams and
+// the compiler headers, so the hydro_client tool starts fast.
+
+// One end of a client/server connection. Every field of a message is sent
+// as its size in decimal, a newline and its bytes.
+class SocketStream {
+public:
+    explicit SocketStream(int fd) : fd(fd) {}
+
+    ~SocketStream() {
+        if (fd >= 0) close(fd);
+    }
+
+    SocketStream(const SocketStream&) = delete;
+    SocketStream& operator=(const SocketStream&) = delete;
+
+    void write(std::string_view field) {
+        output += std::to_string(field.size());
+        output += '\n';
+        output += field;
+    }
+
+    // Sends everything written so far.
+    bool flush() {
+        size_t sent = 0;
+        while (sent < output.size()) {
+            auto n = send(fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += n;
+        }
+        output.clear();
+        return true;
+    }
+
+    std::optional<std::string> read() {
+        size_t size = 0;
+        int digits = 0;
+        while (true) {
+            auto c = readByte();
+            if (!c) return std::nullopt;
+            if (c.value() == '\n') break;
+            if (c.value() < '0' || c.value() > '9' || ++digits > 15) return std::nullopt;
+            size = size * 10 + (c.value() - '0');
+        }
+        if (digits == 0) return std::nullopt;
+
+        std::string field(size, '\0');
+        for (size_t filled = 0; filled < size;) {
+            if (begin == end && !fill()) return std::nullopt;
+
+            size_t n = std::min(size - filled, end - begin);
+            std::memcpy(field.data() + filled, buffer + begin, n);
+            begin += n;
+            filled += n;
+        }
+        return field;
+    }
+
+    std::optional<long long> readNumber() {
+        auto field = read();
+        if (!field || field->empty() || field->size() > 18) return std::nullopt;
+
+        long long value = 0;
+        bool negative = (*field)[0] == '-';
+        for (size_t i = negative ? 1 : 0; i < field->size(); ++i) {
+            char c = (*field)[i];
+            if (c < '0' || c > '9') return std::nullopt;
+            value = value * 10 + (c - '0');
+        }
+        return negative ? -value : value;
+    }
+
+private:
+    int fd;
+    std::string output;
+    char buffer[1 << 16];
+    size_t begin = 0;
+    size_t end = 0;
+
+    bool fill() {
+        while (true) {
+            auto n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            begin = 0;
+            end = n;
+            return true;
+        }
+    }
+
+    std::optional<char> readByte() {
+        if (begin == end && !fill()) return std::nullopt;
+        return buffer[begin++];
+    }
+};
+
+// A compile request: "hydro-request 1", the working directory, the value
+// of HYDRO_CACHE_DIR (empty when unset), the argument count and arguments,
+// then the file count and a path and content for every file. The response
+// is "hydro-response 1", the exit code, stdout and stderr.
+namespace compile_protocol {
+    inline constexpr std::string_view request_header = "hydro-request 1";
+    inline constexpr std::string_view response_header = "hydro-response 1";
+}
+
+// Unix socket path used when --socket isn't given.
+inline std::string defaultSocketPath() {
+    if (auto runtime_dir = std::getenv("XDG_RUNTIME_DIR"); runtime_dir != nullptr && *runtime_dir != '\0') {
+        return std::string(runtime_dir) + "/hydro.sock";
+    }
+    return "/tmp/hydro-" + std::to_string(getuid()) + ".sock";
+}
+
+inline sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// Forwards the arguments, the working directory and the sources to a
+// compile server and replays its output.
+class CompileClient {
+public:
+    // Returns nothing when no server answers, so the caller can compile itself.
+    static std::optional<int> run(const std::string& socket_path, const std::vector<std::string>& args) {
+        auto address = socketAddress(socket_path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return std::nullopt;
+
+        SocketStream stream(fd);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            return std::nullopt;
+        }
+
+        auto env_cache_dir = std::getenv("HYDRO_CACHE_DIR");
+
+        stream.write(compile_protocol::request_header);
+        stream.write(workingDirectory());
+        stream.write(env_cache_dir != nullptr ? env_cache_dir : "");
+        stream.write(std::to_string(args.size()));
+        for (auto& arg : args) {
+            stream.write(arg);
+        }
+
+        auto files = sources(args);
+        stream.write(std::to_string(files.size()));
+        for (auto& [path, content] : files) {
+            stream.write(path);
+            stream.write(content);
+        }
+
+        if (!stream.flush()) return std::nullopt;
+        shutdown(fd, SHUT_WR);
+
+        auto header = stream.read();
+        auto exit_code = stream.readNumber();
+        auto out = stream.read();
+        auto err = stream.read();
+        if (header != compile_protocol::response_header || !exit_code || !out || !err) {
+            writeAll(STDERR_FILENO, "The compile server on " + socket_path + " closed the connection.\n");
+            return EXIT_FAILURE;
+        }
+
+        writeAll(STDOUT_FILENO, out.value());
+        writeAll(STDERR_FILENO, err.value());
+        return exit_code.value();
+    }
+
+private:
+    static std::string workingDirectory() {
+        std::string path(4096, '\0');
+        while (getcwd(path.data(), path.size()) == nullptr) {
+            if (errno != ERANGE) return "";
+            path.resize(path.size() * 2);
+        }
+        path.resize(std::strlen(path.c_str()));
+        return path;
+    }
+
+    static void writeAll(int fd, std::string_view text) {
+        while (!text.empty()) {
+            auto n = ::write(fd, text.data(), text.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            text.remove_prefix(n);
+        }
+    }
+
+    static std::optional<std::string> readFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::nullopt;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        std::string content;
+        char chunk[1 << 16];
+        while (true) {
+            auto n = ::read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            content.append(chunk, n);
+        }
+        close(fd);
+        return content;
+    }
+
+    // Arguments naming a regular file: the inputs and the manifest. The
+    // server reads anything else, like the files a manifest lists, itself.
+    static std::vector<std::pair<std::string, std::string>> sources(const std::vector<std::string>& args) {
+        std::vector<std::pair<std::string, std::string>> files;
+
+        for (auto& arg : args) {
+            if (arg.empty() || arg[0] == '-') continue;
+            if (auto content = readFile(arg)) {
+                files.emplace_back(arg, std::move(content.value()));
+            }
+        }
+        return files;
+    }
+};
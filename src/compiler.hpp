@@ -0,0 +1,258 @@
+#pragma once
+
+#include "tokenizer.hpp"
+#include "parallel_tokenizer.hpp"
+#include "parser.hpp"
+#include "parallel_parser.hpp"
+#include "type_check.hpp"
+#include "pass_manager.hpp"
+#include "generator.hpp"
+#include "incremental.hpp"
+#include "thread_pool.hpp"
+#include "cache.hpp"
+#include "stats.hpp"
+#include "util.hpp"
+
+#include <iostream>
+#include <string>
+#include <optional>
+#include <filesystem>
+
+#ifndef HYDRO_VERSION
+#define HYDRO_VERSION "dev"
+#endif
+
+// Identifies the compiler build. The build time is part of it, so a rebuilt
+// compiler never reuses assembly cached by an older one.
+inline const char* compilerVersion() {
+    return HYDRO_VERSION " " __DATE__ " " __TIME__;
+}
+
+enum class AstDump {
+    PreOrder,
+    LevelOrder,
+    SExpr,
+};
+
+struct CompileOptions {
+    ThreadPool* pool = nullptr;
+    CompileCache* cache = nullptr;
+    // Filled with per-phase measurements when set.
+    CompileStats* stats = nullptr;
+    // Directory of per-file function databases; empty compiles whole files.
+    std::string incremental_dir;
+    // Relative source paths are relative to it; empty is the process's.
+    std::filesystem::path working_dir;
+    // Instrument the generated code with execution counters.
+    bool profile = false;
+    // The profile counts that guide block layout when set.
+    const BranchWeights* branch_weights = nullptr;
+    // Optimization passes in order, see pass_manager.hpp.
+    std::vector<std::string> passes = PassManager::preset("2");
+    bool optimize_size = false;
+    // Verify the tree after every pass also in builds with NDEBUG.
+    bool verify_passes = false;
+    // Report the time of every pass to the log.
+    bool time_passes = false;
+    // Run only this many passes of the pipeline; negative runs them all.
+    int bisect_limit = -1;
+    // Line table and function symbols for debuggers and profilers.
+    bool debug_info = false;
+    // Debug dumps written to the log. Nothing is dumped by default.
+    bool dump_tokens = false;
+    std::vector<AstDump> ast_dumps;
+
+    // Everything in the options that can change the generated code.
+    // The thread pool doesn't: parallel and serial output are identical.
+    // Debug info names the source file, so then the path is part of it.
+    std::string fingerprint(const std::string& source_path) const {
+        std::string result = "target=x86_64-linux-nasm";
+        if (!incremental_dir.empty()) result += " incremental";
+        if (profile) result += " profile";
+        if (branch_weights != nullptr) result += " weights=" + branch_weights->digest();
+        result += " passes=" + PassManager::join(passManager().effectivePipeline());
+        if (optimize_size) result += " size";
+        if (debug_info) result += " debug=" + source_path;
+        return result;
+    }
+
+    CodegenOptions codegen(const std::string& source_path) const {
+        auto manager = passManager();
+        return CodegenOptions{
+            .profile = profile,
+            .layout = manager.runs("layout"),
+            .weights = branch_weights,
+            .debug_info = debug_info,
+            .source_name = source_path,
+            .vectorize = manager.runs("vectorize"),
+        };
+    }
+
+    PassManager passManager() const {
+        PassManager manager(passes);
+        manager.verify = manager.verify || verify_passes;
+        manager.optimize_size = optimize_size;
+        manager.bisect_limit = bisect_limit;
+        manager.time_passes = time_passes;
+        manager.profile = profile;
+        return manager;
+    }
+};
+
+// Runs the whole pipeline on one source file. Dumps and pass reports go to log.
+// source_path only names the function database in incremental mode.
+// Returns nothing for an empty program, throws on errors. With a cache, a hit
+// skips the whole pipeline; the cache isn't read when dumps are requested.
+inline std::optional<AsmBuffer> compileSource(std::string& code, const CompileOptions& options, std::ostream& log, const std::string& source_path = "") {
+    auto pool = options.pool;
+    auto stats = options.stats;
+
+    if (stats != nullptr) {
+        stats->source_bytes = code.size();
+    }
+
+    auto finish = [&](std::optional<AsmBuffer> asm_code) {
+        if (stats != nullptr && asm_code) {
+            stats->instructions = CompileStats::countInstructions(asm_code.value());
+            stats->output_bytes = asm_code->size();
+        }
+        return asm_code;
+    };
+
+    std::string cache_key;
+    if (options.cache != nullptr) {
+        CompileStats::Scope phase(stats, "cache");
+        cache_key = CompileCache::makeKey(compilerVersion(), options.fingerprint(source_path), code);
+
+        // Dumps and pass reports come from running the pipeline.
+        bool wants_dumps = options.dump_tokens || !options.ast_dumps.empty() || options.time_passes || options.bisect_limit >= 0;
+        if (auto cached = wants_dumps ? std::nullopt : options.cache->lookup(cache_key)) {
+            log << "Loaded from cache: " << cache_key << "\n";
+            return finish(AsmBuffer(std::move(cached.value())));
+        }
+    }
+
+    std::vector<Token> tokens;
+    {
+        CompileStats::Scope phase(stats, "tokenize");
+        if (pool != nullptr) {
+            tokens = ParallelTokenizer(code, *pool).tokenize();
+        } else {
+            tokens = Tokenizer(code).tokenize();
+        }
+    }
+    if (stats != nullptr) {
+        stats->tokens = tokens.size();
+    }
+
+    if (options.dump_tokens) {
+        CompileStats::Scope phase(stats, "dump");
+        printTokens(tokens, log);
+    }
+
+    if (!options.incremental_dir.empty()) {
+        std::optional<AsmBuffer> asm_code;
+        auto db_path = IncrementalCompiler::databasePath(options.incremental_dir, (options.working_dir / source_path).string());
+        IncrementalCompiler incremental(db_path, compilerVersion() + std::string(" ") + options.fingerprint(source_path), pool);
+        auto manager = options.passManager();
+        incremental.codegen = options.codegen(source_path);
+        incremental.fold = manager.runs("fold") || manager.runs("ctfe");
+        incremental.cse = manager.runs("cse");
+
+        {
+            CompileStats::Scope phase(stats, "incremental");
+            asm_code = incremental.compile(tokens);
+        }
+        if (!asm_code) {
+            return std::nullopt;
+        }
+        log << "Incremental: " << incremental.regeneratedFunctions() << " functions regenerated, "
+            << incremental.reusedFunctions() << " reused.\n";
+
+        if (stats != nullptr) {
+            stats->functions = incremental.regeneratedFunctions() + incremental.reusedFunctions();
+        }
+
+        if (options.cache != nullptr) {
+            options.cache->store(cache_key, asm_code.value());
+        }
+        return finish(std::move(asm_code));
+    }
+
+
+    std::unique_ptr<TreeNode> tree_root;
+    {
+        CompileStats::Scope phase(stats, "parse");
+        if (pool != nullptr) {
+            tree_root = ParallelParser(tokens, *pool).parseProgram();
+        } else {
+            tree_root = Parser(tokens).parseProgram();
+        }
+    }
+
+    if (tree_root == nullptr) {
+        return std::nullopt;
+    }
+    log << "Tree generated.\n";
+
+    {
+        CompileStats::Scope phase(stats, "type check");
+        TypeChecker(tree_root).run();
+    }
+
+    if (stats != nullptr) {
+        stats->ast_nodes = CompileStats::countNodes(tree_root.get());
+    }
+
+    if (!options.ast_dumps.empty()) {
+        CompileStats::Scope phase(stats, "dump");
+
+        for (auto dump : options.ast_dumps) {
+            switch (dump) {
+            case AstDump::PreOrder:
+                printTreePreOrder(tree_root, log);
+                break;
+            case AstDump::LevelOrder:
+                printTreeLevelOrder(tree_root, log);
+                break;
+            case AstDump::SExpr:
+                tree_root->printSExpr(log);
+                break;
+            }
+            log << "\n";
+        }
+    }
+
+
+    {
+        CompileStats::Scope phase(stats, "optimize");
+
+        auto manager = options.passManager();
+        manager.run(tree_root, log);
+        if (options.time_passes) {
+            manager.printTimes(log);
+        }
+    }
+
+    if (stats != nullptr) {
+        for (TreeNode* decl = tree_root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left != nullptr && decl->left->token.type == TokenType::FUNCTION_DECL) {
+                ++stats->functions;
+            }
+        }
+    }
+
+
+    AsmBuffer asm_code;
+    {
+        CompileStats::Scope phase(stats, "generate");
+        Generator generator(tree_root, pool);
+        generator.codegen = options.codegen(source_path);
+        asm_code = generator.generateAsm64();
+    }
+
+    if (options.cache != nullptr) {
+        options.cache->store(cache_key, asm_code);
+    }
+    return finish(std::move(asm_code));
+}
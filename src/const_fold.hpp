@@ -0,0 +1,163 @@
+#pragma once
+
+#include "parser.hpp"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+
+class ConstantFolder {
+public:
+    // Folds every operator whose operands are literals, bottom up. Float
+    // operations give the same bits as the generated SSE2 code.
+    static void fold(std::unique_ptr<TreeNode>& node) {
+        if (node == nullptr) return;
+
+        if (auto if_node = dynamic_cast<IfNode*>(node.get())) {
+            fold(if_node->condition);
+        }
+
+        fold(node->left);
+        fold(node->right);
+
+        if (auto value = evaluate(node.get())) {
+            Token token{
+                .type = TokenType::INT_LIT,
+                .lexeme = std::to_string(value.value()),
+                .line = node->token.line,
+            };
+            node = std::make_unique<TreeNode>(token);
+        } else if (auto value = evaluateFloat(node.get())) {
+            Token token{
+                .type = TokenType::FLOAT_LIT,
+                .lexeme = floatLexeme(value.value()),
+                .line = node->token.line,
+            };
+            node = std::make_unique<TreeNode>(token);
+        }
+    }
+
+    static std::optional<long long> literalValue(const TreeNode* node) {
+        if (node == nullptr || node->token.type != TokenType::INT_LIT) {
+            return std::nullopt;
+        }
+        return std::stoll(node->token.lexeme);
+    }
+
+    static std::optional<double> floatValue(const TreeNode* node) {
+        if (node == nullptr || node->token.type != TokenType::FLOAT_LIT) {
+            return std::nullopt;
+        }
+        return std::strtod(node->token.lexeme.c_str(), nullptr);
+    }
+
+    // Spelling of a computed float. It reads back as the same value, and
+    // never as an integer literal.
+    static std::string floatLexeme(double value) {
+        char buffer[32];
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+
+        std::string lexeme(buffer, end);
+        if (lexeme.find_first_of(".ein") == std::string::npos) {
+            lexeme += ".0";
+        }
+        return lexeme;
+    }
+
+    // Applies a binary operator the way the generated code does.
+    // Unary minus is generated as 0 - operand.
+    static std::optional<long long> apply(TokenType type, long long lhs, long long rhs) {
+        unsigned long long a = lhs, b = rhs;
+
+        switch (type) {
+        case TokenType::PLUS: return (long long)(a + b);
+        case TokenType::MINUS: return (long long)(a - b);
+        case TokenType::STAR: return (long long)(a * b);
+        case TokenType::SLASH:
+            if (rhs == 0 || (lhs == LLONG_MIN && rhs == -1)) return std::nullopt;
+            return lhs / rhs;
+        case TokenType::PERCENTAGE:
+            if (rhs == 0 || (lhs == LLONG_MIN && rhs == -1)) return std::nullopt;
+            return lhs % rhs;
+        case TokenType::LESS: return lhs < rhs;
+        case TokenType::LESS_EQUAL: return lhs <= rhs;
+        case TokenType::EQUAL_EQUAL: return lhs == rhs;
+        case TokenType::GREATER: return lhs > rhs;
+        case TokenType::GREATER_EQUAL: return lhs >= rhs;
+        case TokenType::AND: return (long long)(a & b);
+        case TokenType::OR: return (long long)(a | b);
+        default: return std::nullopt;
+        }
+    }
+
+private:
+    static std::optional<long long> evaluate(const TreeNode* node) {
+        auto type = node->token.type;
+
+        if (type == TokenType::FLOAT_TO_INT) {
+            // cvttsd2si gives INT64_MIN for anything out of range, NaN included.
+            auto value = floatValue(node->right.get());
+            if (!value || !(value.value() >= -0x1p63 && value.value() < 0x1p63)) return std::nullopt;
+            return static_cast<long long>(value.value());
+        }
+
+        if (isFloatComparison(type)) {
+            auto lhs = floatValue(node->left.get());
+            auto rhs = floatValue(node->right.get());
+            if (!lhs || !rhs) return std::nullopt;
+
+            switch (type) {
+            case TokenType::FLOAT_LESS: return lhs.value() < rhs.value();
+            case TokenType::FLOAT_LESS_EQUAL: return lhs.value() <= rhs.value();
+            case TokenType::FLOAT_GREATER: return lhs.value() > rhs.value();
+            case TokenType::FLOAT_GREATER_EQUAL: return lhs.value() >= rhs.value();
+            default: return lhs.value() == rhs.value();
+            }
+        }
+
+        auto rhs = literalValue(node->right.get());
+        if (!rhs) return std::nullopt;
+
+        std::optional<long long> lhs = 0;
+        if (node->left != nullptr) {
+            lhs = literalValue(node->left.get());
+        }
+        if (!lhs) return std::nullopt;
+
+        return apply(node->token.type, lhs.value(), rhs.value());
+    }
+
+    static std::optional<double> evaluateFloat(const TreeNode* node) {
+        auto type = node->token.type;
+
+        if (type == TokenType::INT_TO_FLOAT) {
+            auto value = literalValue(node->right.get());
+            if (!value) return std::nullopt;
+            return static_cast<double>(value.value());
+        }
+
+        if (!isFloatArithmetic(type)) return std::nullopt;
+
+        auto rhs = floatValue(node->right.get());
+        if (!rhs) return std::nullopt;
+
+        // Negation flips the sign bit, so -0.0 stays apart from 0.0.
+        if (node->left == nullptr) {
+            return type == TokenType::FLOAT_MINUS ? std::optional<double>(-rhs.value()) : std::nullopt;
+        }
+
+        auto lhs = floatValue(node->left.get());
+        if (!lhs) return std::nullopt;
+
+        switch (type) {
+        case TokenType::FLOAT_PLUS: return lhs.value() + rhs.value();
+        case TokenType::FLOAT_MINUS: return lhs.value() - rhs.value();
+        case TokenType::FLOAT_STAR: return lhs.value() * rhs.value();
+        default: return lhs.value() / rhs.value();
+        }
+    }
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "parser.hpp"
+#include "generator.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>
+#include <optional>
+
+// Global value numbering over the expressions of each function.
+//
+// A pure expression is numbered by its operator and the numbers of its
+// operands. A variable's number changes whenever it may be stored to, and
+// a call changes those of every global, so equal numbers are equal values.
+// An expression whose number was computed before, by an expression that
+// dominates it (earlier in its block, or before the if, switch or loop it
+// is in), reads a temporary that the first computation stores to:
+// x = a*b + a*b becomes x = (t = a*b) + t.
+class CommonSubexpressionEliminator {
+public:
+    // Loops the generator vectorizes are left alone, as temporaries would
+    // keep them from matching.
+    bool keep_vector_loops = true;
+
+    CommonSubexpressionEliminator(std::unique_ptr<TreeNode>& root) : root(root) {}
+
+    void run() {
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left != nullptr && decl->left->token.type == TokenType::FUNCTION_DECL) {
+                runOnFunction(decl->left.get());
+            }
+        }
+    }
+
+    void runOnFunction(TreeNode* function) {
+        auto fn_node = dynamic_cast<FuncNode*>(function);
+        if (fn_node == nullptr) return;
+
+        storage_ids.clear();
+        versions.assign(1, 0);
+        global_storage.assign(1, true);
+        numbers.clear();
+        literals.clear();
+        available.clear();
+        scopes.assign(1, {});
+        leaders.clear();
+        redundant.clear();
+
+        visitStatement(fn_node->right);
+
+        for (auto& occurrence : redundant) {
+            auto& leader = leaders[occurrence.leader];
+            if (leader.temp_offset.empty()) {
+                leader.temp_offset = std::to_string(8 * ++fn_node->max_local_var_count);
+                ++temps;
+            }
+
+            int line = (*occurrence.link)->token.line;
+            *occurrence.link = std::make_unique<TreeNode>(Token{ .type = TokenType::IDENTIFIER, .lexeme = leader.temp_offset, .line = line });
+            ++eliminated_count;
+        }
+
+        for (auto& leader : leaders) {
+            if (leader.temp_offset.empty()) continue;
+
+            int line = (*leader.link)->token.line;
+            *leader.link = std::make_unique<TreeNode>(
+                Token{ .type = TokenType::EQUAL, .lexeme = "=", .line = line },
+                std::make_unique<TreeNode>(Token{ .type = TokenType::IDENTIFIER, .lexeme = leader.temp_offset, .line = line }),
+                std::move(*leader.link)
+            );
+        }
+    }
+
+    int eliminated() const { return eliminated_count; }
+    int temporaries() const { return temps; }
+
+private:
+    // The first computation of a value; temp_offset is set once it is reused.
+    struct Leader {
+        std::unique_ptr<TreeNode>* link;
+        std::string temp_offset;
+    };
+
+    struct Occurrence {
+        std::unique_ptr<TreeNode>* link;
+        size_t leader;
+    };
+
+    std::unique_ptr<TreeNode>& root;
+    int eliminated_count = 0;
+    int temps = 0;
+
+    // Every variable and array has a storage id; id 0 stands for everything
+    // a call may change. A store gives the storage a new version.
+    std::unordered_map<std::string, int> storage_ids;
+    std::vector<int> versions;
+    std::vector<bool> global_storage;
+    int last_version = 0;
+
+    // An operation is keyed by its operator and operand numbers, the contents
+    // of a storage by its negated id and versions.
+    struct NumberKey {
+        int op;
+        int left;
+        int right;
+
+        bool operator==(const NumberKey&) const = default;
+    };
+
+    struct NumberKeyHash {
+        size_t operator()(const NumberKey& key) const {
+            uint64_t hash = uint32_t(key.op) * 0x9E3779B97F4A7C15ull;
+            hash = (hash ^ uint32_t(key.left)) * 0x9E3779B97F4A7C15ull;
+            return (hash ^ uint32_t(key.right)) * 0x9E3779B97F4A7C15ull;
+        }
+    };
+
+    std::unordered_map<NumberKey, int, NumberKeyHash> numbers;
+    std::unordered_map<std::string, int> literals;
+
+    // Leader of each number available at the current point, or -1, and the
+    // numbers made available in each enclosing branch or loop body.
+    std::vector<int> available;
+    std::vector<std::vector<int>> scopes;
+
+    std::vector<Leader> leaders;
+    std::vector<Occurrence> redundant;
+
+    static bool isStore(TokenType type) {
+        return type == TokenType::EQUAL || type == TokenType::PLUS_EQUAL || type == TokenType::MINUS_EQUAL;
+    }
+
+    static bool isTerminal(const TreeNode* node) {
+        auto type = node->token.type;
+        return type == TokenType::INT_LIT || type == TokenType::IDENTIFIER || type == TokenType::GLOBAL_VAR;
+    }
+
+    static bool isCommutative(TokenType type) {
+        return type == TokenType::PLUS || type == TokenType::STAR || type == TokenType::EQUAL_EQUAL
+            || type == TokenType::AND || type == TokenType::OR
+            || type == TokenType::FLOAT_PLUS || type == TokenType::FLOAT_STAR || type == TokenType::FLOAT_EQUAL_EQUAL;
+    }
+
+    // Locals and local arrays are named by their frame offsets, globals by their names.
+    int storageId(const TreeNode* node) {
+        char kind;
+        switch (node->token.type) {
+        case TokenType::IDENTIFIER: kind = 'l'; break;
+        case TokenType::GLOBAL_VAR: kind = 'g'; break;
+        case TokenType::ARRAY: kind = 'a'; break;
+        case TokenType::GLOBAL_ARRAY: kind = 'A'; break;
+        default: return 0;
+        }
+
+        std::string key(1, kind);
+        key += node->token.lexeme;
+
+        auto [it, inserted] = storage_ids.emplace(std::move(key), versions.size());
+        if (inserted) {
+            versions.push_back(0);
+            global_storage.push_back(kind == 'g' || kind == 'A');
+        }
+        return it->second;
+    }
+
+    // Storage a store writes: a variable, or any element of an array.
+    int storeId(const TreeNode* target) {
+        if (target->token.type == TokenType::INDEX) return storageId(target->left.get());
+        return storageId(target);
+    }
+
+    void collectStores(const TreeNode* node, std::vector<int>& stored) {
+        if (node == nullptr) return;
+
+        auto type = node->token.type;
+        if (isStore(type) && node->left != nullptr) {
+            stored.push_back(storeId(node->left.get()));
+        } else if (isDeclaration(node) && node->left != nullptr) {
+            stored.push_back(storageId(node->left.get()));
+        } else if (type == TokenType::FUNCTION_CALL) {
+            stored.push_back(0);
+        }
+
+        if (type == TokenType::IF) {
+            collectStores(static_cast<const IfNode*>(node)->condition.get(), stored);
+        }
+        collectStores(node->left.get(), stored);
+        collectStores(node->right.get(), stored);
+    }
+
+    std::vector<int> storesIn(const std::vector<const TreeNode*>& nodes) {
+        std::vector<int> stored;
+        for (auto node : nodes) {
+            collectStores(node, stored);
+        }
+        std::sort(stored.begin(), stored.end());
+        stored.erase(std::unique(stored.begin(), stored.end()), stored.end());
+        return stored;
+    }
+
+    void store(int id) {
+        versions[id] = ++last_version;
+    }
+
+    int number(const NumberKey& key) {
+        auto [it, inserted] = numbers.emplace(key, numbers.size() + literals.size());
+        return it->second;
+    }
+
+    int literalNumber(const std::string& lexeme) {
+        auto [it, inserted] = literals.emplace(lexeme, numbers.size() + literals.size());
+        return it->second;
+    }
+
+    // Number of the current contents of a variable or an array. Globals
+    // change with calls too.
+    int storageNumber(int id) {
+        return number(NumberKey{ -1 - id, versions[id], global_storage[id] ? versions[0] : 0 });
+    }
+
+    int operationNumber(TokenType type, int left, int right) {
+        if (isCommutative(type) && left > right) std::swap(left, right);
+        return number(NumberKey{ static_cast<int>(type), left, right });
+    }
+
+    void enterScope() {
+        scopes.emplace_back();
+    }
+
+    void leaveScope() {
+        for (auto number : scopes.back()) {
+            available[number] = -1;
+        }
+        scopes.pop_back();
+    }
+
+    void visitStatement(std::unique_ptr<TreeNode>& node) {
+        if (node == nullptr) return;
+
+        switch (node->token.type) {
+        case TokenType::STATEMENT_LIST:
+            for (TreeNode* tmp = node.get(); tmp != nullptr; tmp = tmp->right.get()) {
+                visitStatement(tmp->left);
+            }
+            return;
+
+        case TokenType::RETURN:
+            visitExpr(node->right);
+            return;
+
+        case TokenType::IF: {
+            auto if_node = dynamic_cast<IfNode*>(node.get());
+            visitExpr(if_node->condition);
+            visitBranches({ &if_node->left, &if_node->right });
+            return;
+        }
+
+        case TokenType::SWITCH: {
+            visitExpr(node->left);
+
+            std::vector<std::unique_ptr<TreeNode>*> arms;
+            for (TreeNode* arm = node->right.get(); arm != nullptr; arm = arm->right.get()) {
+                arms.push_back(&arm->left);
+            }
+            visitBranches(arms);
+            return;
+        }
+
+        case TokenType::WHILE:
+            visitLoop(node.get());
+            return;
+
+        case TokenType::INT:
+        case TokenType::FLOAT:
+            if (node->left == nullptr) return;
+            visitExpr(node->right);
+            store(storageId(node->left.get()));
+            return;
+
+        default:
+            visitExpr(node);
+            return;
+        }
+    }
+
+    // Values from before the branches are available in each of them, but
+    // none of theirs is available in another branch or after them.
+    void visitBranches(const std::vector<std::unique_ptr<TreeNode>*>& branches) {
+        std::vector<const TreeNode*> nodes;
+        for (auto branch : branches) {
+            nodes.push_back(branch->get());
+        }
+        auto stored = storesIn(nodes);
+
+        std::vector<int> entry_versions;
+        for (auto id : stored) {
+            entry_versions.push_back(versions[id]);
+        }
+
+        for (auto branch : branches) {
+            enterScope();
+            visitStatement(*branch);
+            leaveScope();
+
+            for (size_t i = 0; i < stored.size(); ++i) {
+                versions[stored[i]] = entry_versions[i];
+            }
+        }
+
+        for (auto id : stored) {
+            store(id);
+        }
+    }
+
+    // Anything the loop stores is treated as changed on entry, so only values
+    // that stay the same in every iteration are carried into it.
+    void visitLoop(TreeNode* while_node) {
+        auto stored = storesIn({ while_node });
+
+        for (auto id : stored) {
+            store(id);
+        }
+        if (keep_vector_loops && FunctionGenerator::vectorizes(while_node)) return;
+
+        enterScope();
+        visitExpr(while_node->left);
+        visitStatement(while_node->right);
+        leaveScope();
+
+        for (auto id : stored) {
+            store(id);
+        }
+    }
+
+    // Numbers an expression in the order the generator evaluates it. Returns
+    // nothing for expressions with side effects.
+    std::optional<int> visitExpr(std::unique_ptr<TreeNode>& link) {
+        TreeNode* node = link.get();
+        if (node == nullptr) return std::nullopt;
+
+        auto type = node->token.type;
+
+        // Float literals are never spelled like int literals.
+        if (type == TokenType::INT_LIT || type == TokenType::FLOAT_LIT) {
+            return literalNumber(node->token.lexeme);
+        }
+
+        if (type == TokenType::IDENTIFIER || type == TokenType::GLOBAL_VAR) {
+            return storageNumber(storageId(node));
+        }
+
+        if (type == TokenType::FUNCTION_CALL) {
+            for (TreeNode* arg = node->left.get(); arg != nullptr; arg = arg->left.get()) {
+                visitExpr(arg->right);
+            }
+            store(0);
+            return std::nullopt;
+        }
+
+        if (isStore(type)) {
+            if (node->left == nullptr) return std::nullopt;
+
+            // An element store evaluates its index before the value.
+            if (node->left->token.type == TokenType::INDEX) {
+                visitExpr(node->left->right);
+            }
+            visitExpr(node->right);
+            store(storeId(node->left.get()));
+            return std::nullopt;
+        }
+
+        size_t first_redundant = redundant.size();
+        bool is_index = type == TokenType::INDEX;
+
+        std::optional<int> left = -1;
+        if (is_index) {
+            left = storageNumber(storageId(node->left.get()));
+        } else if (node->left != nullptr) {
+            left = visitExpr(node->left);
+        }
+        auto right = visitExpr(node->right);
+        if (!left || !right) return std::nullopt;
+
+        int value = operationNumber(type, left.value(), right.value());
+
+        // Reading an element with a plain index costs no more than reading a temporary.
+        bool worth_reusing = is_index ? !isTerminal(node->right.get()) : true;
+        if (!worth_reusing) return value;
+
+        if (available.size() <= size_t(value)) {
+            available.resize(value + 1, -1);
+        }
+
+        int leader = available[value];
+        if (leader < 0) {
+            available[value] = leaders.size();
+            scopes.back().push_back(value);
+            leaders.push_back(Leader{ &link, "" });
+        } else {
+            // Reusing the whole expression makes reusing its parts pointless.
+            redundant.erase(redundant.begin() + first_redundant, redundant.end());
+            redundant.push_back(Occurrence{ &link, size_t(leader) });
+        }
+        return value;
+    }
+};
@@ -0,0 +1,403 @@
+#pragma once
+
+#include "parser.hpp"
+#include "const_fold.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <memory>
+
+// Compile-time function evaluation.
+//
+// Calls to pure functions whose arguments are all literals are executed by an
+// interpreter over the tree and replaced by their result. Global initializers
+// are evaluated the same way, so the generator can place them in .data.
+class CompileTimeEvaluator {
+public:
+    // Interpreted tree nodes allowed per evaluated call.
+    long long max_steps = 1000000;
+    // Deepest call chain the interpreter will follow.
+    int max_depth = 256;
+    // When false only global initializers are evaluated and function bodies
+    // are left alone, so a function's code doesn't depend on its callees.
+    bool fold_function_bodies = true;
+
+    CompileTimeEvaluator(std::unique_ptr<TreeNode>& root) : root(root) {}
+
+    void run() {
+        if (root == nullptr) return;
+
+        collectFunctions();
+        findPureFunctions();
+
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left == nullptr) continue;
+
+            if (decl->left->token.type == TokenType::FUNCTION_DECL) {
+                if (!fold_function_bodies) continue;
+                replaceCalls(decl->left->right);
+                ConstantFolder::fold(decl->left->right);
+            } else {
+                evaluateGlobal(decl->left.get());
+            }
+        }
+    }
+
+    int evaluatedCalls() const { return evaluated_calls; }
+
+private:
+    // Thrown when the interpreter meets something it can't or shouldn't evaluate.
+    struct Abort {};
+
+    struct Returned {
+        long long value;
+    };
+
+    using Frame = std::unordered_map<std::string, long long>;
+
+    std::unique_ptr<TreeNode>& root;
+    std::unordered_map<std::string, const FuncNode*> functions;
+    std::unordered_set<std::string> pure_functions;
+    std::unordered_map<std::string, long long> global_values;
+    long long steps = 0;
+    int depth = 0;
+    int evaluated_calls = 0;
+
+    void collectFunctions() {
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left != nullptr && decl->left->token.type == TokenType::FUNCTION_DECL) {
+                functions[decl->left->token.lexeme.substr(1)] = dynamic_cast<const FuncNode*>(decl->left.get());
+            }
+        }
+    }
+
+    // A node is locally pure when it doesn't touch globals or call into the runtime.
+    bool isLocallyPure(const TreeNode* node, std::unordered_set<std::string>& callees) {
+        if (node == nullptr) return true;
+
+        if (node->token.type == TokenType::GLOBAL_VAR || node->token.type == TokenType::GLOBAL_ARRAY) return false;
+
+        if (node->token.type == TokenType::FUNCTION_CALL) {
+            if (!functions.count(node->token.lexeme)) return false;
+            callees.insert(node->token.lexeme);
+        }
+
+        if (auto if_node = dynamic_cast<const IfNode*>(node)) {
+            if (!isLocallyPure(if_node->condition.get(), callees)) return false;
+        }
+
+        return isLocallyPure(node->left.get(), callees) && isLocallyPure(node->right.get(), callees);
+    }
+
+    void findPureFunctions() {
+        std::unordered_map<std::string, std::unordered_set<std::string>> callees;
+
+        for (auto& [name, fn_node] : functions) {
+            if (isLocallyPure(fn_node->right.get(), callees[name])) {
+                pure_functions.insert(name);
+            }
+        }
+
+        // A function calling an impure function is impure as well.
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            for (auto& [name, calls] : callees) {
+                if (!pure_functions.count(name)) continue;
+
+                for (auto& callee : calls) {
+                    if (!pure_functions.count(callee)) {
+                        pure_functions.erase(name);
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    static std::unique_ptr<TreeNode> makeLiteral(long long value, int line) {
+        Token token{
+            .type = TokenType::INT_LIT,
+            .lexeme = std::to_string(value),
+            .line = line,
+        };
+        return std::make_unique<TreeNode>(token);
+    }
+
+    // Replaces qualifying calls bottom up, so nested calls fold inside out.
+    void replaceCalls(std::unique_ptr<TreeNode>& node) {
+        if (node == nullptr) return;
+
+        if (auto if_node = dynamic_cast<IfNode*>(node.get())) {
+            replaceCalls(if_node->condition);
+        }
+
+        replaceCalls(node->left);
+        replaceCalls(node->right);
+
+        if (node->token.type != TokenType::FUNCTION_CALL || !pure_functions.count(node->token.lexeme)) return;
+
+        ConstantFolder::fold(node->left);
+
+        std::vector<long long> args;
+        for (TreeNode* tmp = node->left.get(); tmp != nullptr; tmp = tmp->left.get()) {
+            auto value = ConstantFolder::literalValue(tmp->right.get());
+            if (!value) return;
+            args.insert(args.begin(), value.value());
+        }
+
+        if (auto result = tryCall(node->token.lexeme, args)) {
+            node = makeLiteral(result.value(), node->token.line);
+            ++evaluated_calls;
+        }
+    }
+
+    void evaluateGlobal(TreeNode* decl) {
+        auto name = decl->left->token.lexeme;
+        // The interpreter only computes ints, so a float global is left out
+        // of global_values and has to fold to a literal.
+        bool is_float = decl->token.type == TokenType::FLOAT;
+
+        if (decl->right == nullptr) {
+            if (!is_float) global_values[name] = 0;
+            return;
+        }
+
+        replaceCalls(decl->right);
+        ConstantFolder::fold(decl->right);
+
+        if (is_float) {
+            if (decl->right->token.type != TokenType::FLOAT_LIT) {
+                throw std::runtime_error("Initializer of global '" + name + "' is not a compile-time constant. at line:" + std::to_string(decl->token.line));
+            }
+            return;
+        }
+
+        try {
+            Frame frame;
+            steps = 0;
+            depth = 0;
+            decl->right = makeLiteral(evaluateExpr(decl->right.get(), frame), decl->right->token.line);
+        }
+        catch (Abort) {
+            throw std::runtime_error("Initializer of global '" + name + "' is not a compile-time constant. at line:" + std::to_string(decl->token.line));
+        }
+
+        global_values[name] = ConstantFolder::literalValue(decl->right.get()).value();
+    }
+
+    std::optional<long long> tryCall(const std::string& name, const std::vector<long long>& args) {
+        try {
+            steps = 0;
+            depth = 0;
+            return call(name, args);
+        }
+        catch (Abort) {
+            return std::nullopt;
+        }
+    }
+
+    long long call(const std::string& name, const std::vector<long long>& args) {
+        if (!pure_functions.count(name) || ++depth > max_depth) throw Abort{};
+
+        auto fn_node = functions.at(name);
+
+        Frame frame;
+        for (int i = 0; i < (int)args.size(); ++i) {
+            frame[std::to_string(-(i + 2) * 8)] = args[i];
+        }
+
+        try {
+            executeList(fn_node->right.get(), frame);
+        }
+        catch (Returned returned) {
+            --depth;
+            return returned.value;
+        }
+
+        // Falling off the end of a function has no defined result.
+        throw Abort{};
+    }
+
+    void step() {
+        if (++steps > max_steps) throw Abort{};
+    }
+
+    void executeList(const TreeNode* list, Frame& frame) {
+        for (const TreeNode* tmp = list; tmp != nullptr; tmp = tmp->right.get()) {
+            execute(tmp->left.get(), frame);
+        }
+    }
+
+    void execute(const TreeNode* stmt, Frame& frame) {
+        if (stmt == nullptr) return;
+        step();
+
+        switch (stmt->token.type) {
+        case TokenType::STATEMENT_LIST:
+            executeList(stmt, frame);
+            return;
+
+        case TokenType::RETURN:
+            throw Returned{ evaluateExpr(stmt->right.get(), frame) };
+
+        case TokenType::IF: {
+            auto if_node = dynamic_cast<const IfNode*>(stmt);
+            if (evaluateExpr(if_node->condition.get(), frame) != 0) {
+                executeList(stmt->left.get(), frame);
+            } else {
+                executeList(stmt->right.get(), frame);
+            }
+            return;
+        }
+
+        case TokenType::WHILE:
+            while (evaluateExpr(stmt->left.get(), frame) != 0) {
+                executeList(stmt->right.get(), frame);
+            }
+            return;
+
+        case TokenType::SWITCH: {
+            auto arm = CaseNode::select(stmt->right.get(), evaluateExpr(stmt->left.get(), frame));
+            if (arm != nullptr) {
+                executeList(arm->left.get(), frame);
+            }
+            return;
+        }
+
+        case TokenType::INT:
+        case TokenType::FLOAT:
+        case TokenType::STRING:
+            if (auto array = dynamic_cast<const ArrayNode*>(stmt->left.get())) {
+                for (long long i = 0; i < array->length; ++i) {
+                    step();
+                    frame.erase(elementSlot(array, i));
+                }
+                return;
+            }
+
+            // An uninitialized local holds whatever was left on the stack.
+            frame.erase(stmt->left->token.lexeme);
+            if (stmt->right != nullptr) {
+                frame[stmt->left->token.lexeme] = evaluateExpr(stmt->right.get(), frame);
+            }
+            return;
+
+        default:
+            evaluateExpr(stmt, frame);
+            return;
+        }
+    }
+
+    // Array elements live in the frame under the stack slot they occupy.
+    static std::string elementSlot(const ArrayNode* array, long long index) {
+        return std::to_string(std::stoll(array->token.lexeme) - index * 8);
+    }
+
+    // The slot of an indexed local array element. Out of bounds accesses are
+    // left to run time rather than given a made-up value.
+    std::string indexedSlot(const TreeNode* node, Frame& frame) {
+        auto array = dynamic_cast<const ArrayNode*>(node->left.get());
+        if (array == nullptr || array->token.type != TokenType::ARRAY) throw Abort{};
+
+        long long index = evaluateExpr(node->right.get(), frame);
+        if (index < 0 || index >= array->length) throw Abort{};
+        return elementSlot(array, index);
+    }
+
+    long long evaluateExpr(const TreeNode* node, Frame& frame) {
+        if (node == nullptr) throw Abort{};
+        step();
+
+        const auto& token = node->token;
+
+        switch (token.type) {
+        case TokenType::INT_LIT:
+            return std::stoll(token.lexeme);
+
+        case TokenType::IDENTIFIER: {
+            auto it = frame.find(token.lexeme);
+            if (it == frame.end()) throw Abort{};
+            return it->second;
+        }
+
+        case TokenType::INDEX: {
+            auto it = frame.find(indexedSlot(node, frame));
+            if (it == frame.end()) throw Abort{};
+            return it->second;
+        }
+
+        case TokenType::GLOBAL_VAR: {
+            // Only reachable from global initializers; functions touching globals are impure.
+            auto it = global_values.find(token.lexeme);
+            if (it == global_values.end()) throw Abort{};
+            return it->second;
+        }
+
+        case TokenType::FUNCTION_CALL: {
+            std::vector<long long> args;
+            for (TreeNode* tmp = node->left.get(); tmp != nullptr; tmp = tmp->left.get()) {
+                args.insert(args.begin(), evaluateExpr(tmp->right.get(), frame));
+            }
+
+            auto fn = functions.find(token.lexeme);
+            if (fn == functions.end()) throw Abort{};
+
+            int param_count = 0;
+            for (const TreeNode* param = fn->second->left->right.get(); param != nullptr; param = param->left.get()) {
+                ++param_count;
+                if (param->token.type != TokenType::COMMA) break;
+            }
+            if (param_count != (int)args.size()) throw Abort{};
+
+            return call(token.lexeme, args);
+        }
+
+        case TokenType::EQUAL:
+        case TokenType::PLUS_EQUAL:
+        case TokenType::MINUS_EQUAL: {
+            if (node->left == nullptr) throw Abort{};
+
+            std::string slot;
+            if (node->left->token.type == TokenType::IDENTIFIER) {
+                slot = node->left->token.lexeme;
+            } else if (node->left->token.type == TokenType::INDEX) {
+                // Like the generated code, the index is evaluated before the value.
+                slot = indexedSlot(node->left.get(), frame);
+            } else {
+                throw Abort{};
+            }
+
+            long long value = evaluateExpr(node->right.get(), frame);
+
+            if (token.type == TokenType::EQUAL) {
+                frame[slot] = value;
+                return value;
+            }
+
+            auto it = frame.find(slot);
+            if (it == frame.end()) throw Abort{};
+
+            unsigned long long old = it->second;
+            it->second = token.type == TokenType::PLUS_EQUAL ? (long long)(old + value) : (long long)(old - value);
+
+            // Like the generated code, compound assignments yield the right hand side.
+            return value;
+        }
+
+        default:
+            break;
+        }
+
+        // Binary (or unary minus) operators share the constant folder's semantics.
+        long long lhs = node->left != nullptr ? evaluateExpr(node->left.get(), frame) : 0;
+        long long rhs = evaluateExpr(node->right.get(), frame);
+
+        auto result = ConstantFolder::apply(token.type, lhs, rhs);
+        if (!result) throw Abort{};
+        return result.value();
+    }
+};
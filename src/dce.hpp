@@ -0,0 +1,368 @@
+#pragma once
+
+#include "parser.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <memory>
+
+// Returns true when control can never fall through the end of the given
+// statement (or statement list).
+inline bool alwaysReturns(const TreeNode* node) {
+    if (node == nullptr) return false;
+
+    switch (node->token.type) {
+    case TokenType::RETURN:
+        return true;
+
+    case TokenType::STATEMENT_LIST:
+        for (const TreeNode* tmp = node; tmp != nullptr; tmp = tmp->right.get()) {
+            if (alwaysReturns(tmp->left.get())) return true;
+        }
+        return false;
+
+    case TokenType::IF:
+        return alwaysReturns(node->left.get()) && alwaysReturns(node->right.get());
+
+    case TokenType::SWITCH: {
+        // Without a default arm a value can match no case at all.
+        bool has_default = false;
+        for (const TreeNode* arm = node->right.get(); arm != nullptr; arm = arm->right.get()) {
+            if (!alwaysReturns(arm->left.get())) return false;
+            if (arm->token.type == TokenType::DEFAULT) has_default = true;
+        }
+        return has_default;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// Returns true when evaluating the expression may do more than produce a value.
+inline bool hasSideEffects(const TreeNode* node) {
+    if (node == nullptr) return false;
+
+    switch (node->token.type) {
+    case TokenType::FUNCTION_CALL:
+    case TokenType::EQUAL:
+    case TokenType::PLUS_EQUAL:
+    case TokenType::MINUS_EQUAL:
+        return true;
+    default:
+        return hasSideEffects(node->left.get()) || hasSideEffects(node->right.get());
+    }
+}
+
+class DeadCodeEliminator {
+public:
+    DeadCodeEliminator(std::unique_ptr<TreeNode>& root) : root(root) {}
+
+    void run() {
+        if (root == nullptr) return;
+
+        removeUnreachableFunctions();
+
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left == nullptr || decl->left->token.type != TokenType::FUNCTION_DECL) continue;
+
+            auto& body = decl->left->right;
+            removeUnreachableStatements(body);
+            removeDeadStores(body);
+        }
+    }
+
+    int removedFunctions() const { return removed_functions; }
+    int removedStatements() const { return removed_statements; }
+    int removedStores() const { return removed_stores; }
+
+private:
+    std::unique_ptr<TreeNode>& root;
+    int removed_functions = 0;
+    int removed_statements = 0;
+    int removed_stores = 0;
+
+    static void collectCalls(const TreeNode* node, std::unordered_set<std::string>& calls) {
+        if (node == nullptr) return;
+
+        if (node->token.type == TokenType::FUNCTION_CALL) {
+            calls.insert(node->token.lexeme);
+        }
+
+        if (auto if_node = dynamic_cast<const IfNode*>(node)) {
+            collectCalls(if_node->condition.get(), calls);
+        }
+
+        collectCalls(node->left.get(), calls);
+        collectCalls(node->right.get(), calls);
+    }
+
+    // Drops every function that cannot be reached from main through the call graph.
+    void removeUnreachableFunctions() {
+        std::unordered_map<std::string, TreeNode*> functions;
+
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left != nullptr && decl->left->token.type == TokenType::FUNCTION_DECL) {
+                functions[decl->left->token.lexeme.substr(1)] = decl->left.get();
+            }
+        }
+
+        // Without an entry point every function is a potential root.
+        if (!functions.count("main")) return;
+
+        std::unordered_set<std::string> reachable{ "main" };
+        std::queue<std::string> pending;
+        pending.push("main");
+
+        while (!pending.empty()) {
+            auto name = pending.front();
+            pending.pop();
+
+            std::unordered_set<std::string> calls;
+            collectCalls(functions[name]->right.get(), calls);
+
+            for (auto& callee : calls) {
+                if (functions.count(callee) && reachable.insert(callee).second) {
+                    pending.push(callee);
+                }
+            }
+        }
+
+        std::unique_ptr<TreeNode>* link = &root;
+        while (*link != nullptr) {
+            auto& decl = (*link)->left;
+            bool is_dead = decl != nullptr
+                && decl->token.type == TokenType::FUNCTION_DECL
+                && !reachable.count(decl->token.lexeme.substr(1));
+
+            if (is_dead) {
+                *link = std::move((*link)->right);
+                ++removed_functions;
+            } else {
+                link = &(*link)->right;
+            }
+        }
+    }
+
+    // Folds branches with constant conditions and cuts statements following a return.
+    void removeUnreachableStatements(std::unique_ptr<TreeNode>& list) {
+        std::unique_ptr<TreeNode>* link = &list;
+
+        while (*link != nullptr) {
+            auto& stmt = (*link)->left;
+            simplifyStatement(stmt);
+
+            if (stmt == nullptr) {
+                *link = std::move((*link)->right);
+                continue;
+            }
+
+            if (alwaysReturns(stmt.get())) {
+                for (TreeNode* rest = (*link)->right.get(); rest != nullptr; rest = rest->right.get()) {
+                    ++removed_statements;
+                }
+                (*link)->right = nullptr;
+                return;
+            }
+
+            link = &(*link)->right;
+        }
+    }
+
+    void simplifyStatement(std::unique_ptr<TreeNode>& stmt) {
+        if (stmt == nullptr) return;
+
+        switch (stmt->token.type) {
+        case TokenType::STATEMENT_LIST:
+            removeUnreachableStatements(stmt);
+            return;
+
+        case TokenType::IF: {
+            auto if_node = dynamic_cast<IfNode*>(stmt.get());
+
+            if (if_node->condition->token.type == TokenType::INT_LIT) {
+                bool taken = std::stoll(if_node->condition->token.lexeme) != 0;
+                auto branch = std::move(taken ? stmt->left : stmt->right);
+                ++removed_statements;
+
+                stmt = std::move(branch);
+                simplifyStatement(stmt);
+                return;
+            }
+
+            removeUnreachableStatements(stmt->left);
+            removeUnreachableStatements(stmt->right);
+            return;
+        }
+
+        case TokenType::WHILE:
+            if (stmt->left->token.type == TokenType::INT_LIT && std::stoll(stmt->left->token.lexeme) == 0) {
+                ++removed_statements;
+                stmt = nullptr;
+                return;
+            }
+
+            removeUnreachableStatements(stmt->right);
+            return;
+
+        case TokenType::SWITCH:
+            if (stmt->left->token.type == TokenType::INT_LIT) {
+                auto arm = CaseNode::select(stmt->right.get(), std::stoll(stmt->left->token.lexeme));
+                auto body = arm != nullptr ? std::move(arm->left) : nullptr;
+                ++removed_statements;
+
+                stmt = std::move(body);
+                simplifyStatement(stmt);
+                return;
+            }
+
+            for (TreeNode* arm = stmt->right.get(); arm != nullptr; arm = arm->right.get()) {
+                removeUnreachableStatements(arm->left);
+            }
+            return;
+
+        default:
+            return;
+        }
+    }
+
+    static bool isStore(const TreeNode* node) {
+        auto type = node->token.type;
+        return (type == TokenType::EQUAL || type == TokenType::PLUS_EQUAL || type == TokenType::MINUS_EQUAL)
+            && node->left != nullptr && node->left->token.type == TokenType::IDENTIFIER;
+    }
+
+    // Collects the stack slots of every local or parameter that is read somewhere.
+    static void collectReads(const TreeNode* node, std::unordered_set<std::string>& reads) {
+        if (node == nullptr) return;
+
+        if (node->token.type == TokenType::IDENTIFIER) {
+            reads.insert(node->token.lexeme);
+            return;
+        }
+
+        if (auto if_node = dynamic_cast<const IfNode*>(node)) {
+            collectReads(if_node->condition.get(), reads);
+        }
+
+        // The target of an assignment or a declaration is a write, not a read.
+        if (isStore(node) || isDeclaration(node)) {
+            collectReads(node->right.get(), reads);
+            return;
+        }
+
+        collectReads(node->left.get(), reads);
+        collectReads(node->right.get(), reads);
+    }
+
+    // Removes stores to locals that are never read, keeping side effects of the stored value.
+    void removeDeadStores(std::unique_ptr<TreeNode>& body) {
+        bool changed = true;
+
+        while (changed) {
+            std::unordered_set<std::string> reads;
+            collectReads(body.get(), reads);
+
+            changed = false;
+            removeDeadStoresInList(body, reads, changed);
+        }
+    }
+
+    void removeDeadStoresInList(std::unique_ptr<TreeNode>& list, const std::unordered_set<std::string>& reads, bool& changed) {
+        std::unique_ptr<TreeNode>* link = &list;
+
+        while (*link != nullptr) {
+            auto& stmt = (*link)->left;
+            removeDeadStoresInStatement(stmt, reads, changed);
+
+            if (stmt == nullptr) {
+                *link = std::move((*link)->right);
+                continue;
+            }
+
+            link = &(*link)->right;
+        }
+    }
+
+    void removeDeadStoresInStatement(std::unique_ptr<TreeNode>& stmt, const std::unordered_set<std::string>& reads, bool& changed) {
+        if (stmt == nullptr) return;
+
+        switch (stmt->token.type) {
+        case TokenType::STATEMENT_LIST:
+            removeDeadStoresInList(stmt, reads, changed);
+            return;
+
+        case TokenType::IF: {
+            auto if_node = dynamic_cast<IfNode*>(stmt.get());
+            removeDeadStoresInExpr(if_node->condition, reads, changed);
+            removeDeadStoresInList(stmt->left, reads, changed);
+            removeDeadStoresInList(stmt->right, reads, changed);
+            return;
+        }
+
+        case TokenType::WHILE:
+            removeDeadStoresInExpr(stmt->left, reads, changed);
+            removeDeadStoresInList(stmt->right, reads, changed);
+            return;
+
+        case TokenType::SWITCH:
+            removeDeadStoresInExpr(stmt->left, reads, changed);
+            for (TreeNode* arm = stmt->right.get(); arm != nullptr; arm = arm->right.get()) {
+                removeDeadStoresInList(arm->left, reads, changed);
+            }
+            return;
+
+        case TokenType::RETURN:
+            removeDeadStoresInExpr(stmt->right, reads, changed);
+            return;
+
+        case TokenType::INT:
+        case TokenType::FLOAT:
+            // Arrays are read through INDEX, which reads doesn't track.
+            if (stmt->left->token.type == TokenType::ARRAY) return;
+
+            if (reads.count(stmt->left->token.lexeme)) {
+                removeDeadStoresInExpr(stmt->right, reads, changed);
+                return;
+            }
+
+            // A declaration without a live initializer only reserves a slot.
+            ++removed_stores;
+            changed = true;
+            stmt = std::move(stmt->right);
+            if (stmt != nullptr) {
+                removeDeadStoresInStatement(stmt, reads, changed);
+            }
+            return;
+
+        default:
+            removeDeadStoresInExpr(stmt, reads, changed);
+
+            // Expression statements that only compute a value are dead as a whole.
+            if (stmt != nullptr && !hasSideEffects(stmt.get())) {
+                ++removed_statements;
+                changed = true;
+                stmt = nullptr;
+            }
+            return;
+        }
+    }
+
+    void removeDeadStoresInExpr(std::unique_ptr<TreeNode>& expr, const std::unordered_set<std::string>& reads, bool& changed) {
+        if (expr == nullptr) return;
+
+        // The value of an assignment expression is its right hand side,
+        // so a dead store can be replaced by the stored value.
+        while (expr != nullptr && isStore(expr.get()) && !reads.count(expr->left->token.lexeme)) {
+            ++removed_stores;
+            changed = true;
+            expr = std::move(expr->right);
+        }
+
+        if (expr == nullptr) return;
+
+        removeDeadStoresInExpr(expr->left, reads, changed);
+        removeDeadStoresInExpr(expr->right, reads, changed);
+    }
+};
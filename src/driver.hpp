@@ -0,0 +1,415 @@
+#pragma once
+
+#include "compiler.hpp"
+#include "batch.hpp"
+#include "branch_weights.hpp"
+#include "cache.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <charconv>
+#include <cstdlib>
+
+// The options of one hydro invocation.
+struct CommandLine {
+    std::vector<std::string> input_paths;
+    std::string output_dir;
+    bool to_stdout = false;
+    std::string manifest_path;
+    std::string cache_dir;
+    std::string incremental_dir;
+    uint64_t cache_size_mb = 256;
+    bool cache_stats = false;
+    std::string stats_format;
+    bool dump_tokens = false;
+    bool profile = false;
+    // The pipeline of -O or --passes; the --no-<pass> options take passes out.
+    std::vector<std::string> passes = PassManager::preset("2");
+    bool optimize_size = false;
+    bool layout = true;
+    bool vectorize = true;
+    bool cse = true;
+    bool verify_passes = false;
+    bool time_passes = false;
+    int bisect_limit = -1;
+    bool debug_info = false;
+    std::string weights_path;
+    std::vector<AstDump> ast_dumps;
+    unsigned jobs = 1;
+
+    // Modes that don't compile.
+    bool lsp = false;
+    bool server = false;
+    std::string socket_path;
+
+    // cache_dir starts out as HYDRO_CACHE_DIR, which the caller looks up.
+    // Throws std::runtime_error on unknown or malformed options.
+    static CommandLine parse(const std::vector<std::string>& args, const char* env_cache_dir) {
+        CommandLine command;
+        if (env_cache_dir != nullptr) {
+            command.cache_dir = env_cache_dir;
+        }
+
+        for (size_t i = 0; i < args.size(); ++i) {
+            auto& arg = args[i];
+            bool has_value = i + 1 < args.size();
+
+            if (arg == "-j" && has_value) {
+                command.jobs = parseNumber<unsigned>("-j", args[++i]);
+            } else if (arg.rfind("--jobs=", 0) == 0) {
+                command.jobs = parseNumber<unsigned>("--jobs", arg.substr(7));
+            } else if (arg == "-o" && has_value) {
+                command.output_dir = args[++i];
+            } else if (arg == "--stdout") {
+                command.to_stdout = true;
+            } else if (arg == "--manifest" && has_value) {
+                command.manifest_path = args[++i];
+            } else if (arg == "--cache-dir" && has_value) {
+                command.cache_dir = args[++i];
+            } else if (arg.rfind("--cache-size=", 0) == 0) {
+                command.cache_size_mb = parseNumber<uint64_t>("--cache-size", arg.substr(13));
+            } else if (arg == "--incremental" && has_value) {
+                command.incremental_dir = args[++i];
+            } else if (arg == "--stats" || arg == "--time-report") {
+                command.stats_format = "text";
+            } else if (arg.rfind("--stats=", 0) == 0) {
+                command.stats_format = arg.substr(8);
+                if (command.stats_format != "text" && command.stats_format != "json") {
+                    throw std::runtime_error("Unknown stats format: " + command.stats_format + " (expected text or json)");
+                }
+            } else if (arg == "--profile") {
+                command.profile = true;
+            } else if (arg == "--profile-use" && has_value) {
+                command.weights_path = args[++i];
+            } else if (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "-Os") {
+                command.passes = PassManager::preset(arg.substr(2));
+                command.optimize_size = arg == "-Os";
+            } else if (arg.rfind("--passes=", 0) == 0) {
+                command.passes = PassManager::parse(arg.substr(9));
+            } else if (arg == "--verify-passes") {
+                command.verify_passes = true;
+            } else if (arg == "--time-passes") {
+                command.time_passes = true;
+            } else if (arg.rfind("--bisect-limit=", 0) == 0) {
+                command.bisect_limit = parseNumber<int>("--bisect-limit", arg.substr(15));
+            } else if (arg == "--no-layout") {
+                command.layout = false;
+            } else if (arg == "--no-vectorize") {
+                command.vectorize = false;
+            } else if (arg == "--no-cse") {
+                command.cse = false;
+            } else if (arg == "-g") {
+                command.debug_info = true;
+            } else if (arg == "--dump-tokens") {
+                command.dump_tokens = true;
+            } else if (arg.rfind("--dump-ast=", 0) == 0) {
+                auto format = arg.substr(11);
+                if (format == "preorder") command.ast_dumps.push_back(AstDump::PreOrder);
+                else if (format == "levelorder") command.ast_dumps.push_back(AstDump::LevelOrder);
+                else if (format == "sexpr") command.ast_dumps.push_back(AstDump::SExpr);
+                else {
+                    throw std::runtime_error("Unknown AST dump format: " + format + " (expected preorder, levelorder or sexpr)");
+                }
+            } else if (arg == "--lsp") {
+                command.lsp = true;
+            } else if (arg == "--server") {
+                command.server = true;
+            } else if (arg == "--socket" && has_value) {
+                command.socket_path = args[++i];
+            } else if (arg == "--cache-stats") {
+                command.cache_stats = true;
+            } else if (arg.size() > 1 && arg[0] == '-') {
+                throw std::runtime_error("Unknown option: " + arg);
+            } else {
+                command.input_paths.push_back(arg);
+            }
+        }
+
+        return command;
+    }
+
+    std::vector<std::string> enabledPasses() const {
+        auto enabled = passes;
+        std::erase_if(enabled, [&](const std::string& name) {
+            return (name == "layout" && !layout) || (name == "vectorize" && !vectorize) || (name == "cse" && !cse);
+        });
+        return enabled;
+    }
+
+private:
+    // The whole value has to be a number of type T.
+    template <typename T>
+    static T parseNumber(const std::string& option, const std::string& value) {
+        T number{};
+        auto result = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (result.ec != std::errc() || result.ptr != value.data() + value.size()) {
+            throw std::runtime_error("Invalid value for " + option + ": " + value);
+        }
+        return number;
+    }
+};
+
+// Runs compilations described by command lines.
+//
+// A plain invocation runs one and exits. The compile server keeps a Driver
+// for its whole life and runs every request through it, so the thread pool,
+// the opened caches and the loaded branch weights stay warm between
+// requests; that state is shared by concurrent requests.
+class Driver {
+public:
+    // Where one invocation reads and writes. Relative paths are resolved
+    // against cwd. Sources found in files, keyed by the path as given on the
+    // command line, are used instead of reading the file. When out_fd is
+    // set, out writes to it, and --stdout writes the program to it directly.
+    struct Context {
+        std::filesystem::path cwd;
+        std::ostream& out;
+        std::ostream& err;
+        std::ostream& log;
+        const std::unordered_map<std::string, std::string>* files = nullptr;
+        int out_fd = -1;
+    };
+
+    // With a pool, -j other than 1 shares it instead of starting threads.
+    explicit Driver(ThreadPool* shared_pool = nullptr) : shared_pool(shared_pool) {}
+
+    int run(const CommandLine& command, const Context& context) {
+        auto& err = context.err;
+        auto input_paths = command.input_paths;
+
+        if (!command.manifest_path.empty()) {
+            try {
+                std::stringstream manifest(readSource(command.manifest_path, context));
+                auto listed = BatchCompiler::parseManifest(manifest);
+                input_paths.insert(input_paths.end(), listed.begin(), listed.end());
+            }
+            catch (const std::exception& e) {
+                err << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::shared_ptr<const BranchWeights> weights;
+        if (!command.weights_path.empty()) {
+            try {
+                weights = loadWeights(resolve(command.weights_path, context));
+            }
+            catch (const std::exception& e) {
+                err << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+        }
+
+        CompileCache* cache = nullptr;
+        if (!command.cache_dir.empty()) {
+            try {
+                cache = openCache(resolve(command.cache_dir, context), command.cache_size_mb << 20);
+            }
+            catch (const std::exception& e) {
+                err << "Unable to use cache directory " << command.cache_dir << ": " << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (command.cache_stats) {
+            if (cache == nullptr) {
+                err << "--cache-stats requires --cache-dir or HYDRO_CACHE_DIR.\n";
+                return EXIT_FAILURE;
+            }
+
+            auto stats = cache->stats();
+            context.out << "hits:    " << stats.hits << "\n"
+                << "misses:  " << stats.misses << "\n"
+                << "entries: " << stats.entries << "\n"
+                << "size:    " << stats.bytes << " bytes of " << (command.cache_size_mb << 20) << "\n";
+
+            if (input_paths.empty()) return EXIT_SUCCESS;
+        }
+
+        if (input_paths.empty()) {
+            err << "Requires a file path in the arguments.\n";
+            return EXIT_FAILURE;
+        }
+
+        if (input_paths.size() > 1 && command.output_dir.empty()) {
+            err << "Compiling several files requires an output directory: -o <dir>.\n";
+            return EXIT_FAILURE;
+        }
+
+        // -j 0 uses every core. The main thread works too, so it isn't counted in the pool.
+        unsigned jobs = command.jobs;
+        if (jobs == 0) {
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::unique_ptr<ThreadPool> own_pool;
+        ThreadPool* pool = nullptr;
+        if (jobs > 1) {
+            if (shared_pool == nullptr) {
+                own_pool = std::make_unique<ThreadPool>(jobs - 1);
+            }
+            pool = shared_pool != nullptr ? shared_pool : own_pool.get();
+        }
+
+        CompileOptions options{
+            .pool = pool,
+            .cache = cache,
+            .incremental_dir = command.incremental_dir.empty() ? "" : resolve(command.incremental_dir, context),
+            .working_dir = context.cwd,
+            .profile = command.profile,
+            .branch_weights = weights.get(),
+            .passes = command.enabledPasses(),
+            .optimize_size = command.optimize_size,
+            .verify_passes = command.verify_passes,
+            .time_passes = command.time_passes,
+            .bisect_limit = command.bisect_limit,
+            .debug_info = command.debug_info,
+            .dump_tokens = command.dump_tokens,
+            .ast_dumps = command.ast_dumps,
+        };
+
+        if (command.to_stdout && (!command.output_dir.empty() || !command.stats_format.empty())) {
+            err << "--stdout writes a single program and can't be used with -o or --stats.\n";
+            return EXIT_FAILURE;
+        }
+
+        if (!command.output_dir.empty()) {
+            if (!command.stats_format.empty()) {
+                err << "--stats measures a single compilation and can't be used with -o.\n";
+                return EXIT_FAILURE;
+            }
+
+            BatchCompiler batch(resolve(command.output_dir, context), options);
+            batch.read_source = [&](const std::string& path) { return readSource(path, context); };
+            batch.err = &err;
+            batch.log = &context.log;
+            return batch.run(input_paths);
+        }
+
+        CompileStats stats;
+        if (!command.stats_format.empty()) {
+            options.stats = &stats;
+        }
+
+        int exit_code = 0;
+
+        try {
+            std::string code;
+            try {
+                CompileStats::Scope phase(options.stats, "read");
+                code = readSource(input_paths[0], context);
+            }
+            catch (const std::exception& e) {
+                err << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+
+            auto asm_code = compileSource(code, options, context.log, input_paths[0]);
+            if (!asm_code) {
+                exit_code = EXIT_FAILURE;
+            }
+            else if (command.to_stdout) {
+                if (context.out_fd >= 0) {
+                    context.out.flush();
+                    if (!asm_code->writeTo(context.out_fd)) {
+                        err << "Unable to write to stdout.\n";
+                        exit_code = EXIT_FAILURE;
+                    }
+                } else {
+                    context.out << asm_code.value();
+                }
+            }
+            else {
+                CompileStats::Scope phase(options.stats, "write");
+
+                if (!asm_code->writeFile((context.cwd / "out.asm").string())) {
+                    err << "Unable to write out.asm file.\n";
+                    exit_code = EXIT_FAILURE;
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            err << e.what() << '\n';
+            exit_code = EXIT_FAILURE;
+        }
+
+        if (command.stats_format == "text") {
+            stats.printText(context.out);
+        } else if (command.stats_format == "json") {
+            stats.printJson(context.out);
+        }
+
+        return exit_code;
+    }
+
+private:
+    ThreadPool* shared_pool;
+
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<CompileCache>> caches;
+
+    struct LoadedWeights {
+        std::filesystem::file_time_type modified;
+        std::shared_ptr<const BranchWeights> weights;
+    };
+    std::map<std::string, LoadedWeights> weights_by_path;
+
+    static std::string resolve(const std::string& path, const Context& context) {
+        return (context.cwd / path).string();
+    }
+
+    std::string readSource(const std::string& path, const Context& context) {
+        if (context.files != nullptr) {
+            auto it = context.files->find(path);
+            if (it != context.files->end()) return it->second;
+        }
+
+        std::ifstream fin(resolve(path, context));
+        if (!fin) {
+            throw std::runtime_error("Unable to open file: " + path);
+        }
+        std::stringstream ss;
+        ss << fin.rdbuf();
+        return ss.str();
+    }
+
+    // Caches stay open, so their directories are set up once.
+    CompileCache* openCache(const std::string& dir, uint64_t max_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto key = std::filesystem::path(dir).lexically_normal().string() + "\n" + std::to_string(max_bytes);
+        auto& cache = caches[key];
+        if (cache == nullptr) {
+            cache = std::make_unique<CompileCache>(dir, max_bytes);
+        }
+        return cache.get();
+    }
+
+    // Weights are loaded again only when the file changed.
+    std::shared_ptr<const BranchWeights> loadWeights(const std::string& path) {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(path, error);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = weights_by_path.find(path);
+        if (!error && it != weights_by_path.end() && it->second.modified == modified) {
+            return it->second.weights;
+        }
+
+        auto weights = std::make_shared<const BranchWeights>(BranchWeights::load(path));
+        if (!error) {
+            weights_by_path[path] = LoadedWeights{ modified, weights };
+        }
+        return weights;
+    }
+};
@@ -1,68 +1,67 @@
 #pragma once
 
 #include "parser.hpp"
-#include "util.hpp"
+#include "dce.hpp"
+#include "thread_pool.hpp"
+#include "branch_weights.hpp"
+#include "runtime_lib.hpp"
+#include "asm_buffer.hpp"
 
 #include <iostream>
 #include <sstream>
 #include <memory>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <bit>
+#include <charconv>
+#include <cstdlib>
 
-class Generator {
-public:
-    Generator(const std::unique_ptr<TreeNode>& root) : root(root) {}
-
-    std::string generateAsm64() {
-        if (root == nullptr) {
-            return "";
-        }
-
-        auto printfn_asm_code = readFile("./src/asm_lib/print_int.asm");
-
-        asm_code << "global _start\n";
-        asm_code << "_start:\n";
-        asm_code << "   call _main\n";
-
-        // Exit
-        asm_code << "   ; Exit\n";
-        asm_code << "   mov rdi, rax\n";
-        asm_code << "   mov rax, 60\n";
-        asm_code << "   syscall\n";
-        
-        generateDeclerationList(root);
-
-        asm_code << printfn_asm_code;
-        return asm_code.str();
-    }
+// An execution counter of a --profile build and the source line it measures.
+struct ProfileCounter {
+    std::string kind;   // entry, branch, taken, loop or backedge
+    int line;
+};
 
-    void generateDeclerationList(const std::unique_ptr<TreeNode>& tree_node) {
-        if (tree_node == nullptr) return;
+struct CodegenOptions {
+    // Function entries, branches and loop back edges increment counters in
+    // the table P_<name>.
+    bool profile = false;
+    // Rotate loops, align loop bodies and move cold blocks out of line.
+    bool layout = true;
+    // Counts of an instrumented run. Without them layout uses static guesses.
+    const BranchWeights* weights = nullptr;
+    // Maps the code to lines of source_name with %line directives, which nasm
+    // turns into a DWARF line table (-g -F dwarf), and gives functions ELF
+    // symbol types and sizes, so perf can attribute samples to Hydro source.
+    bool debug_info = false;
+    std::string source_name;
+    // Run simple array loops several elements at a time with SSE2 or AVX2,
+    // whichever the CPU supports, before finishing them element by element.
+    bool vectorize = true;
+};
 
-        if (tree_node->token.type != TokenType::DECL_LIST) {
-            throw std::runtime_error("DECL_LIST expected, got: " + tree_node->token.toString());
-        }
+// The bits of a float literal as a hex integer, for mov and dq.
+inline std::string floatBits(const std::string& lexeme) {
+    auto bits = std::bit_cast<uint64_t>(std::strtod(lexeme.c_str(), nullptr));
 
-        TreeNode* tmp = tree_node.get();
-        while (tmp != nullptr) {
-            if (tmp->left == nullptr) {
-                throw std::runtime_error("Decleration expected. at line:" + std::to_string(tmp->token.line));
-            }
-            
-            auto token = tmp->left->token;
-            if (token.type == TokenType::FUNCTION_DECL) {
-                generateFunction(tmp->left);
-            }
+    char digits[24] = "0x";
+    auto result = std::to_chars(digits + 2, digits + sizeof(digits), bits, 16);
+    return std::string(digits, result.ptr);
+}
 
-            tmp = tmp->right.get();
-        }
-    }
-
-    void generateFunction(const std::unique_ptr<TreeNode>& tree_node) {
-        if (tree_node == nullptr) return;
+// Generates a single function. It shares no state with other instances,
+// so functions can be generated concurrently.
+class FunctionGenerator {
+public:
+    explicit FunctionGenerator(CodegenOptions options = {}) : options(options) {}
 
+    AsmBuffer generateFunction(const TreeNode* tree_node) {
         auto token = tree_node->token;
-        if (token.type != TokenType::FUNCTION_DECL) return;
 
-        const FuncNode* fn_node = dynamic_cast<FuncNode*>(tree_node.get());
+        const FuncNode* fn_node = dynamic_cast<const FuncNode*>(tree_node);
         if (!fn_node) {
             throw std::runtime_error("Failed to convert to FuncNode.");
         }
@@ -70,7 +69,12 @@ public:
         auto total_local_var_bytes = 16 * ((8 * fn_node->max_local_var_count + 15) / 16);
         auto fn_name = token.lexeme;
 
-        asm_code << '\n' << fn_name << ":\n";
+        asm_code << '\n';
+        if (options.debug_info) {
+            asm_code << "global " << fn_name << ":function (" << fn_name << ".end - " << fn_name << ")\n";
+        }
+        asm_code << fn_name << ":\n";
+        markLine(token.line);
         asm_code << "   push rbp\n";
         asm_code << "   mov rbp, rsp\n";
 
@@ -78,7 +82,46 @@ public:
             asm_code << "   sub rsp, " << total_local_var_bytes << "\n";
         }
 
+        function_name = fn_name.substr(1);
+        counter_table = "P" + fn_name;
+        countExecution("entry", token.line);
+
         generateStatementList(fn_node->right);
+
+        // Cold blocks go after the body, which must not fall through into them.
+        if (!cold_blocks.empty()) {
+            if (!alwaysReturns(fn_node->right.get())) {
+                asm_code << "   mov rsp, rbp\n";
+                asm_code << "   pop rbp\n";
+                asm_code << "   ret\n";
+            }
+
+            asm_code << "   ; Cold blocks\n";
+            for (auto& cold_block : cold_blocks) {
+                asm_code << std::move(cold_block);
+            }
+        }
+
+        // Line 0 is code without a source line: the runtime after the functions.
+        if (options.debug_info) {
+            asm_code << ".end:\n";
+            asm_code << "%line 0+0\n";
+        }
+
+        return std::move(asm_code);
+    }
+
+    const std::unordered_set<std::string>& calledFunctions() const {
+        return called_functions;
+    }
+
+    const std::vector<ProfileCounter>& profileCounters() const {
+        return profile_counters;
+    }
+
+    // Whether a while loop gets a vector loop when vectorizing.
+    static bool vectorizes(const TreeNode* while_node) {
+        return analyzeVectorLoop(while_node).has_value();
     }
 
     void generateStatementList(const std::unique_ptr<TreeNode>& tree_node) {
@@ -103,6 +146,8 @@ public:
             return;
         }
 
+        markLine(tree_node->token.line);
+
         if (token_type == TokenType::RETURN) {
             generateExpr(tree_node->right);
 
@@ -113,17 +158,61 @@ public:
             return;
         }
 
+        if (token_type == TokenType::SWITCH) {
+            std::vector<SwitchCase> cases;
+            std::vector<const std::unique_ptr<TreeNode>*> arms;
+            const std::unique_ptr<TreeNode>* default_arm = nullptr;
+
+            for (auto arm = &tree_node->right; *arm != nullptr; arm = &(*arm)->right) {
+                auto case_node = dynamic_cast<const CaseNode*>(arm->get());
+                if (case_node->values.empty()) {
+                    default_arm = &case_node->left;
+                    continue;
+                }
+
+                for (auto value : case_node->values) {
+                    cases.push_back(SwitchCase{ value, arms.size() });
+                }
+                arms.push_back(&case_node->left);
+            }
+
+            generateExpr(tree_node->left);
+            generateSwitch(cases, arms, default_arm);
+            return;
+        }
+
         if (token_type == TokenType::IF) {
             auto if_node = dynamic_cast<IfNode*>(tree_node.get());
+
+            // Chains keep their branch counters in --profile builds.
+            if (!options.profile && generateIfChainAsSwitch(if_node)) {
+                return;
+            }
+
+            if (options.layout && generateIfWithColdBlock(if_node)) {
+                return;
+            }
+
             auto l0 = getUniqueLabel();
             auto l1 = getUniqueLabel();
             
             generateExpr(if_node->condition);
+            countExecution("branch", tree_node->token.line);
             asm_code << "   cmp rax, 0\n";
             asm_code << "   jz " + l0 + "\n";
+            countExecution("taken", tree_node->token.line);
             
             generateStatementList(if_node->left);
-            asm_code << "   jmp " + l1 + "\n";
+
+            if (if_node->right == nullptr) {
+                asm_code << l0 + ":\n";
+                return;
+            }
+
+            // No jump over the else block when the then block never falls through.
+            if (!alwaysReturns(if_node->left.get())) {
+                asm_code << "   jmp " + l1 + "\n";
+            }
 
             asm_code << l0 + ":\n";
             generateStatementList(if_node->right);
@@ -133,20 +222,35 @@ public:
         }
 
         if (token_type == TokenType::WHILE) {
+            // The vector loop leaves the remaining iterations to the scalar loop.
+            if (options.vectorize && !options.profile) {
+                if (auto loop = analyzeVectorLoop(tree_node.get())) {
+                    generateVectorLoop(loop.value());
+                }
+            }
+
+            if (options.layout) {
+                generateRotatedLoop(tree_node.get());
+                return;
+            }
+
             auto l0 = getUniqueLabel();
             auto l1 = getUniqueLabel();
 
+            countExecution("loop", tree_node->token.line);
             asm_code << l0 << ":\n";
             generateExpr(tree_node->left);
+            asm_code << "   cmp rax, 0\n";
             asm_code << "   jz " << l1 << '\n';
 
             generateStatementList(tree_node->right);
+            countExecution("backedge", tree_node->token.line);
             asm_code << "   jmp " << l0 << '\n';
             asm_code << l1 << ":\n";
             return;
         }
 
-        if (token_type == TokenType::INT) {
+        if (isDeclaration(tree_node.get())) {
             if (tree_node->right == nullptr) return;
 
             if (tree_node->left == nullptr) {
@@ -154,16 +258,36 @@ public:
             }
 
             auto id = tree_node->left->token.lexeme;
+            if (isFloatValue(tree_node->right.get())) {
+                generateFloatExpr(tree_node->right, 0);
+                asm_code << "   movsd qword [rbp - " << id << "], xmm0\n";
+                return;
+            }
+
             generateExpr(tree_node->right);
             asm_code << "   mov qword [rbp - " << id << "], rax\n";
             return;
         }
 
+        // A float store's value stays in xmm0.
+        if (isFloatValue(tree_node.get())) {
+            generateFloatExpr(tree_node, 0);
+            return;
+        }
+
         generateExpr(tree_node);
     }
 
     void generateExpr(const std::unique_ptr<TreeNode>& tree_node) {
+        if (tree_node != nullptr && isFloatValue(tree_node.get())) {
+            generateFloatExpr(tree_node, 0);
+            asm_code << "   movq rax, xmm0\n";
+            return;
+        }
+
         if (generateTerminal(tree_node)) return;
+
+        if (generateFloatToInt(tree_node.get())) return;
         
         bool is_unary = tree_node->left == nullptr;
         if (is_unary) {
@@ -192,13 +316,13 @@ public:
         case TokenType::SLASH:
             asm_code << "   mov rcx, rax\n";  // divisor in ecx
             asm_code << "   mov rax, rbx\n";  // dividend in eax
-            asm_code << "   cdq\n";           // sign extend eax into edx:eax
+            asm_code << "   cqo\n";           // sign extend rax into rdx:rax
             asm_code << "   idiv rcx\n";      // result in eax
             break;
         case TokenType::PERCENTAGE:
             asm_code << "   mov rcx, rax\n";  // divisor in ecx
             asm_code << "   mov rax, rbx\n";  // dividend in eax
-            asm_code << "   cdq\n";           // sign extend eax into edx:eax
+            asm_code << "   cqo\n";           // sign extend rax into rdx:rax
             asm_code << "   idiv rcx\n";      // result in eax
             asm_code << "   mov rax, rdx\n";      // result in eax
             break;
@@ -234,10 +358,12 @@ public:
             asm_code << "   or rax, rbx\n";
             break;
         case TokenType::AND_AND:
+            asm_code << "   test rbx, rbx\n";
             asm_code << "   cmovnz rbx, rax\n";
             asm_code << "   mov rax, rbx\n";
             break;
         case TokenType::OR_OR:
+            asm_code << "   test rbx, rbx\n";
             asm_code << "   cmovz rbx, rax\n";
             asm_code << "   mov rax, rbx\n";
             break;
@@ -251,8 +377,652 @@ public:
     }
 
 private:
-    const std::unique_ptr<TreeNode>& root;
-    std::stringstream asm_code;
+    AsmBuffer asm_code;
+    std::unordered_set<std::string> called_functions;
+    int label_count = 0;
+    CodegenOptions options;
+    std::string function_name;
+    std::string counter_table;
+    std::vector<ProfileCounter> profile_counters;
+    std::vector<AsmBuffer> cold_blocks;
+    int cold_depth = 0;
+    int current_line = -1;
+
+    // Attributes the code that follows to a source line.
+    void markLine(int line) {
+        if (!options.debug_info || line == current_line) return;
+
+        asm_code << "%line " << line << "+0 " << options.source_name << "\n";
+        current_line = line;
+    }
+
+    struct SwitchCase {
+        long long value;
+        size_t arm;
+    };
+
+    // Case sets at least this large are dispatched in logarithmic or
+    // constant time; smaller ones are compared one by one.
+    static constexpr size_t min_switch_cases = 4;
+
+    // Jumps to the arm matching rax and generates the arms after the
+    // dispatch, the default arm last. Dense case sets go through a table of
+    // arm addresses in .rodata, sparse ones through a balanced compare tree.
+    void generateSwitch(std::vector<SwitchCase> cases, const std::vector<const std::unique_ptr<TreeNode>*>& arms,
+                        const std::unique_ptr<TreeNode>* default_arm) {
+        std::vector<std::string> arm_labels;
+        for (size_t i = 0; i < arms.size(); ++i) {
+            arm_labels.push_back(getUniqueLabel());
+        }
+        auto default_label = getUniqueLabel();
+        auto end_label = getUniqueLabel();
+
+        std::sort(cases.begin(), cases.end(), [](auto& a, auto& b) { return a.value < b.value; });
+
+        // The span is computed unsigned, so case values at both ends of the
+        // range can't overflow it.
+        unsigned long long span = cases.empty() ? 0 : static_cast<unsigned long long>(cases.back().value) - cases.front().value;
+        bool dense = cases.size() >= min_switch_cases && span < 3 * cases.size() && span < 4096;
+
+        if (dense) {
+            generateJumpTable(cases, span, arm_labels, default_label);
+        } else {
+            generateCompareTree(cases, 0, cases.size(), arm_labels, default_label);
+        }
+
+        for (size_t i = 0; i < arms.size(); ++i) {
+            asm_code << arm_labels[i] << ":\n";
+            generateStatementList(*arms[i]);
+            if (!alwaysReturns(arms[i]->get())) {
+                asm_code << "   jmp " << end_label << "\n";
+            }
+        }
+
+        asm_code << default_label << ":\n";
+        if (default_arm != nullptr) {
+            generateStatementList(*default_arm);
+        }
+        asm_code << end_label << ":\n";
+    }
+
+    void generateJumpTable(const std::vector<SwitchCase>& cases, unsigned long long span,
+                           const std::vector<std::string>& arm_labels, const std::string& default_label) {
+        auto table_label = getUniqueLabel();
+        long long low = cases.front().value;
+
+        asm_code << "   ; Jump table\n";
+        if (low >= INT32_MIN && low <= INT32_MAX) {
+            if (low != 0) asm_code << "   sub rax, " << low << "\n";
+        } else {
+            asm_code << "   mov rbx, " << low << "\n";
+            asm_code << "   sub rax, rbx\n";
+        }
+        asm_code << "   cmp rax, " << span << "\n";
+        asm_code << "   ja " << default_label << "\n";
+        asm_code << "   lea rbx, [rel " << table_label << "]\n";
+        asm_code << "   jmp qword [rbx + rax*8]\n";
+
+        asm_code << "section .rodata\n";
+        asm_code << "align 8\n";
+        asm_code << table_label << ":\n";
+
+        size_t next = 0;
+        for (unsigned long long slot = 0; slot <= span; ++slot) {
+            bool is_case = next < cases.size() && static_cast<unsigned long long>(cases[next].value) - low == slot;
+            asm_code << "   dq " << (is_case ? arm_labels[cases[next++].arm] : default_label) << "\n";
+        }
+
+        asm_code << "section .text\n";
+    }
+
+    // Binary search over cases[begin, end), which are sorted by value.
+    void generateCompareTree(const std::vector<SwitchCase>& cases, size_t begin, size_t end,
+                             const std::vector<std::string>& arm_labels, const std::string& default_label) {
+        if (end - begin < min_switch_cases) {
+            for (size_t i = begin; i < end; ++i) {
+                compareWith(cases[i].value);
+                asm_code << "   je " << arm_labels[cases[i].arm] << "\n";
+            }
+            asm_code << "   jmp " << default_label << "\n";
+            return;
+        }
+
+        size_t middle = begin + (end - begin) / 2;
+        auto upper_label = getUniqueLabel();
+
+        compareWith(cases[middle].value);
+        asm_code << "   je " << arm_labels[cases[middle].arm] << "\n";
+        asm_code << "   jg " << upper_label << "\n";
+        generateCompareTree(cases, begin, middle, arm_labels, default_label);
+
+        asm_code << upper_label << ":\n";
+        generateCompareTree(cases, middle + 1, end, arm_labels, default_label);
+    }
+
+    // cmp takes a sign-extended 32-bit immediate at most.
+    void compareWith(long long value) {
+        if (value >= INT32_MIN && value <= INT32_MAX) {
+            asm_code << "   cmp rax, " << value << "\n";
+        } else {
+            asm_code << "   mov rbx, " << value << "\n";
+            asm_code << "   cmp rax, rbx\n";
+        }
+    }
+
+    // Lowers "if (x == 1) {..} else { if (x == 2) {..} else {..} }" like a
+    // switch when every link compares the same variable with a distinct
+    // literal. Returns false for chains that are too short.
+    bool generateIfChainAsSwitch(const IfNode* if_node) {
+        const std::unique_ptr<TreeNode>* variable = nullptr;
+        std::vector<SwitchCase> cases;
+        std::vector<const std::unique_ptr<TreeNode>*> arms;
+        const std::unique_ptr<TreeNode>* default_arm = nullptr;
+        std::unordered_set<long long> seen_values;
+
+        // A link that doesn't fit ends the chain; it stays in the default arm.
+        for (auto link = if_node; link != nullptr; ) {
+            auto& condition = link->condition;
+            if (condition->token.type != TokenType::EQUAL_EQUAL || condition->left == nullptr) break;
+
+            auto operand = &condition->left;
+            auto literal = &condition->right;
+            if ((*operand)->token.type == TokenType::INT_LIT) {
+                std::swap(operand, literal);
+            }
+
+            auto& token = (*operand)->token;
+            bool is_variable = token.type == TokenType::IDENTIFIER || token.type == TokenType::GLOBAL_VAR;
+            if (!is_variable || (*literal)->token.type != TokenType::INT_LIT) break;
+            if (variable != nullptr && (token.type != (*variable)->token.type || token.lexeme != (*variable)->token.lexeme)) break;
+
+            auto value = std::stoll((*literal)->token.lexeme);
+            if (!seen_values.insert(value).second) break;
+
+            variable = operand;
+            cases.push_back(SwitchCase{ value, arms.size() });
+            arms.push_back(&link->left);
+            default_arm = &link->right;
+
+            // Continue while the else block holds nothing but the next if.
+            auto& else_block = link->right;
+            bool continues = else_block != nullptr && else_block->right == nullptr && else_block->left != nullptr
+                && else_block->left->token.type == TokenType::IF;
+            link = continues ? dynamic_cast<const IfNode*>(else_block->left.get()) : nullptr;
+        }
+
+        if (cases.size() < min_switch_cases) return false;
+
+        generateExpr(*variable);
+        generateSwitch(cases, arms, default_arm);
+        return true;
+    }
+
+    // Generates a statement list out of line and returns its code.
+    AsmBuffer generateColdBlock(const std::string& label, const std::unique_ptr<TreeNode>& block, const std::string& counter_kind, int line) {
+        AsmBuffer hot_code;
+        std::swap(asm_code, hot_code);
+        ++cold_depth;
+        int hot_line = current_line;
+
+        asm_code << label << ":\n";
+        current_line = -1;
+        markLine(line);
+        if (!counter_kind.empty()) {
+            countExecution(counter_kind, line);
+        }
+        generateStatementList(block);
+
+        --cold_depth;
+        current_line = hot_line;
+        std::swap(asm_code, hot_code);
+        return hot_code;
+    }
+
+    // Moves a rarely executed branch of an if out of line, so the likely
+    // path falls through. Without profile weights, a then block that always
+    // returns is taken to be the cold one (an early exit). Returns false when
+    // neither branch is cold.
+    bool generateIfWithColdBlock(const IfNode* if_node) {
+        int line = if_node->token.line;
+        bool cold_then = false;
+        bool cold_else = false;
+
+        auto weight = options.weights != nullptr ? options.weights->branch(function_name, line) : nullptr;
+        if (weight != nullptr) {
+            cold_then = weight->executed > 0 && weight->taken * 5 < weight->executed;
+            cold_else = !cold_then && if_node->right != nullptr && weight->executed > 0
+                && (weight->executed - weight->taken) * 5 < weight->executed;
+        } else {
+            cold_then = alwaysReturns(if_node->left.get())
+                && (if_node->right == nullptr || !alwaysReturns(if_node->right.get()));
+        }
+
+        if (!cold_then && !cold_else) return false;
+
+        auto cold_label = getUniqueLabel();
+        auto join_label = getUniqueLabel();
+
+        generateExpr(if_node->condition);
+        countExecution("branch", line);
+        asm_code << "   cmp rax, 0\n";
+
+        const TreeNode* cold_block;
+        AsmBuffer cold_code;
+        if (cold_then) {
+            asm_code << "   jnz " << cold_label << "\n";
+            cold_block = if_node->left.get();
+            cold_code = generateColdBlock(cold_label, if_node->left, "taken", line);
+
+            generateStatementList(if_node->right);
+        } else {
+            asm_code << "   jz " << cold_label << "\n";
+            countExecution("taken", line);
+            generateStatementList(if_node->left);
+
+            cold_block = if_node->right.get();
+            cold_code = generateColdBlock(cold_label, if_node->right, "", line);
+        }
+
+        if (!alwaysReturns(cold_block)) {
+            cold_code << "   jmp " << join_label << "\n";
+            asm_code << join_label << ":\n";
+        }
+        cold_blocks.push_back(std::move(cold_code));
+        return true;
+    }
+
+    // Lays a while loop out as
+    //     jmp cond
+    //   body:
+    //     ...
+    //   cond:
+    //     <condition>
+    //     jnz body
+    // so every iteration takes one conditional branch. Hot loop bodies are
+    // aligned to 16 bytes; the padding sits behind the jmp and never runs.
+    void generateRotatedLoop(const TreeNode* while_node) {
+        int line = while_node->token.line;
+        auto body_label = getUniqueLabel();
+        auto cond_label = getUniqueLabel();
+
+        bool hot = cold_depth == 0;
+        if (options.weights != nullptr) {
+            auto weight = options.weights->loop(function_name, line);
+            hot = weight != nullptr && weight->iterations >= 8;
+        }
+
+        countExecution("loop", line);
+        asm_code << "   jmp " << cond_label << "\n";
+        if (hot) {
+            asm_code << "align 16\n";
+        }
+        asm_code << body_label << ":\n";
+
+        generateStatementList(while_node->right);
+        countExecution("backedge", line);
+
+        asm_code << cond_label << ":\n";
+        markLine(line);
+        generateExpr(while_node->left);
+        asm_code << "   cmp rax, 0\n";
+        asm_code << "   jnz " << body_label << "\n";
+    }
+
+    // One statement of a vectorizable loop: target[i] op= expr for an array
+    // target, or a sum of expr over the iterations for a scalar target.
+    struct VectorStatement {
+        const TreeNode* target;
+        TokenType op;
+        const TreeNode* expr;
+        bool is_reduction;
+    };
+
+    // A loop of the form
+    //     while (i < n) { <statements>; i += 1; }
+    // where every statement is a VectorStatement whose expr adds and
+    // subtracts elements x[i] and loop invariants.
+    struct VectorLoop {
+        const TreeNode* counter;
+        const TreeNode* bound;
+        std::vector<VectorStatement> statements;
+        std::vector<const TreeNode*> invariants;
+        std::vector<const TreeNode*> accumulators;
+        std::vector<std::string> global_arrays;
+    };
+
+    // xmm0-5 hold temporaries, xmm6-11 broadcast invariants and
+    // xmm12-15 partial sums. Global array bases go in general registers.
+    static constexpr int vector_temps = 6;
+    static constexpr int first_invariant_register = 6;
+    static constexpr int first_accumulator_register = 12;
+    static constexpr int max_accumulators = 4;
+    static constexpr const char* array_base_registers[] = { "rsi", "rdi", "r8", "r9", "r10", "r11" };
+
+    static std::string variableKey(const TreeNode* node) {
+        return std::to_string(static_cast<int>(node->token.type)) + " " + node->token.lexeme;
+    }
+
+    static bool isIncrementOf(const TreeNode* stmt, const TreeNode* counter) {
+        auto isCounter = [&](const TreeNode* node) {
+            return node != nullptr && node->token.type == TokenType::IDENTIFIER && node->token.lexeme == counter->token.lexeme;
+        };
+        auto isOne = [](const TreeNode* node) {
+            return node != nullptr && node->token.type == TokenType::INT_LIT && node->token.lexeme == "1";
+        };
+
+        if (!isCounter(stmt->left.get())) return false;
+        if (stmt->token.type == TokenType::PLUS_EQUAL) return isOne(stmt->right.get());
+
+        auto sum = stmt->right.get();
+        return stmt->token.type == TokenType::EQUAL && sum != nullptr && sum->token.type == TokenType::PLUS
+            && ((isCounter(sum->left.get()) && isOne(sum->right.get())) || (isOne(sum->left.get()) && isCounter(sum->right.get())));
+    }
+
+    // Checks an element expression and collects its invariants and global
+    // arrays. Returns the number of temporaries evaluating it takes, or -1
+    // when it can't be vectorized.
+    static int analyzeVectorExpr(const TreeNode* node, VectorLoop& loop) {
+        if (node == nullptr) return -1;
+
+        auto type = node->token.type;
+        if (type == TokenType::INDEX) {
+            auto index = node->right.get();
+            if (index->token.type != TokenType::IDENTIFIER || index->token.lexeme != loop.counter->token.lexeme) return -1;
+
+            auto& array = node->left->token;
+            if (array.type == TokenType::GLOBAL_ARRAY
+                && std::find(loop.global_arrays.begin(), loop.global_arrays.end(), array.lexeme) == loop.global_arrays.end()) {
+                loop.global_arrays.push_back(array.lexeme);
+            }
+            return 1;
+        }
+
+        if (type == TokenType::INT_LIT || isVariable(node)) {
+            if (variableKey(node) == variableKey(loop.counter)) return -1;
+
+            bool seen = std::any_of(loop.invariants.begin(), loop.invariants.end(), [&](auto invariant) {
+                return variableKey(invariant) == variableKey(node);
+            });
+            if (!seen) loop.invariants.push_back(node);
+            return 0;
+        }
+
+        bool is_lane_op = type == TokenType::PLUS || type == TokenType::MINUS;
+        if (!is_lane_op || node->left == nullptr) return -1;
+
+        int left = analyzeVectorExpr(node->left.get(), loop);
+        int right = analyzeVectorExpr(node->right.get(), loop);
+        if (left < 0 || right < 0) return -1;
+
+        return std::max({ left, right + 1, 1 });
+    }
+
+    static std::optional<VectorLoop> analyzeVectorLoop(const TreeNode* while_node) {
+        VectorLoop loop;
+
+        auto condition = while_node->left.get();
+        if (condition->token.type != TokenType::LESS || condition->left == nullptr) return std::nullopt;
+
+        loop.counter = condition->left.get();
+        loop.bound = condition->right.get();
+        if (loop.counter->token.type != TokenType::IDENTIFIER) return std::nullopt;
+        if (loop.bound->token.type != TokenType::INT_LIT && !isVariable(loop.bound)) return std::nullopt;
+        if (variableKey(loop.bound) == variableKey(loop.counter)) return std::nullopt;
+
+        std::vector<const TreeNode*> body;
+        for (const TreeNode* tmp = while_node->right.get(); tmp != nullptr; tmp = tmp->right.get()) {
+            if (tmp->left == nullptr) return std::nullopt;
+            body.push_back(tmp->left.get());
+        }
+        if (body.size() < 2 || !isIncrementOf(body.back(), loop.counter)) return std::nullopt;
+        body.pop_back();
+
+        for (auto stmt : body) {
+            auto op = stmt->token.type;
+            bool is_store = op == TokenType::EQUAL || op == TokenType::PLUS_EQUAL || op == TokenType::MINUS_EQUAL;
+            if (!is_store || stmt->left == nullptr || stmt->right == nullptr) return std::nullopt;
+
+            VectorStatement statement{ stmt->left.get(), op, stmt->right.get(), false };
+
+            if (!isVariable(statement.target)) {
+                if (statement.target->token.type != TokenType::INDEX) return std::nullopt;
+                if (analyzeVectorExpr(statement.target, loop) < 0) return std::nullopt;
+            } else {
+                // s = s + expr is s += expr.
+                statement.is_reduction = true;
+                if (op == TokenType::EQUAL) {
+                    auto sum = statement.expr;
+                    if (sum->token.type != TokenType::PLUS || sum->left == nullptr) return std::nullopt;
+
+                    if (variableKey(sum->left.get()) == variableKey(statement.target)) {
+                        statement.expr = sum->right.get();
+                    } else if (variableKey(sum->right.get()) == variableKey(statement.target)) {
+                        statement.expr = sum->left.get();
+                    } else {
+                        return std::nullopt;
+                    }
+                    statement.op = TokenType::PLUS_EQUAL;
+                }
+
+                bool seen = std::any_of(loop.accumulators.begin(), loop.accumulators.end(), [&](auto accumulator) {
+                    return variableKey(accumulator) == variableKey(statement.target);
+                });
+                if (!seen) loop.accumulators.push_back(statement.target);
+            }
+
+            int temps = analyzeVectorExpr(statement.expr, loop);
+            if (temps < 0 || temps > vector_temps) return std::nullopt;
+
+            loop.statements.push_back(statement);
+        }
+
+        // A partial sum can't be read until the loop is over, and the
+        // counter and bound must only change through the increment.
+        for (auto accumulator : loop.accumulators) {
+            auto key = variableKey(accumulator);
+            if (key == variableKey(loop.counter) || key == variableKey(loop.bound)) return std::nullopt;
+
+            for (auto invariant : loop.invariants) {
+                if (variableKey(invariant) == key) return std::nullopt;
+            }
+        }
+
+        int invariant_registers = first_accumulator_register - first_invariant_register;
+        if ((int)loop.invariants.size() > invariant_registers) return std::nullopt;
+        if ((int)loop.accumulators.size() > max_accumulators) return std::nullopt;
+        if (loop.global_arrays.size() > std::size(array_base_registers)) return std::nullopt;
+
+        return loop;
+    }
+
+    // Runs whole vectors of iterations of a loop matched by
+    // analyzeVectorLoop, with AVX2 when hydro_avx2 is set and SSE2 otherwise,
+    // and leaves the counter at the first iteration not yet run.
+    void generateVectorLoop(const VectorLoop& loop) {
+        auto sse_label = getUniqueLabel();
+        auto end_label = getUniqueLabel();
+
+        called_functions.insert("cpu_features");
+
+        asm_code << "   ; Vectorized loop\n";
+        asm_code << "   cmp qword [rel hydro_avx2], 0\n";
+        asm_code << "   je " << sse_label << "\n";
+        generateVectorLoopFor(loop, true);
+        asm_code << "   jmp " << end_label << "\n";
+
+        asm_code << sse_label << ":\n";
+        generateVectorLoopFor(loop, false);
+        asm_code << end_label << ":\n";
+    }
+
+    void generateVectorLoopFor(const VectorLoop& loop, bool avx) {
+        int width = avx ? 4 : 2;
+        auto body_label = getUniqueLabel();
+        auto skip_label = getUniqueLabel();
+
+        // rcx runs from i to the last multiple of the width below n, in rdx.
+        // The subtraction's flags compare n and i even when it overflows;
+        // a count that doesn't fit in a signed register is left to the
+        // scalar loop.
+        asm_code << "   mov rcx, qword " << variableAddress(loop.counter) << "\n";
+        if (loop.bound->token.type == TokenType::INT_LIT) {
+            asm_code << "   mov rdx, " << loop.bound->token.lexeme << "\n";
+        } else {
+            asm_code << "   mov rdx, qword " << variableAddress(loop.bound) << "\n";
+        }
+        asm_code << "   mov rax, rdx\n";
+        asm_code << "   sub rax, rcx\n";
+        asm_code << "   jle " << skip_label << "\n";
+        asm_code << "   and rax, " << -width << "\n";
+        asm_code << "   jle " << skip_label << "\n";
+        asm_code << "   lea rdx, [rcx + rax]\n";
+
+        for (size_t i = 0; i < loop.invariants.size(); ++i) {
+            auto invariant = loop.invariants[i];
+            int reg = first_invariant_register + i;
+
+            if (invariant->token.type == TokenType::INT_LIT) {
+                asm_code << "   mov rax, " << invariant->token.lexeme << "\n";
+            } else {
+                asm_code << "   mov rax, qword " << variableAddress(invariant) << "\n";
+            }
+
+            if (avx) {
+                asm_code << "   vmovq xmm" << reg << ", rax\n";
+                asm_code << "   vpbroadcastq ymm" << reg << ", xmm" << reg << "\n";
+            } else {
+                asm_code << "   movq xmm" << reg << ", rax\n";
+                asm_code << "   punpcklqdq xmm" << reg << ", xmm" << reg << "\n";
+            }
+        }
+
+        for (size_t i = 0; i < loop.accumulators.size(); ++i) {
+            int reg = first_accumulator_register + i;
+            asm_code << (avx ? "   vpxor xmm" : "   pxor xmm") << reg << ", xmm" << reg << (avx ? ", xmm" + std::to_string(reg) : "") << "\n";
+        }
+
+        for (size_t i = 0; i < loop.global_arrays.size(); ++i) {
+            asm_code << "   lea " << array_base_registers[i] << ", [rel G_" << loop.global_arrays[i] << "]\n";
+        }
+
+        asm_code << "align 16\n";
+        asm_code << body_label << ":\n";
+
+        for (auto& statement : loop.statements) {
+            int value = generateVectorExpr(statement.expr, loop, avx, 0);
+
+            if (statement.is_reduction) {
+                int reg = first_accumulator_register + accumulatorIndex(loop, statement.target);
+                generateVectorOp(statement.op == TokenType::PLUS_EQUAL ? TokenType::PLUS : TokenType::MINUS, avx, reg, reg, value);
+                continue;
+            }
+
+            auto address = vectorElementAddress(statement.target, loop);
+            if (statement.op == TokenType::EQUAL) {
+                asm_code << (avx ? "   vmovdqu " : "   movdqu ") << address << ", " << vectorRegister(avx, value) << "\n";
+                continue;
+            }
+
+            // The value is in temporary 0 or an invariant register, so a
+            // second temporary is always free.
+            int element = value == 0 ? 1 : 0;
+            asm_code << (avx ? "   vmovdqu " : "   movdqu ") << vectorRegister(avx, element) << ", " << address << "\n";
+            generateVectorOp(statement.op == TokenType::PLUS_EQUAL ? TokenType::PLUS : TokenType::MINUS, avx, element, element, value);
+            asm_code << (avx ? "   vmovdqu " : "   movdqu ") << address << ", " << vectorRegister(avx, element) << "\n";
+        }
+
+        asm_code << "   add rcx, " << width << "\n";
+        asm_code << "   cmp rcx, rdx\n";
+        asm_code << "   jne " << body_label << "\n";
+        asm_code << "   mov qword " << variableAddress(loop.counter) << ", rcx\n";
+
+        for (size_t i = 0; i < loop.accumulators.size(); ++i) {
+            int reg = first_accumulator_register + i;
+
+            if (avx) {
+                asm_code << "   vextracti128 xmm0, ymm" << reg << ", 1\n";
+                asm_code << "   vpaddq xmm0, xmm0, xmm" << reg << "\n";
+                asm_code << "   vpshufd xmm1, xmm0, 0x4e\n";
+                asm_code << "   vpaddq xmm0, xmm0, xmm1\n";
+                asm_code << "   vmovq rax, xmm0\n";
+            } else {
+                asm_code << "   pshufd xmm0, xmm" << reg << ", 0x4e\n";
+                asm_code << "   paddq xmm0, xmm" << reg << "\n";
+                asm_code << "   movq rax, xmm0\n";
+            }
+            asm_code << "   add qword " << variableAddress(loop.accumulators[i]) << ", rax\n";
+        }
+
+        // Leaves the upper halves clean for SSE code in the runtime.
+        if (avx) {
+            asm_code << "   vzeroupper\n";
+        }
+        asm_code << skip_label << ":\n";
+    }
+
+    static int accumulatorIndex(const VectorLoop& loop, const TreeNode* target) {
+        for (size_t i = 0; i < loop.accumulators.size(); ++i) {
+            if (variableKey(loop.accumulators[i]) == variableKey(target)) return i;
+        }
+        return -1;
+    }
+
+    static std::string vectorRegister(bool avx, int reg) {
+        return (avx ? "ymm" : "xmm") + std::to_string(reg);
+    }
+
+    std::string vectorElementAddress(const TreeNode* index_node, const VectorLoop& loop) {
+        auto& array = index_node->left->token;
+        if (array.type == TokenType::GLOBAL_ARRAY) {
+            auto base = std::find(loop.global_arrays.begin(), loop.global_arrays.end(), array.lexeme) - loop.global_arrays.begin();
+            return "[" + std::string(array_base_registers[base]) + " + rcx*8]";
+        }
+        return "[rbp + rcx*8 - " + array.lexeme + "]";
+    }
+
+    // dst = lhs op rhs. SSE2 only has two operand forms, which overwrite lhs.
+    void generateVectorOp(TokenType op, bool avx, int dst, int lhs, int rhs) {
+        std::string mnemonic = op == TokenType::PLUS ? "paddq" : "psubq";
+
+        if (avx) {
+            asm_code << "   v" << mnemonic << " " << vectorRegister(avx, dst) << ", " << vectorRegister(avx, lhs) << ", " << vectorRegister(avx, rhs) << "\n";
+            return;
+        }
+
+        if (dst != lhs) {
+            asm_code << "   movdqa " << vectorRegister(avx, dst) << ", " << vectorRegister(avx, lhs) << "\n";
+        }
+        asm_code << "   " << mnemonic << " " << vectorRegister(avx, dst) << ", " << vectorRegister(avx, rhs) << "\n";
+    }
+
+    // Evaluates an element expression into temporary temp or later, or
+    // finds it in an invariant register. Returns the register holding it.
+    int generateVectorExpr(const TreeNode* node, const VectorLoop& loop, bool avx, int temp) {
+        if (node->token.type == TokenType::INDEX) {
+            asm_code << (avx ? "   vmovdqu " : "   movdqu ") << vectorRegister(avx, temp) << ", " << vectorElementAddress(node, loop) << "\n";
+            return temp;
+        }
+
+        if (node->left == nullptr || node->right == nullptr) {
+            for (size_t i = 0; i < loop.invariants.size(); ++i) {
+                if (variableKey(loop.invariants[i]) == variableKey(node)) return first_invariant_register + i;
+            }
+            throw std::runtime_error("Unexpected operand in vectorized loop. at line:" + std::to_string(node->token.line));
+        }
+
+        int lhs = generateVectorExpr(node->left.get(), loop, avx, temp);
+        int rhs = generateVectorExpr(node->right.get(), loop, avx, temp + 1);
+        generateVectorOp(node->token.type, avx, temp, lhs, rhs);
+        return temp;
+    }
+
+    // inc leaves rax alone, so a counter can go between computing and testing a condition.
+    void countExecution(const std::string& kind, int line) {
+        if (!options.profile) return;
+
+        asm_code << "   inc qword [rel " << counter_table << " + " << 8 * profile_counters.size() << "]\n";
+        profile_counters.push_back(ProfileCounter{ kind, line });
+    }
 
     bool generateTerminal(const std::unique_ptr<TreeNode>& tree_node) {
         if (tree_node == nullptr) return true;
@@ -264,8 +1034,26 @@ private:
             return true;
         }
 
-        if (token.type == TokenType::IDENTIFIER) {
-            asm_code << "   mov rax, qword [rbp - " << token.lexeme << "]" << "\n";
+        if (token.type == TokenType::FLOAT_LIT) {
+            asm_code << "   mov rax, " << floatBits(token.lexeme) << "\n";
+            return true;
+        }
+
+        if (isVariable(tree_node.get())) {
+            asm_code << "   mov rax, qword " << variableAddress(tree_node.get()) << "\n";
+            return true;
+        }
+
+        if (token.type == TokenType::INDEX) {
+            generateExpr(tree_node->right);
+            auto address = elementAddress(tree_node.get(), "rax", "rbx");
+            asm_code << "   mov rax, qword " << address << "\n";
+            return true;
+        }
+
+        bool is_store = token.type == TokenType::EQUAL || token.type == TokenType::PLUS_EQUAL || token.type == TokenType::MINUS_EQUAL;
+        if (is_store && tree_node->left != nullptr && tree_node->left->token.type == TokenType::INDEX) {
+            generateElementStore(tree_node.get());
             return true;
         }
 
@@ -285,6 +1073,7 @@ private:
                 total_param_bytes += 8;
             }
 
+            called_functions.insert(token.lexeme);
             asm_code << "   call _" << token.lexeme << '\n';
             if (total_param_bytes > 0) {
                 asm_code << "   add rsp, " << total_param_bytes << '\n';
@@ -294,46 +1083,469 @@ private:
         }
 
         if (token.type == TokenType::EQUAL) {
-            if (tree_node->left == nullptr || tree_node->left->token.type != TokenType::IDENTIFIER) {
+            if (tree_node->left == nullptr || !isVariable(tree_node->left.get())) {
                 throw std::runtime_error("Identifier expected before '='. at line:" + std::to_string(token.line));
             }
 
-            auto var_id = tree_node->left->token.lexeme;
-
             generateExpr(tree_node->right);
-            asm_code << "   mov qword [rbp - " << var_id << "], rax\n";
+            asm_code << "   mov qword " << variableAddress(tree_node->left.get()) << ", rax\n";
             return true;
         }
 
         if (token.type == TokenType::PLUS_EQUAL) {
-            if (tree_node->left == nullptr || tree_node->left->token.type != TokenType::IDENTIFIER) {
+            if (tree_node->left == nullptr || !isVariable(tree_node->left.get())) {
                 throw std::runtime_error("Identifier expected before '+='. at line:" + std::to_string(token.line));
             }
 
-            auto var_id = tree_node->left->token.lexeme;
-
             generateExpr(tree_node->right);
-            asm_code << "   add qword [rbp - " << var_id << "], rax\n";
+            asm_code << "   add qword " << variableAddress(tree_node->left.get()) << ", rax\n";
             return true;
         }
 
         if (token.type == TokenType::MINUS_EQUAL) {
-            if (tree_node->left == nullptr || tree_node->left->token.type != TokenType::IDENTIFIER) {
+            if (tree_node->left == nullptr || !isVariable(tree_node->left.get())) {
                 throw std::runtime_error("Identifier expected before '-='. at line:" + std::to_string(token.line));
             }
 
-            auto var_id = tree_node->left->token.lexeme;
-
             generateExpr(tree_node->right);
-            asm_code << "   sub qword [rbp - " << var_id << "], rax\n";
+            asm_code << "   sub qword " << variableAddress(tree_node->left.get()) << ", rax\n";
             return true;
         }
 
         return false;
     }
 
+    static bool isVariable(const TreeNode* node) {
+        return node->token.type == TokenType::IDENTIFIER || node->token.type == TokenType::GLOBAL_VAR;
+    }
+
+    static std::string variableAddress(const TreeNode* node) {
+        if (node->token.type == TokenType::GLOBAL_VAR) {
+            return "[rel G_" + node->token.lexeme + "]";
+        }
+        return "[rbp - " + node->token.lexeme + "]";
+    }
+
+    static constexpr int float_registers = 16;
+
+    // Nodes whose value is computed in an xmm register: float arithmetic,
+    // conversions to float and stores of those to a variable.
+    static bool isFloatValue(const TreeNode* node) {
+        auto type = node->token.type;
+        if (isFloatArithmetic(type) || type == TokenType::INT_TO_FLOAT) return true;
+
+        return type == TokenType::EQUAL && node->left != nullptr && isVariable(node->left.get())
+            && node->right != nullptr && isFloatValue(node->right.get());
+    }
+
+    // Whether evaluating a float subtree leaves the xmm registers it doesn't
+    // compute into alone. Calls clobber all of them, and conversions to int
+    // and comparisons start over at xmm0.
+    static bool keepsFloatRegisters(const TreeNode* node) {
+        if (node == nullptr) return true;
+
+        auto type = node->token.type;
+        if (type == TokenType::FUNCTION_CALL || type == TokenType::FLOAT_TO_INT || isFloatComparison(type)) return false;
+
+        return keepsFloatRegisters(node->left.get()) && keepsFloatRegisters(node->right.get());
+    }
+
+    // Computes a float into xmm<reg>. The registers below reg hold operands
+    // still to be used, so a right operand that keeps them goes to the next
+    // register; any other is computed while the left one waits on the stack.
+    void generateFloatExpr(const std::unique_ptr<TreeNode>& node, int reg) {
+        auto xmm = "xmm" + std::to_string(reg);
+        auto type = node->token.type;
+
+        if (type == TokenType::FLOAT_LIT) {
+            auto bits = floatBits(node->token.lexeme);
+            if (bits == "0x0") {
+                asm_code << "   xorps " << xmm << ", " << xmm << "\n";
+            } else {
+                asm_code << "   mov rax, " << bits << "\n";
+                asm_code << "   movq " << xmm << ", rax\n";
+            }
+            return;
+        }
+
+        if (isVariable(node.get())) {
+            asm_code << "   movsd " << xmm << ", qword " << variableAddress(node.get()) << "\n";
+            return;
+        }
+
+        if (type == TokenType::INT_TO_FLOAT) {
+            generateExpr(node->right);
+            // Clearing the register first breaks cvtsi2sd's dependency on its old value.
+            asm_code << "   xorps " << xmm << ", " << xmm << "\n";
+            asm_code << "   cvtsi2sd " << xmm << ", rax\n";
+            return;
+        }
+
+        if (type == TokenType::EQUAL) {
+            generateFloatExpr(node->right, reg);
+            asm_code << "   movsd qword " << variableAddress(node->left.get()) << ", " << xmm << "\n";
+            return;
+        }
+
+        if (!isFloatArithmetic(type)) {
+            generateExpr(node);
+            asm_code << "   movq " << xmm << ", rax\n";
+            return;
+        }
+
+        if (node->left == nullptr) {
+            generateFloatExpr(node->right, reg);
+            asm_code << "   movq rax, " << xmm << "\n";
+            asm_code << "   btc rax, 63\n";
+            asm_code << "   movq " << xmm << ", rax\n";
+            return;
+        }
+
+        auto operand = generateFloatOperands(node.get(), reg);
+        std::string op = type == TokenType::FLOAT_PLUS ? "addsd" : type == TokenType::FLOAT_MINUS ? "subsd" : type == TokenType::FLOAT_STAR ? "mulsd" : "divsd";
+        asm_code << "   " << op << " " << xmm << ", " << operand << "\n";
+        if (operand == "qword [rsp]") {
+            asm_code << "   add rsp, 8\n";
+        }
+    }
+
+    // Computes the left operand into xmm<reg> and returns the right one as a
+    // source operand: a variable in memory, the next register, or the stack
+    // slot the caller pops.
+    std::string generateFloatOperands(const TreeNode* node, int reg) {
+        auto xmm = "xmm" + std::to_string(reg);
+        generateFloatExpr(node->left, reg);
+
+        if (isVariable(node->right.get())) {
+            return "qword " + variableAddress(node->right.get());
+        }
+
+        if (reg + 1 < float_registers && keepsFloatRegisters(node->right.get())) {
+            generateFloatExpr(node->right, reg + 1);
+            return "xmm" + std::to_string(reg + 1);
+        }
+
+        asm_code << "   movq rax, " << xmm << "\n";
+        asm_code << "   push rax\n";
+        generateFloatExpr(node->right, reg);
+        // Swaps the operands: the left one back in the register, the right one on the stack.
+        asm_code << "   movq rax, " << xmm << "\n";
+        asm_code << "   movsd " << xmm << ", qword [rsp]\n";
+        asm_code << "   mov qword [rsp], rax\n";
+        return "qword [rsp]";
+    }
+
+    // Comparisons and conversions to int of floats, with the result in rax.
+    // A comparison with a NaN is false, so those whose flags would say
+    // otherwise also check the parity flag, which ucomisd sets for NaN.
+    bool generateFloatToInt(const TreeNode* node) {
+        auto type = node->token.type;
+
+        if (type == TokenType::FLOAT_TO_INT) {
+            generateFloatExpr(node->right, 0);
+            asm_code << "   cvttsd2si rax, xmm0\n";
+            return true;
+        }
+
+        if (!isFloatComparison(type)) return false;
+
+        auto operand = generateFloatOperands(node, 0);
+        asm_code << "   ucomisd xmm0, " << operand << "\n";
+        if (operand == "qword [rsp]") {
+            asm_code << "   lea rsp, [rsp + 8]\n";
+        }
+
+        switch (type) {
+        case TokenType::FLOAT_GREATER:
+            asm_code << "   seta al\n";
+            break;
+        case TokenType::FLOAT_GREATER_EQUAL:
+            asm_code << "   setae al\n";
+            break;
+        default: {
+            auto condition = type == TokenType::FLOAT_LESS ? "b" : type == TokenType::FLOAT_LESS_EQUAL ? "be" : "e";
+            asm_code << "   set" << condition << " al\n";
+            asm_code << "   setnp cl\n";
+            asm_code << "   and al, cl\n";
+            break;
+        }
+        }
+        asm_code << "   and rax, 1\n";
+        return true;
+    }
+
+    // The index is evaluated before the stored value.
+    void generateElementStore(const TreeNode* store) {
+        auto op = store->token.type == TokenType::EQUAL ? "mov" : store->token.type == TokenType::PLUS_EQUAL ? "add" : "sub";
+
+        generateExpr(store->left->right);
+        asm_code << "   push rax\n";
+        generateExpr(store->right);
+        asm_code << "   pop rbx\n";
+        auto address = elementAddress(store->left.get(), "rbx", "rcx");
+        asm_code << "   " << op << " qword " << address << ", rax\n";
+    }
+
+    // Address of the element of an INDEX node's array at the index in
+    // index_reg. Element 0 of a local array is its lowest address; a global
+    // array's address is first loaded into base_reg.
+    std::string elementAddress(const TreeNode* index_node, const std::string& index_reg, const std::string& base_reg) {
+        auto& array = index_node->left->token;
+        if (array.type == TokenType::GLOBAL_ARRAY) {
+            asm_code << "   lea " << base_reg << ", [rel G_" << array.lexeme << "]\n";
+            return "[" + base_reg + " + " + index_reg + "*8]";
+        }
+        return "[rbp + " + index_reg + "*8 - " + array.lexeme + "]";
+    }
+
+    // Labels are local to the enclosing function label, so every function can
+    // count from one without clashing with the others.
     std::string getUniqueLabel() {
-        static int label_count = 0;
-        return "L" + std::to_string(++label_count);
+        return ".L" + std::to_string(++label_count);
+    }
+};
+
+// Code of one function together with the functions it calls, which decide
+// the runtime routines linked into the program, and its profile counters.
+struct GeneratedFunction {
+    std::string name;
+    AsmBuffer code;
+    std::unordered_set<std::string> calls;
+    std::vector<ProfileCounter> counters;
+};
+
+// Generates the whole program. Functions are generated independently of each
+// other, on the thread pool when one is given, and concatenated in source order,
+// so the output doesn't depend on the number of threads.
+class Generator {
+public:
+    CodegenOptions codegen;
+
+    Generator(const std::unique_ptr<TreeNode>& root, ThreadPool* pool = nullptr) : root(root), pool(pool) {}
+
+    AsmBuffer generateAsm64() {
+        if (root == nullptr) {
+            return {};
+        }
+
+        generateDeclerationList(root);
+        return link(generateFunctions(functions, pool, codegen), global_vars);
+    }
+
+    void generateDeclerationList(const std::unique_ptr<TreeNode>& tree_node) {
+        if (tree_node == nullptr) return;
+
+        if (tree_node->token.type != TokenType::DECL_LIST) {
+            throw std::runtime_error("DECL_LIST expected, got: " + tree_node->token.toString());
+        }
+
+        TreeNode* tmp = tree_node.get();
+        while (tmp != nullptr) {
+            if (tmp->left == nullptr) {
+                throw std::runtime_error("Decleration expected. at line:" + std::to_string(tmp->token.line));
+            }
+            
+            auto token = tmp->left->token;
+            if (token.type == TokenType::FUNCTION_DECL) {
+                functions.push_back(tmp->left.get());
+            } else {
+                global_vars.push_back(tmp->left.get());
+            }
+
+            tmp = tmp->right.get();
+        }
+    }
+
+    static std::vector<GeneratedFunction> generateFunctions(const std::vector<const TreeNode*>& functions, ThreadPool* pool, const CodegenOptions& codegen = {}) {
+        std::vector<GeneratedFunction> generated(functions.size());
+
+        auto generate = [&](size_t i) {
+            FunctionGenerator generator(codegen);
+            generated[i].name = functions[i]->token.lexeme.substr(1);
+            generated[i].code = generator.generateFunction(functions[i]);
+            generated[i].calls = generator.calledFunctions();
+            generated[i].counters = generator.profileCounters();
+        };
+
+        if (pool != nullptr && functions.size() > 1) {
+            pool->parallelFor(functions.size(), generate);
+        } else {
+            for (size_t i = 0; i < functions.size(); ++i) {
+                generate(i);
+            }
+        }
+
+        return generated;
+    }
+
+    // Assembles the program from already generated functions, in the given
+    // order. Their code is moved into the program.
+    static AsmBuffer link(std::vector<GeneratedFunction> functions, const std::vector<const TreeNode*>& global_vars) {
+        bool profile = std::any_of(functions.begin(), functions.end(), [](auto& function) { return !function.counters.empty(); });
+        auto routines = resolveRuntime(functions, profile);
+
+        AsmBuffer program;
+        program << "global _start\n";
+        program << "_start:\n";
+
+        if (std::find(routines.begin(), routines.end(), "cpu_features") != routines.end()) {
+            program << "   ; Detect vector extensions\n";
+            program << "   call _cpu_features\n";
+        }
+
+        program << "   call _main\n";
+
+        if (profile) {
+            program << "   ; Write profile counters\n";
+            program << "   push rax\n";
+            program << "   call _profile_dump\n";
+            program << "   pop rax\n";
+        }
+
+        if (std::find(routines.begin(), routines.end(), "flush_stdout") != routines.end()) {
+            program << "   ; Flush buffered output\n";
+            program << "   push rax\n";
+            program << "   call _flush_stdout\n";
+            program << "   pop rax\n";
+        }
+
+        // Exit
+        program << "   ; Exit\n";
+        program << "   mov rdi, rax\n";
+        program << "   mov rax, 60\n";
+        program << "   syscall\n";
+
+        for (auto& function : functions) {
+            program << std::move(function.code);
+        }
+
+        generateRuntime(program, routines);
+        generateGlobals(program, global_vars);
+
+        if (profile) {
+            generateProfileTable(program, functions);
+        }
+
+        return program;
+    }
+
+private:
+    const std::unique_ptr<TreeNode>& root;
+    ThreadPool* pool;
+    std::vector<const TreeNode*> functions;
+    std::vector<const TreeNode*> global_vars;
+
+    // Globals live in .data with the initial values computed at compile time.
+    // Arrays start zeroed in .bss, aligned for vector loads.
+    static void generateGlobals(AsmBuffer& out, const std::vector<const TreeNode*>& global_vars) {
+        std::vector<const ArrayNode*> arrays;
+        for (auto global : global_vars) {
+            if (auto array = dynamic_cast<const ArrayNode*>(global->left.get())) {
+                arrays.push_back(array);
+            }
+        }
+
+        if (!arrays.empty()) {
+            out << "\nsection .bss\n";
+            for (auto array : arrays) {
+                out << "alignb 32\n";
+                out << "G_" << array->token.lexeme << ": resq " << array->length << "\n";
+            }
+        }
+
+        if (global_vars.size() == arrays.size()) return;
+
+        out << "\nsection .data\n";
+
+        for (auto global : global_vars) {
+            if (global->left->token.type == TokenType::GLOBAL_ARRAY) continue;
+
+            auto name = global->left->token.lexeme;
+            std::string value = "0";
+
+            if (global->right != nullptr) {
+                auto type = global->right->token.type;
+                if (type != TokenType::INT_LIT && type != TokenType::FLOAT_LIT) {
+                    throw std::runtime_error("Initializer of global '" + name + "' is not a compile-time constant. at line:" + std::to_string(global->token.line));
+                }
+                value = type == TokenType::FLOAT_LIT ? floatBits(global->right->token.lexeme) : global->right->token.lexeme;
+            }
+
+            out << "G_" << name << ": dq " << value << "\n";
+        }
+    }
+
+    // One contiguous counter table, dumped by _profile_dump, and a map from
+    // counter index to function, kind and source line for the report tool.
+    static void generateProfileTable(AsmBuffer& out, const std::vector<GeneratedFunction>& functions) {
+        out << "\nsection .bss\n";
+        out << "alignb 8\n";
+        out << "hydro_prof_counters:\n";
+
+        for (auto& function : functions) {
+            if (function.counters.empty()) continue;
+            out << "P_" << function.name << ": resq " << function.counters.size() << "\n";
+        }
+        out << "hydro_prof_end:\n\n";
+
+        out << "; Profile map: counter index, function, kind, source line.\n";
+        size_t index = 0;
+        for (auto& function : functions) {
+            for (auto& counter : function.counters) {
+                out << "; profile " << index++ << " " << function.name << " " << counter.kind << " " << counter.line << "\n";
+            }
+        }
+    }
+
+    static const RuntimeRoutine* findRuntimeRoutine(std::string_view name) {
+        for (auto& routine : runtime_routines) {
+            if (name == routine.name) return &routine;
+        }
+        return nullptr;
+    }
+
+    // Runtime routines the program calls, dependencies first.
+    static std::vector<std::string> resolveRuntime(const std::vector<GeneratedFunction>& functions, bool profile) {
+        std::unordered_set<std::string> defined_functions;
+        std::unordered_set<std::string> called_functions;
+        if (profile) {
+            called_functions.insert("profile_dump");
+        }
+        for (auto& function : functions) {
+            defined_functions.insert(function.name);
+            called_functions.insert(function.calls.begin(), function.calls.end());
+        }
+
+        std::vector<std::string> ordered;
+        std::unordered_set<std::string> visited;
+
+        auto visit = [&](auto& self, const std::string& name) -> void {
+            auto routine = findRuntimeRoutine(name);
+            if (routine == nullptr || !visited.insert(name).second) return;
+
+            std::stringstream dependencies{ std::string(routine->dependencies) };
+            std::string dependency;
+            while (dependencies >> dependency) {
+                self(self, dependency);
+            }
+            ordered.push_back(name);
+        };
+
+        for (auto& routine : runtime_routines) {
+            std::string name(routine.name);
+            if (called_functions.count(name) && !defined_functions.count(name)) {
+                visit(visit, name);
+            }
+        }
+
+        return ordered;
+    }
+
+    // Appends only the runtime routines that the program actually uses.
+    // They are embedded into the compiler at build time, see cmake/embed_runtime.cmake.
+    static void generateRuntime(AsmBuffer& out, const std::vector<std::string>& routines) {
+        for (auto& name : routines) {
+            out << findRuntimeRoutine(name)->code;
+        }
     }
 };
@@ -0,0 +1,383 @@
+#pragma once
+
+#include "parser.hpp"
+#include "parallel_parser.hpp"
+#include "const_fold.hpp"
+#include "type_check.hpp"
+#include "ctfe.hpp"
+#include "cse.hpp"
+#include "generator.hpp"
+#include "thread_pool.hpp"
+#include "sha256.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <vector>
+#include <string>
+#include <optional>
+#include <memory>
+#include <atomic>
+
+#include <unistd.h>
+
+// Recompiles a file function by function against a database of the code
+// generated for it last time.
+//
+// Every top-level function is fingerprinted by its tokens, the signatures of
+// the functions it calls and the globals it can see, with their types. Only functions whose
+// fingerprint isn't in the database are parsed and generated; the code of the
+// others is spliced in unchanged. Globals are always parsed, they are cheap.
+//
+// Interprocedural passes (compile-time evaluation of calls, constant
+// propagation, dead code elimination) would make a function's code depend on
+// other functions, so they are not run in this mode.
+class IncrementalCompiler {
+public:
+    // Code generation of regenerated functions.
+    CodegenOptions codegen;
+    // Constant folding and common subexpression elimination only look inside
+    // a function, so they run here too.
+    bool fold = true;
+    bool cse = true;
+
+    IncrementalCompiler(std::string db_path, std::string salt, ThreadPool* pool)
+        : db_path(std::move(db_path)), salt(std::move(salt)), pool(pool) {}
+
+    // Database file for a source file, unique per source path.
+    static std::string databasePath(const std::string& dir, const std::string& source_path) {
+        namespace fs = std::filesystem;
+
+        auto absolute = fs::absolute(source_path).lexically_normal().string();
+        auto name = fs::path(source_path).stem().string() + "-" + Sha256::hash(absolute).substr(0, 16) + ".fndb";
+        return (fs::path(dir) / name).string();
+    }
+
+    std::optional<AsmBuffer> compile(std::vector<Token>& tokens) {
+        auto ranges = ParallelParser::splitDeclarations(tokens);
+        if (!ranges) {
+            // Only the real parser can explain what is wrong.
+            Parser(tokens).parseProgram();
+            throw std::runtime_error("Malformed program");
+        }
+
+        if (ranges->empty()) {
+            return std::nullopt;
+        }
+
+        auto visible_globals = ParallelParser::visibleGlobals(tokens, ranges.value());
+        auto signatures = collectSignatures(tokens, ranges.value());
+        auto global_types = collectGlobalTypes(tokens, ranges.value());
+
+        loadDatabase();
+
+        size_t count = ranges->size();
+        std::vector<std::string> fingerprints(count);
+        std::vector<bool> needs_parse(count, false);
+
+        for (size_t i = 0; i < count; ++i) {
+            auto& range = (*ranges)[i];
+            if (isFunction(tokens, range)) {
+                fingerprints[i] = fingerprint(tokens, range, signatures, global_types, visible_globals[i]);
+                needs_parse[i] = !database.count(fingerprints[i]);
+            } else {
+                needs_parse[i] = true;
+            }
+        }
+
+        // Initializers calling functions are evaluated, which needs those functions parsed.
+        if (globalsCallFunctions(tokens, ranges.value())) {
+            needs_parse.assign(count, true);
+        }
+
+        auto declarations = parseDeclarations(tokens, ranges.value(), visible_globals, needs_parse);
+
+        std::unique_ptr<TreeNode> root = nullptr;
+        for (size_t i = count; i-- > 0;) {
+            if (declarations[i] == nullptr) continue;
+
+            Token token{
+                .type = TokenType::DECL_LIST,
+                .lexeme = "dec",
+                .line = tokens[(*ranges)[i].begin].line,
+            };
+            root = std::make_unique<TreeNode>(token, std::move(declarations[i]), std::move(root));
+        }
+
+        // Calls of functions that weren't parsed are typed by their tokens.
+        TypeChecker type_checker(root);
+        type_checker.functions = signatures;
+        type_checker.run();
+
+        CompileTimeEvaluator ctfe(root);
+        ctfe.fold_function_bodies = false;
+        ctfe.run();
+
+        std::vector<const TreeNode*> global_vars;
+        std::vector<const TreeNode*> changed_functions;
+        std::vector<size_t> changed_indices;
+
+        CommonSubexpressionEliminator cse_pass(root);
+        cse_pass.keep_vector_loops = codegen.vectorize && !codegen.profile;
+
+        size_t index = 0;
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get(), ++index) {
+            while (!needs_parse[index]) ++index;
+
+            if (decl->left->token.type != TokenType::FUNCTION_DECL) {
+                global_vars.push_back(decl->left.get());
+            } else if (!database.count(fingerprints[index])) {
+                if (fold) ConstantFolder::fold(decl->left->right);
+                if (cse) cse_pass.runOnFunction(decl->left.get());
+                changed_functions.push_back(decl->left.get());
+                changed_indices.push_back(index);
+            }
+        }
+
+        auto generated = Generator::generateFunctions(changed_functions, pool, codegen);
+        for (size_t i = 0; i < generated.size(); ++i) {
+            database[fingerprints[changed_indices[i]]] = std::move(generated[i]);
+        }
+        regenerated = generated.size();
+
+        std::vector<GeneratedFunction> functions;
+        for (size_t i = 0; i < count; ++i) {
+            if (!fingerprints[i].empty()) {
+                functions.push_back(database.at(fingerprints[i]));
+            }
+        }
+        reused = functions.size() - regenerated;
+
+        auto asm_code = Generator::link(std::move(functions), global_vars);
+
+        // Only the current functions are kept, so the database doesn't grow with edits.
+        std::unordered_map<std::string, GeneratedFunction> current;
+        for (size_t i = 0; i < count; ++i) {
+            if (!fingerprints[i].empty()) {
+                current[fingerprints[i]] = std::move(database.at(fingerprints[i]));
+            }
+        }
+        database = std::move(current);
+        saveDatabase();
+
+        return asm_code;
+    }
+
+    size_t regeneratedFunctions() const { return regenerated; }
+    size_t reusedFunctions() const { return reused; }
+
+private:
+    std::string db_path;
+    std::string salt;
+    ThreadPool* pool;
+    std::unordered_map<std::string, GeneratedFunction> database;
+    size_t regenerated = 0;
+    size_t reused = 0;
+
+    static bool isFunction(const std::vector<Token>& tokens, const ParallelParser::Range& range) {
+        return range.end - range.begin >= 3 && tokens[range.begin + 2].type == TokenType::LEFT_PAREN;
+    }
+
+    // Return and parameter types of every function in the file. A
+    // parameter's type is the token after '(' or a comma.
+    static FunctionTypes collectSignatures(const std::vector<Token>& tokens, const std::vector<ParallelParser::Range>& ranges) {
+        FunctionTypes signatures;
+
+        for (auto& range : ranges) {
+            if (!isFunction(tokens, range)) continue;
+
+            FunctionType type;
+            type.result = tokens[range.begin].type;
+            for (size_t i = range.begin + 3; i < range.end && tokens[i].type != TokenType::RIGHT_PAREN; ++i) {
+                if (i == range.begin + 3 || tokens[i - 1].type == TokenType::COMMA) {
+                    type.params.push_back(tokens[i].type);
+                }
+            }
+            signatures[tokens[range.begin + 1].lexeme] = std::move(type);
+        }
+
+        return signatures;
+    }
+
+    static std::unordered_map<std::string, TokenType> collectGlobalTypes(const std::vector<Token>& tokens, const std::vector<ParallelParser::Range>& ranges) {
+        std::unordered_map<std::string, TokenType> types;
+
+        for (auto& range : ranges) {
+            if (!isFunction(tokens, range) && range.end - range.begin >= 2) {
+                types[tokens[range.begin + 1].lexeme] = tokens[range.begin].type;
+            }
+        }
+
+        return types;
+    }
+
+    static std::string signatureKey(const FunctionType& type) {
+        std::string key = std::to_string(static_cast<int>(type.result)) + "(";
+        for (auto param : type.params) {
+            key += std::to_string(static_cast<int>(param)) + ",";
+        }
+        return key + ")";
+    }
+
+    static bool isCall(const std::vector<Token>& tokens, size_t i, size_t end) {
+        return tokens[i].type == TokenType::IDENTIFIER && i + 1 < end && tokens[i + 1].type == TokenType::LEFT_PAREN;
+    }
+
+    static bool globalsCallFunctions(const std::vector<Token>& tokens, const std::vector<ParallelParser::Range>& ranges) {
+        for (auto& range : ranges) {
+            if (isFunction(tokens, range)) continue;
+
+            for (size_t i = range.begin; i < range.end; ++i) {
+                if (isCall(tokens, i, range.end)) return true;
+            }
+        }
+        return false;
+    }
+
+    std::string fingerprint(const std::vector<Token>& tokens, const ParallelParser::Range& range,
+                            const FunctionTypes& signatures,
+                            const std::unordered_map<std::string, TokenType>& global_types,
+                            const GlobalScope& globals) {
+        // Sorted, so the fingerprint doesn't depend on hash table order.
+        std::set<std::string> dependencies;
+        Sha256 sha;
+        sha.update(salt).update(std::string_view("\0", 1));
+
+        // Profile counters, branch weights and line tables refer to source
+        // lines, so then a function that moved must be regenerated too.
+        bool line_sensitive = codegen.profile || codegen.weights != nullptr || codegen.debug_info;
+
+        for (size_t i = range.begin; i < range.end; ++i) {
+            auto& token = tokens[i];
+            sha.update(std::to_string(static_cast<int>(token.type))).update(" ").update(token.lexeme).update(std::string_view("\0", 1));
+            if (line_sensitive) {
+                sha.update(std::to_string(token.line)).update(std::string_view("\0", 1));
+            }
+
+            if (i == range.begin + 1) continue;
+
+            if (isCall(tokens, i, range.end)) {
+                auto it = signatures.find(token.lexeme);
+                dependencies.insert("call " + token.lexeme + "/" + (it != signatures.end() ? signatureKey(it->second) : "extern"));
+            } else if (token.type == TokenType::IDENTIFIER && globals.count(token.lexeme)) {
+                auto type = global_types.find(token.lexeme);
+                dependencies.insert("global " + token.lexeme + "/" + (type != global_types.end() ? std::to_string(static_cast<int>(type->second)) : ""));
+            }
+        }
+
+        for (auto& dependency : dependencies) {
+            sha.update(dependency).update(std::string_view("\0", 1));
+        }
+
+        return sha.hexDigest();
+    }
+
+    // Parses the selected declarations, concurrently when there is a pool.
+    // The error of the first failing declaration in source order is thrown.
+    std::vector<std::unique_ptr<TreeNode>> parseDeclarations(std::vector<Token>& tokens,
+                                                             const std::vector<ParallelParser::Range>& ranges,
+                                                             const std::vector<GlobalScope>& visible_globals,
+                                                             const std::vector<bool>& needs_parse) {
+        std::vector<std::unique_ptr<TreeNode>> declarations(ranges.size());
+
+        auto parse = [&](size_t i) {
+            if (!needs_parse[i]) return;
+
+            Parser parser(tokens, ranges[i].begin, ranges[i].end, visible_globals[i]);
+            declarations[i] = parser.parseDeclaration();
+            if (!parser.isFinished()) {
+                throw std::runtime_error("Unexpected tokens after declaration at line:" + std::to_string(tokens[ranges[i].begin].line));
+            }
+        };
+
+        if (pool != nullptr) {
+            pool->parallelFor(ranges.size(), parse);
+        } else {
+            for (size_t i = 0; i < ranges.size(); ++i) {
+                parse(i);
+            }
+        }
+
+        return declarations;
+    }
+
+    // Format: a header line, the salt line, then for every function
+    // "<fingerprint> <name> <code bytes> <counters> <calls...>" followed by
+    // the code and one "<kind> <line>" line per profile counter.
+    static constexpr const char* database_header = "hydro-fndb 2";
+
+    void loadDatabase() {
+        std::ifstream fin(db_path, std::ios::binary);
+        if (!fin) return;
+
+        std::string header, stored_salt;
+        if (!std::getline(fin, header) || header != database_header) return;
+        if (!std::getline(fin, stored_salt) || stored_salt != salt) return;
+
+        std::string line;
+        while (std::getline(fin, line)) {
+            std::stringstream fields(line);
+            std::string key;
+            GeneratedFunction function;
+            size_t code_size = 0;
+            size_t counter_count = 0;
+
+            if (!(fields >> key >> function.name >> code_size >> counter_count)) break;
+
+            std::string call;
+            while (fields >> call) {
+                function.calls.insert(call);
+            }
+
+            std::string code(code_size, '\0');
+            if (!fin.read(code.data(), code_size)) break;
+            function.code = AsmBuffer(std::move(code));
+
+            for (size_t i = 0; i < counter_count; ++i) {
+                ProfileCounter counter;
+                if (!(fin >> counter.kind >> counter.line)) break;
+                function.counters.push_back(counter);
+            }
+            if (function.counters.size() != counter_count) break;
+            if (counter_count > 0) fin.ignore(1);
+
+            database[key] = std::move(function);
+        }
+    }
+
+    void saveDatabase() {
+        namespace fs = std::filesystem;
+
+        std::error_code error;
+        fs::create_directories(fs::path(db_path).parent_path(), error);
+
+        // Unique per save, as the compile server may save one database from two requests at once.
+        static std::atomic<uint64_t> temp_counter{ 0 };
+        auto tmp_path = db_path + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(temp_counter++);
+        {
+            std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!fout) return;
+
+            fout << database_header << '\n' << salt << '\n';
+            for (auto& [key, function] : database) {
+                fout << key << ' ' << function.name << ' ' << function.code.size() << ' ' << function.counters.size();
+                for (auto& call : function.calls) {
+                    fout << ' ' << call;
+                }
+                fout << '\n' << function.code;
+                for (auto& counter : function.counters) {
+                    fout << counter.kind << ' ' << counter.line << '\n';
+                }
+            }
+        }
+
+        fs::rename(tmp_path, db_path, error);
+        if (error) {
+            fs::remove(tmp_path, error);
+        }
+    }
+};
@@ -0,0 +1,407 @@
+#pragma once
+
+#include "parser.hpp"
+#include "const_fold.hpp"
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <memory>
+#include <algorithm>
+
+// Interprocedural constant propagation.
+//
+// Parameters that receive the same literal at every call site are replaced by
+// that literal inside the callee and dropped from the signature. Call sites
+// that still pass literals are redirected to specialized clones of the callee
+// when the pattern is hot enough and the code growth stays within budget.
+class InterproceduralConstPropagator {
+public:
+    struct Clone {
+        std::string function;
+        std::string clone_name;
+        std::vector<std::optional<long long>> pattern;
+        int call_sites;
+        int nodes;
+    };
+
+    struct Propagated {
+        std::string function;
+        int param_index;
+        long long value;
+    };
+
+    // Static weight of a call pattern needed before it gets its own clone.
+    // A call site counts once, or ten times per enclosing loop.
+    int min_hotness = 2;
+    // Largest callee body (in tree nodes) that is worth cloning.
+    int max_clone_nodes = 200;
+    // Total size of all clones as a percentage of the original program.
+    int max_growth_percent = 25;
+
+    InterproceduralConstPropagator(std::unique_ptr<TreeNode>& root) : root(root) {}
+
+    void run() {
+        if (root == nullptr) return;
+
+        collectFunctions();
+        collectCallSites();
+        propagateUniformArguments();
+        specializeCallSites();
+    }
+
+    const std::vector<Clone>& clones() const { return clone_report; }
+    const std::vector<Propagated>& propagated() const { return propagated_report; }
+
+private:
+    struct Function {
+        TreeNode* decl_list = nullptr;
+        FuncNode* node = nullptr;
+        std::vector<std::unique_ptr<TreeNode>> params;
+        std::unordered_set<std::string> written_slots;
+    };
+
+    struct CallSite {
+        TreeNode* call;
+        std::string callee;
+        int hotness;
+    };
+
+    std::unique_ptr<TreeNode>& root;
+    std::map<std::string, Function> functions;
+    std::vector<CallSite> call_sites;
+    std::vector<Clone> clone_report;
+    std::vector<Propagated> propagated_report;
+    int program_nodes = 0;
+    int clone_count = 0;
+
+    static std::string paramSlot(int index) {
+        return std::to_string(-(index + 2) * 8);
+    }
+
+    static int countNodes(const TreeNode* node) {
+        if (node == nullptr) return 0;
+
+        int count = 1 + countNodes(node->left.get()) + countNodes(node->right.get());
+        if (auto if_node = dynamic_cast<const IfNode*>(node)) {
+            count += countNodes(if_node->condition.get());
+        }
+        return count;
+    }
+
+    static void flattenParams(TreeNode* node, std::vector<std::unique_ptr<TreeNode>>& params) {
+        if (node == nullptr) return;
+
+        if (node->token.type == TokenType::COMMA) {
+            flattenParams(node->left.get(), params);
+            params.push_back(node->right->clone());
+            return;
+        }
+
+        params.push_back(node->clone());
+    }
+
+    static std::unique_ptr<TreeNode> buildParams(const std::vector<const TreeNode*>& params) {
+        std::unique_ptr<TreeNode> left = nullptr;
+
+        for (auto param : params) {
+            if (left == nullptr) {
+                left = param->clone();
+                continue;
+            }
+
+            Token comma{
+                .type = TokenType::COMMA,
+                .lexeme = ",",
+                .line = param->token.line,
+            };
+            left = std::make_unique<TreeNode>(comma, std::move(left), param->clone());
+        }
+
+        return left;
+    }
+
+    // Arguments of a call in source order. The ARG_LIST chain holds the last argument on top.
+    static std::vector<std::unique_ptr<TreeNode>*> callArguments(TreeNode* call) {
+        std::vector<std::unique_ptr<TreeNode>*> args;
+
+        for (TreeNode* tmp = call->left.get(); tmp != nullptr; tmp = tmp->left.get()) {
+            args.push_back(&tmp->right);
+        }
+
+        std::reverse(args.begin(), args.end());
+        return args;
+    }
+
+    static void removeArguments(TreeNode* call, const std::vector<bool>& removed) {
+        int index = 0;
+        for (TreeNode* tmp = call->left.get(); tmp != nullptr; tmp = tmp->left.get()) {
+            ++index;
+        }
+
+        std::unique_ptr<TreeNode>* link = &call->left;
+        while (*link != nullptr) {
+            --index;
+            if (removed[index]) {
+                *link = std::move((*link)->left);
+            } else {
+                link = &(*link)->left;
+            }
+        }
+    }
+
+    static void collectWrites(const TreeNode* node, std::unordered_set<std::string>& written) {
+        if (node == nullptr) return;
+
+        auto type = node->token.type;
+        bool is_store = type == TokenType::EQUAL || type == TokenType::PLUS_EQUAL || type == TokenType::MINUS_EQUAL;
+        if (is_store && node->left != nullptr && node->left->token.type == TokenType::IDENTIFIER) {
+            written.insert(node->left->token.lexeme);
+        }
+
+        if (auto if_node = dynamic_cast<const IfNode*>(node)) {
+            collectWrites(if_node->condition.get(), written);
+        }
+
+        collectWrites(node->left.get(), written);
+        collectWrites(node->right.get(), written);
+    }
+
+    void collectFunctions() {
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            program_nodes += countNodes(decl->left.get());
+
+            if (decl->left == nullptr || decl->left->token.type != TokenType::FUNCTION_DECL) continue;
+
+            auto fn_node = dynamic_cast<FuncNode*>(decl->left.get());
+            auto& fn = functions[fn_node->token.lexeme.substr(1)];
+            fn.decl_list = decl;
+            fn.node = fn_node;
+            flattenParams(fn_node->left->right.get(), fn.params);
+            collectWrites(fn_node->right.get(), fn.written_slots);
+        }
+    }
+
+    void collectCallSites(TreeNode* node, int hotness) {
+        if (node == nullptr) return;
+
+        if (node->token.type == TokenType::WHILE) {
+            hotness = std::min(hotness * 10, 1000);
+        }
+
+        if (node->token.type == TokenType::FUNCTION_CALL && functions.count(node->token.lexeme)) {
+            call_sites.push_back(CallSite{ node, node->token.lexeme, hotness });
+        }
+
+        if (auto if_node = dynamic_cast<IfNode*>(node)) {
+            collectCallSites(if_node->condition.get(), hotness);
+        }
+
+        collectCallSites(node->left.get(), hotness);
+        collectCallSites(node->right.get(), hotness);
+    }
+
+    void collectCallSites() {
+        for (auto& [name, fn] : functions) {
+            collectCallSites(fn.node->right.get(), 1);
+        }
+    }
+
+    bool isPropagatable(const Function& fn, int index) const {
+        return !fn.written_slots.count(paramSlot(index));
+    }
+
+    // Replaces constant parameters by their values and renumbers the remaining ones.
+    static void substituteParams(std::unique_ptr<TreeNode>& node, const std::vector<std::optional<long long>>& values) {
+        if (node == nullptr) return;
+
+        if (node->token.type == TokenType::IDENTIFIER) {
+            int shift = 0;
+
+            for (int i = 0; i < (int)values.size(); ++i) {
+                if (node->token.lexeme != paramSlot(i)) {
+                    if (values[i]) ++shift;
+                    continue;
+                }
+
+                if (values[i]) {
+                    Token token{
+                        .type = TokenType::INT_LIT,
+                        .lexeme = std::to_string(values[i].value()),
+                        .line = node->token.line,
+                    };
+                    node = std::make_unique<TreeNode>(token);
+                } else {
+                    node->token.lexeme = paramSlot(i - shift);
+                }
+                return;
+            }
+            return;
+        }
+
+        if (auto if_node = dynamic_cast<IfNode*>(node.get())) {
+            substituteParams(if_node->condition, values);
+        }
+
+        substituteParams(node->left, values);
+        substituteParams(node->right, values);
+    }
+
+    // Rewrites a function declaration for a known set of constant parameters.
+    void specializeFunction(FuncNode* fn_node, const Function& fn, const std::vector<std::optional<long long>>& values) {
+        std::vector<const TreeNode*> kept;
+        for (int i = 0; i < (int)fn.params.size(); ++i) {
+            if (!values[i]) kept.push_back(fn.params[i].get());
+        }
+
+        fn_node->left->right = buildParams(kept);
+        substituteParams(fn_node->right, values);
+        ConstantFolder::fold(fn_node->right);
+    }
+
+    void propagateUniformArguments() {
+        for (auto& [name, fn] : functions) {
+            if (name == "main" || fn.params.empty()) continue;
+
+            std::vector<std::optional<long long>> values(fn.params.size());
+            std::vector<bool> is_uniform(fn.params.size(), true);
+            bool has_call_site = false;
+
+            for (auto& site : call_sites) {
+                if (site.callee != name) continue;
+
+                // Calls with a mismatched argument count keep the function untouched.
+                auto args = callArguments(site.call);
+                if (args.size() != fn.params.size()) {
+                    has_call_site = false;
+                    break;
+                }
+
+                for (int i = 0; i < (int)args.size(); ++i) {
+                    auto value = ConstantFolder::literalValue(args[i]->get());
+                    if (!value || (has_call_site && values[i] != value)) {
+                        is_uniform[i] = false;
+                    }
+                    values[i] = value;
+                }
+
+                has_call_site = true;
+            }
+
+            if (!has_call_site) continue;
+
+            bool changed = false;
+            for (int i = 0; i < (int)values.size(); ++i) {
+                if (!is_uniform[i] || !isPropagatable(fn, i)) {
+                    values[i] = std::nullopt;
+                    continue;
+                }
+
+                changed = true;
+                propagated_report.push_back(Propagated{ name, i, values[i].value() });
+            }
+
+            if (!changed) continue;
+
+            std::vector<bool> removed(values.size());
+            for (int i = 0; i < (int)values.size(); ++i) {
+                removed[i] = values[i].has_value();
+            }
+
+            for (auto& site : call_sites) {
+                if (site.callee == name) removeArguments(site.call, removed);
+            }
+
+            specializeFunction(fn.node, fn, values);
+
+            fn.params.clear();
+            flattenParams(fn.node->left->right.get(), fn.params);
+            fn.written_slots.clear();
+            collectWrites(fn.node->right.get(), fn.written_slots);
+        }
+    }
+
+    void specializeCallSites() {
+        using Pattern = std::pair<std::string, std::vector<std::optional<long long>>>;
+        std::map<Pattern, std::vector<const CallSite*>> patterns;
+
+        for (auto& site : call_sites) {
+            auto& fn = functions[site.callee];
+            if (site.callee == "main") continue;
+
+            auto args = callArguments(site.call);
+            if (args.size() != fn.params.size()) continue;
+
+            std::vector<std::optional<long long>> values(args.size());
+            bool has_constant = false;
+
+            for (int i = 0; i < (int)args.size(); ++i) {
+                if (!isPropagatable(fn, i)) continue;
+
+                values[i] = ConstantFolder::literalValue(args[i]->get());
+                has_constant |= values[i].has_value();
+            }
+
+            if (has_constant) {
+                patterns[{ site.callee, values }].push_back(&site);
+            }
+        }
+
+        std::vector<std::pair<int, const Pattern*>> candidates;
+        for (auto& [pattern, sites] : patterns) {
+            int hotness = 0;
+            for (auto site : sites) hotness += site->hotness;
+
+            if (hotness >= min_hotness) {
+                candidates.push_back({ hotness, &pattern });
+            }
+        }
+
+        std::stable_sort(candidates.begin(), candidates.end(), [](auto& a, auto& b) { return a.first > b.first; });
+
+        int budget = program_nodes * max_growth_percent / 100;
+
+        for (auto& [hotness, pattern] : candidates) {
+            auto& [name, values] = *pattern;
+            auto& fn = functions[name];
+
+            int nodes = countNodes(fn.node);
+            if (nodes > max_clone_nodes || nodes > budget) continue;
+            budget -= nodes;
+
+            // Skip numbers whose name the program already uses.
+            std::string clone_name;
+            do {
+                clone_name = name + "__spec" + std::to_string(++clone_count);
+            } while (functions.count(clone_name));
+
+            auto clone = fn.node->clone();
+            auto clone_fn = dynamic_cast<FuncNode*>(clone.get());
+            clone_fn->token.lexeme = "_" + clone_name;
+            clone_fn->left->left->token.lexeme = clone_name;
+            specializeFunction(clone_fn, fn, values);
+
+            Token decl_token{
+                .type = TokenType::DECL_LIST,
+                .lexeme = "dec",
+                .line = fn.decl_list->token.line,
+            };
+            fn.decl_list->right = std::make_unique<TreeNode>(decl_token, std::move(clone), std::move(fn.decl_list->right));
+
+            std::vector<bool> removed(values.size());
+            for (int i = 0; i < (int)values.size(); ++i) {
+                removed[i] = values[i].has_value();
+            }
+
+            auto& sites = patterns.at(*pattern);
+            for (auto site : sites) {
+                site->call->token.lexeme = clone_name;
+                removeArguments(site->call, removed);
+            }
+
+            clone_report.push_back(Clone{ name, clone_name, values, (int)sites.size(), nodes });
+        }
+    }
+};
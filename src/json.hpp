@@ -0,0 +1,391 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+#include <cstdint>
+
+// A JSON value, just enough for the language server protocol. Objects keep
+// their keys in insertion order; lookups are linear, messages are small.
+class Json {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Json() = default;
+    Json(std::nullptr_t) {}
+    Json(bool value) : type(Type::Bool), boolean(value) {}
+    Json(int value) : type(Type::Number), number(value) {}
+    Json(long long value) : type(Type::Number), number(static_cast<double>(value)) {}
+    Json(size_t value) : type(Type::Number), number(static_cast<double>(value)) {}
+    Json(double value) : type(Type::Number), number(value) {}
+    Json(const char* value) : type(Type::String), string(value) {}
+    Json(std::string value) : type(Type::String), string(std::move(value)) {}
+
+    static Json array() {
+        Json json;
+        json.type = Type::Array;
+        return json;
+    }
+
+    static Json object() {
+        Json json;
+        json.type = Type::Object;
+        return json;
+    }
+
+    // Throws std::runtime_error on malformed input.
+    static Json parse(std::string_view text) {
+        Reader reader{ text };
+        auto value = reader.readValue();
+        reader.skipSpace();
+        if (reader.pos != text.size()) reader.fail("Unexpected data after JSON value");
+        return value;
+    }
+
+    Type kind() const { return type; }
+    bool isNull() const { return type == Type::Null; }
+    bool isString() const { return type == Type::String; }
+    bool isNumber() const { return type == Type::Number; }
+    bool isObject() const { return type == Type::Object; }
+    bool isArray() const { return type == Type::Array; }
+
+    const std::string& asString() const {
+        static const std::string empty;
+        return type == Type::String ? string : empty;
+    }
+
+    long long asInt(long long fallback = 0) const {
+        return type == Type::Number ? static_cast<long long>(number) : fallback;
+    }
+
+    bool asBool() const {
+        return type == Type::Bool && boolean;
+    }
+
+    size_t size() const {
+        return type == Type::Array ? elements.size() : type == Type::Object ? members.size() : 0;
+    }
+
+    // Missing members and elements read as null.
+    const Json& operator[](std::string_view key) const {
+        for (auto& [name, value] : members) {
+            if (name == key) return value;
+        }
+        return null();
+    }
+
+    const Json& operator[](size_t index) const {
+        return index < elements.size() ? elements[index] : null();
+    }
+
+    bool contains(std::string_view key) const {
+        for (auto& member : members) {
+            if (member.first == key) return true;
+        }
+        return false;
+    }
+
+    const std::vector<Json>& items() const { return elements; }
+
+    Json& set(std::string key, Json value) {
+        type = Type::Object;
+        for (auto& member : members) {
+            if (member.first == key) {
+                member.second = std::move(value);
+                return *this;
+            }
+        }
+        members.emplace_back(std::move(key), std::move(value));
+        return *this;
+    }
+
+    Json& push(Json value) {
+        type = Type::Array;
+        elements.push_back(std::move(value));
+        return *this;
+    }
+
+    void write(std::ostream& out) const {
+        switch (type) {
+        case Type::Null: out << "null"; break;
+        case Type::Bool: out << (boolean ? "true" : "false"); break;
+        case Type::Number: writeNumber(out); break;
+        case Type::String: writeString(out, string); break;
+        case Type::Array:
+            out << '[';
+            for (size_t i = 0; i < elements.size(); ++i) {
+                if (i > 0) out << ',';
+                elements[i].write(out);
+            }
+            out << ']';
+            break;
+        case Type::Object:
+            out << '{';
+            for (size_t i = 0; i < members.size(); ++i) {
+                if (i > 0) out << ',';
+                writeString(out, members[i].first);
+                out << ':';
+                members[i].second.write(out);
+            }
+            out << '}';
+            break;
+        }
+    }
+
+    std::string dump() const {
+        std::stringstream ss;
+        write(ss);
+        return ss.str();
+    }
+
+private:
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<Json> elements;
+    std::vector<std::pair<std::string, Json>> members;
+
+    static const Json& null() {
+        static const Json value;
+        return value;
+    }
+
+    // Integers print without a fraction, so ids and positions round-trip.
+    void writeNumber(std::ostream& out) const {
+        if (std::isfinite(number) && number == std::floor(number) && std::fabs(number) < 9.007199254740992e15) {
+            out << static_cast<long long>(number);
+        } else if (std::isfinite(number)) {
+            std::stringstream ss;
+            ss.precision(17);
+            ss << number;
+            out << ss.str();
+        } else {
+            out << "null";
+        }
+    }
+
+    static void writeString(std::ostream& out, std::string_view text) {
+        static const char* hex = "0123456789abcdef";
+
+        out << '"';
+        for (unsigned char c : text) {
+            switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out << "\\u00" << hex[c >> 4] << hex[c & 15];
+                } else {
+                    out << c;
+                }
+            }
+        }
+        out << '"';
+    }
+
+    struct Reader {
+        std::string_view text;
+        size_t pos = 0;
+        int depth = 0;
+
+        [[noreturn]] void fail(const std::string& message) {
+            throw std::runtime_error(message + " at offset " + std::to_string(pos));
+        }
+
+        void skipSpace() {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+                ++pos;
+            }
+        }
+
+        bool consumeWord(std::string_view word) {
+            if (text.substr(pos, word.size()) != word) return false;
+            pos += word.size();
+            return true;
+        }
+
+        Json readValue() {
+            skipSpace();
+            if (pos >= text.size()) fail("Unexpected end of JSON");
+
+            char c = text[pos];
+            if (c == '{' || c == '[') {
+                if (++depth > 256) fail("JSON nested too deeply");
+                auto value = c == '{' ? readObject() : readArray();
+                --depth;
+                return value;
+            }
+            if (c == '"') return Json(readString());
+            if (consumeWord("true")) return Json(true);
+            if (consumeWord("false")) return Json(false);
+            if (consumeWord("null")) return Json();
+            if (c == '-' || (c >= '0' && c <= '9')) return readNumber();
+
+            fail("Unexpected character in JSON");
+        }
+
+        Json readObject() {
+            auto object = Json::object();
+            ++pos; // consume '{'
+
+            skipSpace();
+            if (pos < text.size() && text[pos] == '}') {
+                ++pos;
+                return object;
+            }
+
+            while (true) {
+                skipSpace();
+                if (pos >= text.size() || text[pos] != '"') fail("Expected a member name");
+                auto key = readString();
+
+                skipSpace();
+                if (pos >= text.size() || text[pos] != ':') fail("Expected ':'");
+                ++pos;
+
+                object.members.emplace_back(std::move(key), readValue());
+
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                if (pos < text.size() && text[pos] == '}') {
+                    ++pos;
+                    return object;
+                }
+                fail("Expected ',' or '}'");
+            }
+        }
+
+        Json readArray() {
+            auto array = Json::array();
+            ++pos; // consume '['
+
+            skipSpace();
+            if (pos < text.size() && text[pos] == ']') {
+                ++pos;
+                return array;
+            }
+
+            while (true) {
+                array.elements.push_back(readValue());
+
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                if (pos < text.size() && text[pos] == ']') {
+                    ++pos;
+                    return array;
+                }
+                fail("Expected ',' or ']'");
+            }
+        }
+
+        Json readNumber() {
+            size_t begin = pos;
+            if (text[pos] == '-') ++pos;
+            while (pos < text.size() && std::string_view("0123456789.eE+-").find(text[pos]) != std::string_view::npos) {
+                ++pos;
+            }
+
+            try {
+                size_t used = 0;
+                std::string number(text.substr(begin, pos - begin));
+                double value = std::stod(number, &used);
+                if (used != number.size()) fail("Malformed number");
+                return Json(value);
+            }
+            catch (const std::logic_error&) {
+                fail("Malformed number");
+            }
+        }
+
+        unsigned readHex4() {
+            if (pos + 4 > text.size()) fail("Truncated escape");
+
+            unsigned value = 0;
+            for (int i = 0; i < 4; ++i) {
+                char c = text[pos++];
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= c - '0';
+                else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+                else fail("Malformed escape");
+            }
+            return value;
+        }
+
+        static void appendUtf8(std::string& out, uint32_t code) {
+            if (code < 0x80) {
+                out += static_cast<char>(code);
+            } else if (code < 0x800) {
+                out += static_cast<char>(0xc0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            } else if (code < 0x10000) {
+                out += static_cast<char>(0xe0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            } else {
+                out += static_cast<char>(0xf0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            }
+        }
+
+        std::string readString() {
+            std::string out;
+            ++pos; // consume '"'
+
+            while (true) {
+                if (pos >= text.size()) fail("Unterminated string");
+
+                char c = text[pos++];
+                if (c == '"') return out;
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+
+                if (pos >= text.size()) fail("Unterminated string");
+                char escape = text[pos++];
+                switch (escape) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code = readHex4();
+                    // A surrogate pair encodes one code point above U+FFFF.
+                    if (code >= 0xd800 && code < 0xdc00 && consumeWord("\\u")) {
+                        uint32_t low = readHex4();
+                        if (low >= 0xdc00 && low < 0xe000) {
+                            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                        }
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    fail("Malformed escape");
+                }
+            }
+        }
+    };
+};
@@ -0,0 +1,769 @@
+#pragma once
+
+#include "tokenizer.hpp"
+#include "parser.hpp"
+#include "parallel_parser.hpp"
+#include "json.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <memory>
+#include <algorithm>
+#include <charconv>
+
+// An open source file of the language server, kept lexed and parsed.
+//
+// Every line keeps its own tokens, so an edit re-lexes only the lines it
+// touches (and the following ones while a block comment changes state).
+// Top-level declarations keep their tokens' extent, AST, symbol table and
+// parse error; an edit re-splits only the declarations around it and
+// re-parses those, plus later ones naming a global whose declaration
+// changed. Positions are 0-based lines and byte columns, which equal the
+// protocol's UTF-16 columns for ASCII sources.
+class LspDocument {
+public:
+    struct Span {
+        int line;
+        int column;
+        int length;
+    };
+
+    struct Diagnostic {
+        Span span;
+        std::string message;
+    };
+
+    struct Hover {
+        Span span;
+        std::string text;
+    };
+
+    explicit LspDocument(const std::string& text) {
+        setText(text);
+    }
+
+    void setText(const std::string& text) {
+        lines = splitLines(text);
+        line_info.assign(lines.size(), Line());
+        relex(0, lines.size());
+
+        declarations.clear();
+        auto fresh = splitFrom(Position{ 0, 0 }, 0, 0);
+        declarations = std::move(fresh);
+        reparse(0, declarations.size(), {});
+        symbol_index_valid = false;
+    }
+
+    // Replaces the text between two positions, as a didChange range does.
+    void edit(int start_line, int start_column, int end_line, int end_column, const std::string& text) {
+        clampPosition(start_line, start_column);
+        clampPosition(end_line, end_column);
+        if (std::make_pair(end_line, end_column) < std::make_pair(start_line, start_column)) {
+            std::swap(start_line, end_line);
+            std::swap(start_column, end_column);
+        }
+
+        auto replacement = splitLines(lines[start_line].substr(0, start_column) + text + lines[end_line].substr(end_column));
+        int old_count = end_line - start_line + 1;
+        int delta = (int)replacement.size() - old_count;
+
+        // Typing within a line keeps the line count; then nothing has to shift.
+        resizeRange(lines, start_line, old_count, replacement.size());
+        resizeRange(line_info, start_line, old_count, replacement.size());
+        std::move(replacement.begin(), replacement.end(), lines.begin() + start_line);
+
+        size_t relexed_end = relex(start_line, start_line + replacement.size());
+
+        // Declarations ending before the edit are untouched, unless the last
+        // one was still open and the edit can complete it.
+        size_t first = 0;
+        while (first < declarations.size() && declarations[first].last.line < start_line) ++first;
+        if (first > 0 && first == declarations.size() && !declarations[first - 1].complete) --first;
+
+        // Declarations starting after the edit keep their tokens; they only move.
+        size_t reusable = first;
+        while (reusable < declarations.size() && declarations[reusable].first.line <= end_line) ++reusable;
+        for (size_t i = reusable; i < declarations.size(); ++i) {
+            declarations[i].first.line += delta;
+            declarations[i].last.line += delta;
+        }
+
+        Position start = first == 0 ? Position{ 0, 0 } : next(declarations[first - 1].last);
+        size_t resume = declarations.size();
+        auto fresh = splitFrom(start, relexed_end, reusable, &resume);
+
+        std::unordered_set<std::string> changed_globals;
+        for (size_t i = first; i < resume; ++i) {
+            if (declarations[i].global) changed_globals.insert(declarations[i].global->first);
+        }
+        for (auto& declaration : fresh) {
+            if (declaration.global) {
+                // A global that stays as it was doesn't affect later declarations.
+                bool kept = std::any_of(declarations.begin() + first, declarations.begin() + resume, [&](auto& old) {
+                    return old.global == declaration.global;
+                });
+                if (kept) changed_globals.erase(declaration.global->first);
+                else changed_globals.insert(declaration.global->first);
+            }
+        }
+
+        size_t fresh_count = fresh.size();
+        declarations.erase(declarations.begin() + first, declarations.begin() + resume);
+        declarations.insert(declarations.begin() + first, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+
+        reparse(first, first + fresh_count, changed_globals);
+        symbol_index_valid = false;
+    }
+
+    std::vector<Diagnostic> diagnostics() const {
+        std::vector<Diagnostic> result;
+
+        for (size_t i = 0; i < line_info.size(); ++i) {
+            if (line_info[i].error) {
+                result.push_back(Diagnostic{ Span{ (int)i, line_info[i].error_column, 1 }, line_info[i].error.value() });
+            }
+        }
+
+        for (auto& declaration : declarations) {
+            if (declaration.error) {
+                auto diagnostic = declaration.error.value();
+                diagnostic.span.line += declaration.first.line;
+                result.push_back(diagnostic);
+            }
+        }
+
+        std::stable_sort(result.begin(), result.end(), [](auto& a, auto& b) {
+            return std::make_pair(a.span.line, a.span.column) < std::make_pair(b.span.line, b.span.column);
+        });
+        return result;
+    }
+
+    std::optional<Span> definition(int line, int column) {
+        auto found = resolve(line, column);
+        if (!found) return std::nullopt;
+        return symbolSpan(found->first, *found->second);
+    }
+
+    std::optional<Hover> hover(int line, int column) {
+        auto token = tokenAt(line, column);
+        auto found = resolve(line, column);
+        if (!token || !found) return std::nullopt;
+
+        auto& symbol = *found->second;
+        std::string text;
+        switch (symbol.kind) {
+        case SymbolTable::Kind::Function:
+            text = signature(declarations[found->first]);
+            break;
+        case SymbolTable::Kind::Parameter:
+            text = "(parameter) " + symbol.type + " " + symbol.name.lexeme;
+            break;
+        case SymbolTable::Kind::Local:
+            text = "(local) " + symbol.type + " " + symbol.name.lexeme;
+            break;
+        case SymbolTable::Kind::Global:
+            text = "(global) " + symbol.type + " " + symbol.name.lexeme;
+            break;
+        }
+        if (symbol.length > 0) {
+            text += "[" + std::to_string(symbol.length) + "]";
+        }
+
+        auto& at = tokenRef(token.value());
+        return Hover{ Span{ line, at.column, (int)at.lexeme.size() }, text };
+    }
+
+    size_t lineCount() const { return lines.size(); }
+    size_t declarationCount() const { return declarations.size(); }
+    // Declarations parsed by the last setText or edit.
+    size_t lastReparsed() const { return last_reparsed; }
+
+private:
+    // A token: its line and its index among the line's tokens.
+    struct Position {
+        int line;
+        size_t token;
+
+        bool operator==(const Position&) const = default;
+        bool operator<(const Position& other) const {
+            return line != other.line ? line < other.line : token < other.token;
+        }
+    };
+
+    struct Line {
+        std::vector<Token> tokens;      // line numbers are 0
+        bool starts_in_comment = false;
+        bool ends_in_comment = false;
+        std::optional<std::string> error;
+        int error_column = 0;
+    };
+
+    struct Declaration {
+        Position first;
+        Position last;
+        bool complete = false;          // ends in ';' or the closing '}'
+        std::unique_ptr<TreeNode> ast;
+        SymbolTable symbols;            // lines relative to first.line
+        std::optional<Diagnostic> error;    // line relative to first.line
+        std::optional<std::pair<std::string, long long>> global;
+    };
+
+    std::vector<std::string> lines;
+    std::vector<Line> line_info;
+    std::vector<Declaration> declarations;
+    size_t last_reparsed = 0;
+
+    // Functions and globals by name: declaration index and symbol index.
+    std::unordered_map<std::string, std::pair<size_t, int>> functions;
+    std::unordered_map<std::string, std::pair<size_t, int>> globals;
+    bool symbol_index_valid = false;
+
+    static std::vector<std::string> splitLines(const std::string& text) {
+        std::vector<std::string> result;
+        size_t begin = 0;
+        while (true) {
+            size_t newline = text.find('\n', begin);
+            if (newline == std::string::npos) {
+                result.push_back(text.substr(begin));
+                return result;
+            }
+            result.push_back(text.substr(begin, newline - begin));
+            begin = newline + 1;
+        }
+    }
+
+    // Makes the count elements at start new_count elements.
+    template <typename T>
+    static void resizeRange(std::vector<T>& items, size_t start, size_t count, size_t new_count) {
+        if (new_count < count) {
+            items.erase(items.begin() + start + new_count, items.begin() + start + count);
+        } else if (new_count > count) {
+            items.insert(items.begin() + start + count, new_count - count, T());
+        }
+    }
+
+    void clampPosition(int& line, int& column) const {
+        line = std::clamp(line, 0, (int)lines.size() - 1);
+        column = std::clamp(column, 0, (int)lines[line].size());
+    }
+
+    // Lexes one line. A character the tokenizer rejects is reported and
+    // then skipped, so the rest of the line still has tokens.
+    void lexLine(size_t i, bool starts_in_comment) {
+        auto& info = line_info[i];
+        info.starts_in_comment = starts_in_comment;
+        info.error.reset();
+
+        std::string text = lines[i] + "\n";
+        while (true) {
+            Tokenizer tokenizer(text);
+            try {
+                auto chunk = tokenizer.tokenizeChunk(0, text.size(), starts_in_comment);
+                info.tokens = std::move(chunk.tokens);
+                info.ends_in_comment = chunk.ends_in_comment;
+                return;
+            }
+            catch (const std::exception& e) {
+                size_t bad = tokenizer.position() - 1;
+                if (!info.error) {
+                    info.error = e.what();
+                    info.error_column = bad;
+                }
+                text[bad] = ' ';
+            }
+        }
+    }
+
+    // Lexes lines [begin, end) and the lines after them whose block comment
+    // state changed. Returns the end of the lexed lines.
+    size_t relex(size_t begin, size_t end) {
+        bool in_comment = begin > 0 && line_info[begin - 1].ends_in_comment;
+
+        size_t i = begin;
+        for (; i < line_info.size(); ++i) {
+            if (i >= end && line_info[i].starts_in_comment == in_comment) break;
+
+            lexLine(i, in_comment);
+            in_comment = line_info[i].ends_in_comment;
+        }
+        return i;
+    }
+
+    // The first token at or after a position, or the end of the document.
+    Position settle(Position position) const {
+        while (position.line < (int)lines.size() && position.token >= line_info[position.line].tokens.size()) {
+            ++position.line;
+            position.token = 0;
+        }
+        return position;
+    }
+
+    Position next(Position position) const {
+        ++position.token;
+        return settle(position);
+    }
+
+    bool atEnd(Position position) const {
+        return position.line >= (int)lines.size();
+    }
+
+    const Token& tokenRef(Position position) const {
+        return line_info[position.line].tokens[position.token];
+    }
+
+    // Splits the tokens from start into declarations, like
+    // ParallelParser::splitDeclarations. Once past stop_line, the split stops
+    // at the start of any declaration in declarations[reusable...], whose
+    // index is stored in resume.
+    std::vector<Declaration> splitFrom(Position start, size_t stop_line, size_t reusable, size_t* resume = nullptr) {
+        std::vector<Declaration> result;
+        Position position = settle(start);
+        size_t candidate = reusable;
+
+        while (!atEnd(position)) {
+            if (position.line >= (int)stop_line) {
+                while (candidate < declarations.size() && declarations[candidate].first < position) ++candidate;
+                if (candidate < declarations.size() && declarations[candidate].first == position) {
+                    *resume = candidate;
+                    return result;
+                }
+            }
+
+            Declaration declaration;
+            declaration.first = position;
+            int depth = 0;
+
+            while (!atEnd(position)) {
+                auto type = tokenRef(position).type;
+                declaration.last = position;
+                position = next(position);
+
+                if (type == TokenType::LEFT_BRACE) {
+                    ++depth;
+                } else if (type == TokenType::RIGHT_BRACE && --depth <= 0) {
+                    declaration.complete = true;
+                    break;
+                } else if (type == TokenType::SEMICOLON && depth == 0) {
+                    declaration.complete = true;
+                    break;
+                }
+            }
+
+            auto tokens = declarationTokens(declaration);
+            declaration.global = ParallelParser::declaredGlobal(tokens, ParallelParser::Range{ 0, tokens.size() - 1 });
+            result.push_back(std::move(declaration));
+        }
+
+        if (resume != nullptr) *resume = declarations.size();
+        return result;
+    }
+
+    std::vector<Token> declarationTokens(const Declaration& declaration) const {
+        std::vector<Token> tokens;
+        for (Position position = declaration.first; ; position = next(position)) {
+            tokens.push_back(tokenRef(position));
+            tokens.back().line = position.line - declaration.first.line;
+            if (position == declaration.last) break;
+        }
+
+        auto& last = tokens.back();
+        tokens.push_back(Token{
+            .type = TokenType::EOF_TOKEN,
+            .lexeme = "",
+            .line = last.line,
+            .column = last.column + (int)last.lexeme.size(),
+        });
+        return tokens;
+    }
+
+    static bool mentions(const std::vector<Token>& tokens, const std::unordered_set<std::string>& names) {
+        return std::any_of(tokens.begin(), tokens.end(), [&](auto& token) {
+            return token.type == TokenType::IDENTIFIER && names.count(token.lexeme);
+        });
+    }
+
+    // "Expected ';' at line: 12" reads "Expected ';'": diagnostics carry the
+    // position, and the line in the text goes stale when the code moves.
+    static std::string stripLine(std::string message) {
+        for (std::string marker : { " at line", " at Line", ". line", ". Line", " line:", " Line:" }) {
+            auto at = message.find(marker);
+            if (at != std::string::npos) {
+                message.erase(at);
+                break;
+            }
+        }
+        while (!message.empty() && (message.back() == '.' || message.back() == ' ')) message.pop_back();
+        return message;
+    }
+
+    void parse(Declaration& declaration, const std::vector<Token>& declaration_tokens, const GlobalScope& visible_globals) {
+        auto tokens = declaration_tokens;
+        declaration.ast.reset();
+        declaration.symbols = SymbolTable();
+        declaration.error.reset();
+
+        Parser parser(tokens, 0, tokens.size() - 1, visible_globals);
+        parser.symbols = &declaration.symbols;
+
+        try {
+            declaration.ast = parser.parseDeclaration();
+            if (!parser.isFinished()) {
+                throw std::runtime_error("Unexpected tokens after declaration");
+            }
+        }
+        catch (const std::exception& e) {
+            size_t index = std::min(parser.position(), tokens.size() - 1);
+
+            // "Variable 'x' ..." is thrown just after reading x; point at x.
+            std::string message = e.what();
+            auto quote = message.find('\'');
+            auto close = message.find('\'', quote + 1);
+            if (index > 0 && close != std::string::npos && tokens[index - 1].lexeme == message.substr(quote + 1, close - quote - 1)) {
+                --index;
+            }
+
+            auto& at = tokens[index];
+            int length = std::max(1, (int)at.lexeme.size());
+            declaration.error = Diagnostic{ Span{ at.line, at.column, length }, stripLine(e.what()) };
+        }
+
+        ++last_reparsed;
+    }
+
+    // Parses declarations [begin, end), then later ones naming a changed global.
+    void reparse(size_t begin, size_t end, const std::unordered_set<std::string>& changed_globals) {
+        last_reparsed = 0;
+
+        GlobalScope visible_globals;
+        for (size_t i = 0; i < begin; ++i) {
+            if (declarations[i].global) visible_globals[declarations[i].global->first] = declarations[i].global->second;
+        }
+
+        size_t stop = changed_globals.empty() ? end : declarations.size();
+        for (size_t i = begin; i < stop; ++i) {
+            auto& declaration = declarations[i];
+            auto tokens = declarationTokens(declaration);
+
+            if (i < end || mentions(tokens, changed_globals)) {
+                parse(declaration, tokens, visible_globals);
+            }
+
+            if (declaration.global) visible_globals[declaration.global->first] = declaration.global->second;
+        }
+    }
+
+    std::optional<Position> tokenAt(int line, int column) const {
+        if (line < 0 || line >= (int)lines.size()) return std::nullopt;
+
+        auto& tokens = line_info[line].tokens;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            // The end counts too: the cursor often sits right after a name.
+            if (column >= tokens[i].column && column <= tokens[i].column + (int)tokens[i].lexeme.size()) {
+                if (tokens[i].type != TokenType::IDENTIFIER && i + 1 < tokens.size() && tokens[i + 1].column == column) continue;
+                return Position{ line, i };
+            }
+        }
+        return std::nullopt;
+    }
+
+    size_t declarationAt(Position position) const {
+        auto it = std::upper_bound(declarations.begin(), declarations.end(), position, [](const Position& p, const Declaration& d) {
+            return p < d.first;
+        });
+        return it - declarations.begin() - 1;
+    }
+
+    void buildSymbolIndex() {
+        if (symbol_index_valid) return;
+
+        functions.clear();
+        globals.clear();
+        for (size_t i = 0; i < declarations.size(); ++i) {
+            auto& symbols = declarations[i].symbols.symbols;
+            for (size_t s = 0; s < symbols.size(); ++s) {
+                if (symbols[s].kind == SymbolTable::Kind::Function) functions.emplace(symbols[s].name.lexeme, std::make_pair(i, (int)s));
+                if (symbols[s].kind == SymbolTable::Kind::Global) globals.emplace(symbols[s].name.lexeme, std::make_pair(i, (int)s));
+            }
+        }
+        symbol_index_valid = true;
+    }
+
+    // The declaration and symbol that the name at a position refers to.
+    std::optional<std::pair<size_t, const SymbolTable::Symbol*>> resolve(int line, int column) {
+        auto position = tokenAt(line, column);
+        if (!position || tokenRef(position.value()).type != TokenType::IDENTIFIER || declarations.empty()) return std::nullopt;
+
+        size_t index = declarationAt(position.value());
+        if (index >= declarations.size()) return std::nullopt;
+
+        auto& declaration = declarations[index];
+        auto& token = tokenRef(position.value());
+        int relative_line = line - declaration.first.line;
+        auto matches = [&](const Token& name) {
+            return name.line == relative_line && name.column == token.column;
+        };
+
+        for (auto& symbol : declaration.symbols.symbols) {
+            if (matches(symbol.name)) return std::make_pair(index, &symbol);
+        }
+
+        for (auto& use : declaration.symbols.uses) {
+            if (!matches(use.name)) continue;
+            if (use.symbol >= 0) return std::make_pair(index, &declaration.symbols.symbols[use.symbol]);
+
+            buildSymbolIndex();
+            auto after = next(position.value());
+            bool is_call = !atEnd(after) && tokenRef(after).type == TokenType::LEFT_PAREN;
+            auto& names = is_call ? functions : globals;
+
+            auto it = names.find(token.lexeme);
+            if (it == names.end()) return std::nullopt;
+            return std::make_pair(it->second.first, &declarations[it->second.first].symbols.symbols[it->second.second]);
+        }
+
+        return std::nullopt;
+    }
+
+    Span symbolSpan(size_t index, const SymbolTable::Symbol& symbol) const {
+        return Span{ declarations[index].first.line + symbol.name.line, symbol.name.column, (int)symbol.name.lexeme.size() };
+    }
+
+    // "int add(int a, int b)" from a function declaration's tokens.
+    std::string signature(const Declaration& declaration) const {
+        std::string text;
+        std::string previous;
+
+        for (Position position = declaration.first; !atEnd(position); position = next(position)) {
+            auto& lexeme = tokenRef(position).lexeme;
+            bool glued = previous.empty() || previous == "(" || lexeme == "(" || lexeme == ")" || lexeme == ",";
+            if (!glued) text += ' ';
+            text += lexeme;
+            previous = lexeme;
+
+            if (lexeme == ")" || position == declaration.last) break;
+        }
+        return text;
+    }
+};
+
+// Serves diagnostics, go to definition and hover over the language server
+// protocol: JSON-RPC messages framed by Content-Length headers on stdin and
+// stdout. Documents are synchronized incrementally.
+class LanguageServer {
+public:
+    LanguageServer(std::istream& in, std::ostream& out) : in(in), out(out) {}
+
+    // Serves until the client sends exit. Returns the process exit code.
+    int run() {
+        while (auto body = readMessage()) {
+            Json message;
+            try {
+                message = Json::parse(body.value());
+            }
+            catch (const std::exception& e) {
+                sendError(Json(), -32700, e.what());
+                continue;
+            }
+
+            auto& method = message["method"].asString();
+            if (method == "exit") {
+                return shutdown_requested ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+
+            try {
+                handle(message);
+            }
+            catch (const std::exception& e) {
+                if (message.contains("id")) sendError(message["id"], -32603, e.what());
+                else std::cerr << "hydro lsp: " << method << ": " << e.what() << '\n';
+            }
+        }
+
+        // The client went away without saying goodbye.
+        return EXIT_FAILURE;
+    }
+
+private:
+    std::istream& in;
+    std::ostream& out;
+    std::unordered_map<std::string, std::unique_ptr<LspDocument>> documents;
+    bool shutdown_requested = false;
+
+    std::optional<std::string> readMessage() {
+        size_t length = 0;
+        bool has_length = false;
+        std::string header;
+
+        while (std::getline(in, header)) {
+            if (!header.empty() && header.back() == '\r') header.pop_back();
+            if (header.empty()) {
+                if (has_length) break;
+                continue;
+            }
+
+            static const std::string content_length = "Content-Length:";
+            if (header.compare(0, content_length.size(), content_length) == 0) {
+                auto first = header.data() + std::min(header.find_first_not_of(' ', content_length.size()), header.size());
+                auto last = header.data() + header.size();
+                auto result = std::from_chars(first, last, length);
+
+                // A bad header is reported and skipped, the next message may be fine.
+                if (result.ec != std::errc() || result.ptr != last) {
+                    sendError(Json(), -32700, "Invalid Content-Length header: " + header);
+                    continue;
+                }
+                has_length = true;
+            }
+        }
+        if (!has_length) return std::nullopt;
+
+        std::string body(length, '\0');
+        if (!in.read(body.data(), length)) return std::nullopt;
+        return body;
+    }
+
+    void send(const Json& message) {
+        auto body = message.dump();
+        out << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+        out.flush();
+    }
+
+    void sendResult(const Json& id, Json result) {
+        send(Json::object().set("jsonrpc", "2.0").set("id", id).set("result", std::move(result)));
+    }
+
+    void sendError(const Json& id, int code, const std::string& text) {
+        auto error = Json::object().set("code", code).set("message", text);
+        send(Json::object().set("jsonrpc", "2.0").set("id", id).set("error", std::move(error)));
+    }
+
+    void notify(const std::string& method, Json params) {
+        send(Json::object().set("jsonrpc", "2.0").set("method", method).set("params", std::move(params)));
+    }
+
+    static Json toPosition(int line, int column) {
+        return Json::object().set("line", line).set("character", column);
+    }
+
+    static Json toRange(const LspDocument::Span& span) {
+        return Json::object()
+            .set("start", toPosition(span.line, span.column))
+            .set("end", toPosition(span.line, span.column + span.length));
+    }
+
+    LspDocument* document(const Json& params) {
+        auto it = documents.find(params["textDocument"]["uri"].asString());
+        return it != documents.end() ? it->second.get() : nullptr;
+    }
+
+    void publishDiagnostics(const std::string& uri, const LspDocument* document) {
+        auto diagnostics = Json::array();
+        if (document != nullptr) {
+            for (auto& diagnostic : document->diagnostics()) {
+                diagnostics.push(Json::object()
+                    .set("range", toRange(diagnostic.span))
+                    .set("severity", 1)
+                    .set("source", "hydro")
+                    .set("message", diagnostic.message));
+            }
+        }
+
+        notify("textDocument/publishDiagnostics", Json::object().set("uri", uri).set("diagnostics", std::move(diagnostics)));
+    }
+
+    void handle(const Json& message) {
+        auto& method = message["method"].asString();
+        auto& params = message["params"];
+        auto& id = message["id"];
+        bool is_request = message.contains("id");
+
+        if (method == "initialize") {
+            auto sync = Json::object().set("openClose", true).set("change", 2);
+            auto capabilities = Json::object()
+                .set("textDocumentSync", std::move(sync))
+                .set("hoverProvider", true)
+                .set("definitionProvider", true);
+            sendResult(id, Json::object()
+                .set("capabilities", std::move(capabilities))
+                .set("serverInfo", Json::object().set("name", "hydro")));
+            return;
+        }
+
+        if (method == "shutdown") {
+            shutdown_requested = true;
+            sendResult(id, Json());
+            return;
+        }
+
+        if (method == "textDocument/didOpen") {
+            auto& uri = params["textDocument"]["uri"].asString();
+            documents[uri] = std::make_unique<LspDocument>(params["textDocument"]["text"].asString());
+            publishDiagnostics(uri, documents[uri].get());
+            return;
+        }
+
+        if (method == "textDocument/didChange") {
+            auto doc = document(params);
+            if (doc == nullptr) return;
+
+            for (auto& change : params["contentChanges"].items()) {
+                auto& text = change["text"].asString();
+                if (!change.contains("range")) {
+                    doc->setText(text);
+                    continue;
+                }
+
+                auto& start = change["range"]["start"];
+                auto& end = change["range"]["end"];
+                doc->edit(start["line"].asInt(), start["character"].asInt(), end["line"].asInt(), end["character"].asInt(), text);
+            }
+
+            publishDiagnostics(params["textDocument"]["uri"].asString(), doc);
+            return;
+        }
+
+        if (method == "textDocument/didClose") {
+            auto& uri = params["textDocument"]["uri"].asString();
+            documents.erase(uri);
+            publishDiagnostics(uri, nullptr);
+            return;
+        }
+
+        if (method == "textDocument/definition") {
+            auto doc = document(params);
+            auto& position = params["position"];
+            auto span = doc != nullptr ? doc->definition(position["line"].asInt(), position["character"].asInt()) : std::nullopt;
+
+            if (!span) {
+                sendResult(id, Json());
+                return;
+            }
+            sendResult(id, Json::object().set("uri", params["textDocument"]["uri"]).set("range", toRange(span.value())));
+            return;
+        }
+
+        if (method == "textDocument/hover") {
+            auto doc = document(params);
+            auto& position = params["position"];
+            auto hover = doc != nullptr ? doc->hover(position["line"].asInt(), position["character"].asInt()) : std::nullopt;
+
+            if (!hover) {
+                sendResult(id, Json());
+                return;
+            }
+            auto contents = Json::object().set("kind", "markdown").set("value", "```hydro\n" + hover->text + "\n```");
+            sendResult(id, Json::object().set("contents", std::move(contents)).set("range", toRange(hover->span)));
+            return;
+        }
+
+        // Unknown notifications, like initialized or $/cancelRequest, are ignored.
+        if (is_request) {
+            sendError(id, -32601, "Method not found: " + method);
+        }
+    }
+};
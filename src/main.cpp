@@ -1,66 +1,64 @@
-#include "tokenizer.hpp"
-#include "parser.hpp"
-#include "generator.hpp"
-#include "util.hpp"
+#include "driver.hpp"
+#include "server.hpp"
+#include "lsp.hpp"
 
 #include <iostream>
-#include <sstream>
-#include <fstream>
-#include <queue>
+#include <string>
+#include <vector>
 
+#include <unistd.h>
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "Requires a file path in the arguments.\n";
-        return EXIT_FAILURE;
-    }
-
-    try {
-        std::string code = readFile(argv[1]);
 
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
 
-        Tokenizer tokenizer(code);
-        auto tokens = tokenizer.tokenize();
+    // hydro --client [--socket PATH] <arguments>: everything else is for the server.
+    if (!args.empty() && args[0] == "--client") {
+        args.erase(args.begin());
 
-        for (auto token : tokens) {
-            std::clog << token.toString() << std::endl;
+        std::string socket_path = defaultSocketPath();
+        if (args.size() >= 2 && args[0] == "--socket") {
+            socket_path = args[1];
+            args.erase(args.begin(), args.begin() + 2);
         }
 
-
-        Parser parser(tokens);
-        auto tree_root = parser.parseProgram();
-
-        if (tree_root == nullptr) {
+        try {
+            if (auto exit_code = CompileClient::run(socket_path, args)) {
+                return exit_code.value();
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
             return EXIT_FAILURE;
         }
-        std::clog << "Tree generated.\n";
-
-        printTreeLevelOrder(tree_root);
-        std::clog << "\n\n";
-        std::clog << tree_root->toString() << std::endl;
-        printTreePreOrder(tree_root);
-        std::clog << "\n";
+        // No server: compile here.
+    }
 
+    CommandLine command;
+    try {
+        command = CommandLine::parse(args, std::getenv("HYDRO_CACHE_DIR"));
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
 
-        Generator generator(tree_root);
-        std::string asm_code = generator.generateAsm64();
+    if (command.lsp) {
+        std::ios::sync_with_stdio(false);
+        return LanguageServer(std::cin, std::cout).run();
+    }
 
-        if (auto fout = std::ofstream("./out.asm")) {
-            fout << asm_code;
+    if (command.server) {
+        try {
+            auto socket_path = command.socket_path.empty() ? defaultSocketPath() : command.socket_path;
+            return CompileServer(socket_path, command.jobs).run();
         }
-        else {
-            std::cerr << "Unable to open out.asm file.\n";
+        catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return EXIT_FAILURE;
         }
     }
-    catch (std::runtime_error err) {
-        std::cerr << err.what() << std::endl;
-    }
-    catch (std::logic_error err) {
-        std::cerr << err.what() << std::endl;
-    }
-    catch (const std::exception& e) {
-        std::cerr << e.what() << '\n';
-    }
 
-    return 0;
+    Driver driver;
+    return driver.run(command, Driver::Context{ .cwd = {}, .out = std::cout, .err = std::cerr, .log = std::clog, .out_fd = STDOUT_FILENO });
 }
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "parser.hpp"
+#include "thread_pool.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+
+// Parses top-level declarations concurrently.
+//
+// A brace-matching pre-pass splits the token stream at declaration
+// boundaries. Every declaration is then parsed by its own Parser, which
+// only needs the globals declared before it, and the results are linked
+// into one DECL_LIST in source order. On any error the program is parsed
+// again serially, so diagnostics are exactly those of Parser::parseProgram.
+class ParallelParser {
+public:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    ParallelParser(std::vector<Token>& tokens, ThreadPool& pool) : tokens(tokens), pool(pool) {}
+
+    std::unique_ptr<TreeNode> parseProgram() {
+        auto ranges = splitDeclarations(tokens);
+        if (!ranges) {
+            return Parser(tokens).parseProgram();
+        }
+
+        auto visible_globals = visibleGlobals(tokens, ranges.value());
+        std::vector<std::unique_ptr<TreeNode>> declarations(ranges->size());
+
+        try {
+            pool.parallelFor(ranges->size(), [&](size_t i) {
+                auto& range = (*ranges)[i];
+                Parser parser(tokens, range.begin, range.end, visible_globals[i]);
+
+                declarations[i] = parser.parseDeclaration();
+                if (!parser.isFinished()) {
+                    throw std::runtime_error("Declaration does not end at its boundary");
+                }
+            });
+        }
+        catch (const std::exception&) {
+            return Parser(tokens).parseProgram();
+        }
+
+        std::unique_ptr<TreeNode> root = nullptr;
+
+        for (size_t i = ranges->size(); i-- > 0;) {
+            Token token{
+                .type = TokenType::DECL_LIST,
+                .lexeme = "dec",
+                .line = tokens[(*ranges)[i].begin].line,
+            };
+            root = std::make_unique<TreeNode>(token, std::move(declarations[i]), std::move(root));
+        }
+
+        return root;
+    }
+
+    // Token ranges of the top-level declarations, or nothing when the
+    // stream is malformed enough that only the real parser can explain it.
+    static std::optional<std::vector<Range>> splitDeclarations(const std::vector<Token>& tokens) {
+        std::vector<Range> ranges;
+        size_t begin = 0;
+        int depth = 0;
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            switch (tokens[i].type) {
+            case TokenType::EOF_TOKEN:
+                if (depth != 0 || i != begin) return std::nullopt;
+                return ranges;
+
+            case TokenType::LEFT_BRACE:
+                ++depth;
+                break;
+
+            case TokenType::RIGHT_BRACE:
+                if (--depth < 0) return std::nullopt;
+
+                if (depth == 0) {
+                    ranges.push_back(Range{ begin, i + 1 });
+                    begin = i + 1;
+                }
+                break;
+
+            case TokenType::SEMICOLON:
+                if (depth == 0) {
+                    ranges.push_back(Range{ begin, i + 1 });
+                    begin = i + 1;
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Globals declared before each declaration. A global is visible from the
+    // declaration after the one introducing it.
+    static std::vector<GlobalScope> visibleGlobals(const std::vector<Token>& tokens, const std::vector<Range>& ranges) {
+        std::vector<GlobalScope> visible_globals(ranges.size());
+        GlobalScope globals;
+
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            visible_globals[i] = globals;
+
+            if (auto global = declaredGlobal(tokens, ranges[i])) {
+                globals[global->first] = global->second;
+            }
+        }
+
+        return visible_globals;
+    }
+
+    // Name and element count of the global a declaration introduces, judged
+    // by its shape alone, so a global stays visible while its declaration
+    // doesn't parse.
+    static std::optional<std::pair<std::string, long long>> declaredGlobal(const std::vector<Token>& tokens, const Range& range) {
+        bool is_variable = range.end - range.begin >= 2
+            && tokens[range.begin + 1].type == TokenType::IDENTIFIER
+            && tokens[range.end - 1].type == TokenType::SEMICOLON;
+        if (!is_variable) return std::nullopt;
+
+        return std::make_pair(tokens[range.begin + 1].lexeme, arrayLength(tokens, range));
+    }
+
+private:
+    // Element count of a global array declaration, 0 for a scalar. A malformed
+    // size is left for the declaration's own parser to report.
+    static long long arrayLength(const std::vector<Token>& tokens, const Range& range) {
+        bool is_array = range.end - range.begin >= 4
+            && tokens[range.begin + 2].type == TokenType::LEFT_BRACKET
+            && tokens[range.begin + 3].type == TokenType::INT_LIT;
+        if (!is_array) return 0;
+
+        try {
+            return std::max(1LL, std::stoll(tokens[range.begin + 3].lexeme));
+        }
+        catch (const std::out_of_range&) {
+            return 1;
+        }
+    }
+
+    std::vector<Token>& tokens;
+    ThreadPool& pool;
+};
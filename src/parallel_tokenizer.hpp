@@ -0,0 +1,123 @@
+#pragma once
+
+#include "tokenizer.hpp"
+#include "thread_pool.hpp"
+
+#include <vector>
+#include <string>
+#include <exception>
+
+// Lexes large inputs in newline-aligned chunks on the thread pool.
+//
+// Every chunk is lexed speculatively as if it started outside a comment.
+// A sequential fix-up pass then walks the chunks in order: a chunk that
+// really starts inside a block comment is lexed again with the correct
+// state, and line numbers are shifted by the lines of all earlier chunks.
+// The result is identical to Tokenizer::tokenize, errors included.
+class ParallelTokenizer {
+public:
+    // Inputs smaller than this are lexed serially.
+    size_t min_parallel_bytes = 1 << 20;
+    // Chunks per thread, so uneven chunks still keep every thread busy.
+    size_t chunks_per_thread = 4;
+
+    ParallelTokenizer(std::string& content, ThreadPool& pool) : content(content), pool(pool) {}
+
+    std::vector<Token> tokenize() {
+        auto boundaries = splitAtNewlines();
+        if (boundaries.size() <= 2) {
+            return Tokenizer(content).tokenize();
+        }
+
+        size_t chunk_count = boundaries.size() - 1;
+        std::vector<Tokenizer::Chunk> chunks(chunk_count);
+        std::vector<std::exception_ptr> errors(chunk_count);
+
+        pool.parallelFor(chunk_count, [&](size_t i) {
+            try {
+                chunks[i] = Tokenizer(content).tokenizeChunk(boundaries[i], boundaries[i + 1], false);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+
+        size_t total_tokens = 1;
+        for (auto& chunk : chunks) {
+            total_tokens += chunk.tokens.size();
+        }
+
+        std::vector<Token> tokens;
+        tokens.reserve(total_tokens);
+
+        bool in_comment = false;
+        int line = 1;
+
+        for (size_t i = 0; i < chunk_count; ++i) {
+            int shift = line;
+
+            // The speculation was wrong: the previous chunk left a comment open.
+            // Lexed again from its real line, so its errors and tokens need no shift.
+            if (in_comment) {
+                errors[i] = nullptr;
+                chunks[i] = Tokenizer(content).tokenizeChunk(boundaries[i], boundaries[i + 1], true, line);
+                shift = 0;
+            }
+
+            if (errors[i]) {
+                rethrowAtLine(errors[i], line);
+            }
+
+            for (auto& token : chunks[i].tokens) {
+                token.line += shift;
+                tokens.push_back(std::move(token));
+            }
+
+            line += chunks[i].lines;
+            in_comment = chunks[i].ends_in_comment;
+        }
+
+        tokens.push_back(Token{
+            .type = TokenType::EOF_TOKEN,
+            .lexeme = "",
+            .line = line,
+        });
+
+        return tokens;
+    }
+
+private:
+    std::string& content;
+    ThreadPool& pool;
+
+    // Rethrows an error of a chunk lexed from line 0 at the line of the file.
+    [[noreturn]] static void rethrowAtLine(std::exception_ptr error, int first_line) {
+        try {
+            std::rethrow_exception(error);
+        }
+        catch (const LexError& e) {
+            throw LexError(e.problem, e.line + first_line);
+        }
+    }
+
+    // Chunk start offsets, each right after a newline, plus the end of the input.
+    std::vector<size_t> splitAtNewlines() {
+        std::vector<size_t> boundaries{ 0 };
+
+        if (content.size() >= min_parallel_bytes) {
+            size_t chunk_count = (pool.size() + 1) * chunks_per_thread;
+            size_t chunk_size = content.size() / chunk_count + 1;
+
+            for (size_t pos = chunk_size; pos < content.size(); pos += chunk_size) {
+                size_t newline = content.find('\n', std::max(pos, boundaries.back()));
+                if (newline == std::string::npos || newline + 1 >= content.size()) break;
+
+                boundaries.push_back(newline + 1);
+                pos = newline + 1;
+            }
+        }
+
+        boundaries.push_back(content.size());
+        return boundaries;
+    }
+};
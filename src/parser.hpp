@@ -4,37 +4,73 @@
 
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <stack>
 #include <memory>
 #include <optional>
 #include <stdexcept>
+#include <sstream>
+#include <ostream>
+#include <climits>
 
 class TreeNode {
 public:
     Token token;
     std::unique_ptr<TreeNode> left, right;
 
-    virtual std::string toString() {
-        std::string str = "";
-
-        if (left != nullptr) {
-            str += left->toString() + " ";
+    // Writes the subtree as an s-expression, "(label left right)". A leaf is
+    // just its label, and a missing left child before a right one is "_".
+    virtual void printSExpr(std::ostream& out) const {
+        if (left == nullptr && right == nullptr) {
+            printLabel(out);
+            return;
         }
 
-        str += token.lexeme;
+        out << '(';
+        printLabel(out);
+        printChild(out, left.get());
+        if (right != nullptr) printChild(out, right.get());
+        out << ')';
+    }
 
-        if (right != nullptr) {
-            str += " " + right->toString();
-        }
+    virtual void printLabel(std::ostream& out) const {
+        out << token.lexeme;
+    }
+
+    std::string toString() const {
+        std::stringstream ss;
+        printSExpr(ss);
+        return ss.str();
+    }
 
-        return str;
+    virtual std::unique_ptr<TreeNode> clone() const {
+        return std::make_unique<TreeNode>(token, cloneChild(left), cloneChild(right));
     }
 
     TreeNode(Token token) : token(token), left(nullptr), right(nullptr) {}
     TreeNode(Token token, std::unique_ptr<TreeNode> left, std::unique_ptr<TreeNode> right)
         : token(token), left(std::move(left)), right(std::move(right)) {}
+    virtual ~TreeNode() = default;
+
+protected:
+    static void printChild(std::ostream& out, const TreeNode* child) {
+        out << ' ';
+        if (child == nullptr) out << '_';
+        else child->printSExpr(out);
+    }
+
+    static std::unique_ptr<TreeNode> cloneChild(const std::unique_ptr<TreeNode>& child) {
+        return child == nullptr ? nullptr : child->clone();
+    }
 };
 
+// A variable declaration: the type keyword with the variable left and the
+// initializer, if any, right.
+inline bool isDeclaration(const TreeNode* node) {
+    auto type = node->token.type;
+    return type == TokenType::INT || type == TokenType::FLOAT || type == TokenType::STRING;
+}
+
 class FuncNode : public TreeNode {
 public:
     int max_local_var_count = 0;
@@ -42,20 +78,14 @@ public:
     FuncNode(Token token, std::unique_ptr<TreeNode> left = nullptr, std::unique_ptr<TreeNode> right = nullptr)
         : TreeNode(token, std::move(left), std::move(right)) {}
 
-    virtual std::string toString() override {
-        std::string str = "";
-
-        if (left != nullptr) {
-            str += left->toString() + " ";
-        }
-
-        str += token.lexeme + "_" + std::to_string(max_local_var_count);
-
-        if (right != nullptr) {
-            str += " " + right->toString();
-        }
+    virtual void printLabel(std::ostream& out) const override {
+        out << token.lexeme << '_' << max_local_var_count;
+    }
 
-        return str;
+    virtual std::unique_ptr<TreeNode> clone() const override {
+        auto node = std::make_unique<FuncNode>(token, cloneChild(left), cloneChild(right));
+        node->max_local_var_count = max_local_var_count;
+        return node;
     }
 };
 
@@ -69,26 +99,124 @@ public:
         std::unique_ptr<TreeNode> condition = nullptr
     ) : TreeNode(token, std::move(left), std::move(right)), condition(std::move(condition)) {}
 
-    virtual std::string toString() override {
-        std::string str = "";
+    // "(if condition then else)".
+    virtual void printSExpr(std::ostream& out) const override {
+        out << '(';
+        printLabel(out);
+        printChild(out, condition.get());
+        if (left != nullptr || right != nullptr) printChild(out, left.get());
+        if (right != nullptr) printChild(out, right.get());
+        out << ')';
+    }
 
-        if (left != nullptr) {
-            str += left->toString() + " ";
-        }
+    virtual std::unique_ptr<TreeNode> clone() const override {
+        return std::make_unique<IfNode>(token, cloneChild(left), cloneChild(right), cloneChild(condition));
+    }
+};
 
-        str += token.lexeme + "(" + condition->toString() + ")";
+// An array of 64-bit ints. Local arrays (ARRAY) have the frame offset of
+// their first element as lexeme, element i lives at [rbp - offset + 8 * i];
+// global arrays (GLOBAL_ARRAY) have their name.
+class ArrayNode : public TreeNode {
+public:
+    long long length;
+
+    ArrayNode(Token token, long long length) : TreeNode(token), length(length) {}
+
+    virtual void printLabel(std::ostream& out) const override {
+        out << token.lexeme << '[' << length << ']';
+    }
+
+    virtual std::unique_ptr<TreeNode> clone() const override {
+        return std::make_unique<ArrayNode>(token, length);
+    }
+};
+
+// Globals in scope mapped to their element count, 0 for scalars.
+using GlobalScope = std::unordered_map<std::string, long long>;
+
+// Where names are declared and used, recorded by a Parser for editor tooling.
+// Tokens keep the source spelling of the name.
+struct SymbolTable {
+    enum class Kind { Function, Parameter, Local, Global };
+
+    struct Symbol {
+        Kind kind;
+        std::string type;       // the type keyword
+        Token name;
+        long long length = 0;   // element count of arrays
+    };
+
+    struct Use {
+        Token name;
+        int symbol;             // index into symbols, -1 for globals and functions
+    };
+
+    std::vector<Symbol> symbols;
+    std::vector<Use> uses;
+
+    int declare(Kind kind, const Token& type, const Token& name, long long length = 0) {
+        symbols.push_back(Symbol{ kind, type.lexeme, name, length });
+        return symbols.size() - 1;
+    }
+};
+
+// One arm of a switch: its case values, none for the default arm. The body
+// is left, the next arm right, so passes that walk left and right see
+// every arm.
+class CaseNode : public TreeNode {
+public:
+    std::vector<long long> values;
+
+    CaseNode(Token token, std::vector<long long> values, std::unique_ptr<TreeNode> left = nullptr, std::unique_ptr<TreeNode> right = nullptr)
+        : TreeNode(token, std::move(left), std::move(right)), values(std::move(values)) {}
+
+    virtual void printLabel(std::ostream& out) const override {
+        out << token.lexeme;
+        for (auto value : values) out << '_' << value;
+    }
+
+    virtual std::unique_ptr<TreeNode> clone() const override {
+        return std::make_unique<CaseNode>(token, values, cloneChild(left), cloneChild(right));
+    }
 
-        if (right != nullptr) {
-            str += " " + right->toString();
+    // The arm a switch over value runs: the matching case, else the default
+    // arm. Null when neither exists.
+    static CaseNode* select(TreeNode* arms, long long value) {
+        CaseNode* default_arm = nullptr;
+
+        for (TreeNode* arm = arms; arm != nullptr; arm = arm->right.get()) {
+            auto case_node = dynamic_cast<CaseNode*>(arm);
+            if (case_node->values.empty()) default_arm = case_node;
+
+            for (auto case_value : case_node->values) {
+                if (case_value == value) return case_node;
+            }
         }
 
-        return str;
+        return default_arm;
     }
 };
 
 class Parser {
 public:
-    Parser(std::vector<Token>& tokens) : tokens(tokens), curr(0) {}
+    // Declarations and uses are recorded here when set.
+    SymbolTable* symbols = nullptr;
+
+    Parser(std::vector<Token>& tokens) : tokens(tokens), curr(0), end(tokens.size()) {}
+
+    // Parses only tokens[begin, end), with the given globals already declared.
+    Parser(std::vector<Token>& tokens, size_t begin, size_t end, const GlobalScope& globals)
+        : tokens(tokens), global_var_names(globals), curr(begin), end(end) {}
+
+    bool isFinished() {
+        return isAtEnd();
+    }
+
+    // Index of the next token, the one an error was found at.
+    size_t position() const {
+        return curr;
+    }
 
     std::unique_ptr<TreeNode> parseProgram() {
         auto root = parseDeclarationList();
@@ -129,7 +257,8 @@ public:
 
         // Function declaration
         if (match(TokenType::LEFT_PAREN)) {
-            local_var_names.push_back(std::unordered_map<std::string, int>());
+            local_var_names.push_back(Scope());
+            declare(SymbolTable::Kind::Function, keyword, identifier);
 
             Token fn_token{
                 .type = TokenType::FUNCTION_DECL,
@@ -158,21 +287,40 @@ public:
             return fn_node;
         }
 
-        if (match(TokenType::SEMICOLON)) {
-            advance();
+        if (match(TokenType::LEFT_BRACKET)) {
+            if (global_var_names.count(identifier.lexeme)) {
+                throw std::runtime_error("Variable '" + identifier.lexeme + "' is already decleared. line:" + std::to_string(identifier.line));
+            }
 
-            return std::make_unique<TreeNode>(keyword, std::move(left), nullptr);
+            auto length = parseArrayLength(identifier);
+            declare(SymbolTable::Kind::Global, keyword, identifier, length);
+            identifier.type = TokenType::GLOBAL_ARRAY;
+            global_var_names[identifier.lexeme] = length;
+
+            return std::make_unique<TreeNode>(keyword, std::make_unique<ArrayNode>(identifier, length), nullptr);
         }
 
-        if (match(TokenType::EQUAL)) {
-            advance(); // consume '='
-            auto value = parseExpression();
+        if (match(TokenType::SEMICOLON) || match(TokenType::EQUAL)) {
+            if (global_var_names.count(identifier.lexeme)) {
+                throw std::runtime_error("Variable '" + identifier.lexeme + "' is already decleared. line:" + std::to_string(identifier.line));
+            }
+
+            std::unique_ptr<TreeNode> value = nullptr;
+
+            if (match(TokenType::EQUAL)) {
+                advance(); // consume '='
+                value = parseExpression();
+            }
 
             if (!match(TokenType::SEMICOLON)) {
                 throw std::runtime_error("Expected ';' after variable declaration");
             }
             advance(); // consume ';'
 
+            // Registered after the initializer, so a global can't refer to itself.
+            declare(SymbolTable::Kind::Global, keyword, identifier);
+            global_var_names[identifier.lexeme] = 0;
+
             return std::make_unique<TreeNode>(keyword, std::move(left), std::move(value));
         }
 
@@ -185,10 +333,9 @@ public:
         }
         auto token = consume(); // consume '{'
 
-        local_var_names.push_back(std::unordered_map<std::string, int>());
+        local_var_names.push_back(Scope());
         auto statements = parseStatementList();
-        local_vars_count -= local_var_names.back().size();
-        local_var_names.pop_back();
+        popScope();
 
         if (!match(TokenType::RIGHT_BRACE)) {
             throw std::runtime_error("Missing '}' for '{' at line: " + std::to_string(token.line));
@@ -274,6 +421,36 @@ public:
             return std::make_unique<TreeNode>(while_token, std::move(condition), std::move(while_body));
         }
 
+        if (match(TokenType::SWITCH)) {
+            auto switch_token = consume();
+
+            if (!match(TokenType::LEFT_PAREN)) {
+                throw std::runtime_error("Expected '(' after switch. at line:" + std::to_string(switch_token.line));
+            }
+            advance(); // consume '('
+
+            auto value = parseExpression();
+
+            if (!match(TokenType::RIGHT_PAREN)) {
+                throw std::runtime_error("Expected ')' after expression. at line:" + std::to_string(switch_token.line));
+            }
+            advance(); // consume ')'
+
+            if (!match(TokenType::LEFT_BRACE)) {
+                throw std::runtime_error("Expected '{' after switch. at line:" + std::to_string(switch_token.line));
+            }
+            advance(); // consume '{'
+
+            auto arms = parseSwitchArms();
+
+            if (!match(TokenType::RIGHT_BRACE)) {
+                throw std::runtime_error("Missing '}' for switch at line:" + std::to_string(switch_token.line));
+            }
+            advance(); // consume '}'
+
+            return std::make_unique<TreeNode>(switch_token, std::move(value), std::move(arms));
+        }
+
         if (isTypeKeyword()) {
             auto keyword = consume();
 
@@ -283,6 +460,27 @@ public:
 
             auto identifier = consume();
 
+            if (match(TokenType::LEFT_BRACKET)) {
+                auto var_name = identifier.lexeme;
+                if (local_var_names.back().count(var_name)) {
+                    throw std::runtime_error("Variable '" + var_name + "' is already decleared. line:" + std::to_string(identifier.line));
+                }
+
+                auto length = parseArrayLength(identifier);
+                if (length > max_local_array_length) {
+                    throw std::runtime_error("Array '" + var_name + "' is too large for the stack, declare it globally. line:" + std::to_string(identifier.line));
+                }
+
+                // Element 0 takes the deepest slot, so the elements ascend in memory.
+                local_vars_count += length;
+                local_var_names.back()[var_name] = LocalVar{ local_vars_count, length, declare(SymbolTable::Kind::Local, keyword, identifier, length) };
+                max_local_vars_count = std::max(max_local_vars_count, local_vars_count);
+
+                identifier.type = TokenType::ARRAY;
+                identifier.lexeme = std::to_string(local_vars_count * 8);
+                return std::make_unique<TreeNode>(keyword, std::make_unique<ArrayNode>(identifier, length), nullptr);
+            }
+
             std::unique_ptr<TreeNode> init = nullptr;
 
             if (match(TokenType::EQUAL)) {
@@ -301,7 +499,7 @@ public:
             }
 
             ++local_vars_count;
-            local_var_names.back()[var_name] = local_vars_count;
+            local_var_names.back()[var_name] = LocalVar{ local_vars_count, 0, declare(SymbolTable::Kind::Local, keyword, identifier) };
             identifier.lexeme = std::to_string(local_vars_count * 8);
             max_local_vars_count = std::max(max_local_vars_count, local_vars_count);
 
@@ -326,6 +524,91 @@ public:
         return expr;
     }
 
+    // Arms of a switch: "case 1, 2:" or "default:" followed by statements up
+    // to the next arm. Control never falls from one arm into the next.
+    std::unique_ptr<TreeNode> parseSwitchArms() {
+        std::vector<std::unique_ptr<CaseNode>> arms;
+        std::unordered_set<long long> seen_values;
+        bool has_default = false;
+
+        while (!match(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+            if (!match(TokenType::CASE) && !match(TokenType::DEFAULT)) {
+                throw std::runtime_error("Expected 'case' or 'default' in switch at line:" + std::to_string(peek().line));
+            }
+
+            auto arm_token = consume();
+            std::vector<long long> values;
+
+            if (arm_token.type == TokenType::DEFAULT) {
+                if (has_default) {
+                    throw std::runtime_error("Multiple default labels in switch at line:" + std::to_string(arm_token.line));
+                }
+                has_default = true;
+            } else {
+                while (true) {
+                    auto value = parseCaseValue();
+                    if (!seen_values.insert(value).second) {
+                        throw std::runtime_error("Duplicate case value " + std::to_string(value) + " at line:" + std::to_string(arm_token.line));
+                    }
+                    values.push_back(value);
+
+                    if (!match(TokenType::COMMA)) break;
+                    advance(); // consume ','
+                }
+            }
+
+            if (!match(TokenType::COLON)) {
+                throw std::runtime_error("Expected ':' after case label at line:" + std::to_string(arm_token.line));
+            }
+            advance(); // consume ':'
+
+            local_var_names.push_back(Scope());
+            auto body = parseArmStatements();
+            popScope();
+
+            arms.push_back(std::make_unique<CaseNode>(arm_token, std::move(values), std::move(body)));
+        }
+
+        std::unique_ptr<TreeNode> list = nullptr;
+        for (auto it = arms.rbegin(); it != arms.rend(); ++it) {
+            (*it)->right = std::move(list);
+            list = std::move(*it);
+        }
+        return list;
+    }
+
+    // An integer literal, optionally negated.
+    long long parseCaseValue() {
+        bool negative = match(TokenType::MINUS);
+        if (negative) advance();
+
+        if (!match(TokenType::INT_LIT)) {
+            throw std::runtime_error("Case value must be an integer literal at line:" + std::to_string(peek().line));
+        }
+        auto literal = consume();
+
+        // Two's complement wrap, like the generated negation.
+        unsigned long long value = std::stoull(literal.lexeme);
+        return static_cast<long long>(negative ? 0 - value : value);
+    }
+
+    std::unique_ptr<TreeNode> parseArmStatements() {
+        if (match(TokenType::CASE) || match(TokenType::DEFAULT) || match(TokenType::RIGHT_BRACE) || isAtEnd()) {
+            return nullptr;
+        }
+
+        auto line = peek().line;
+        auto left = parseStatement();
+        auto right = parseArmStatements();
+
+        Token token{
+            .type = ::STATEMENT_LIST,
+            .lexeme = "stmt",
+            .line = line
+        };
+        return std::make_unique<TreeNode>(token, std::move(left), std::move(right));
+    }
+
     std::unique_ptr<TreeNode> parseParams() {
         if (match(TokenType::RIGHT_PAREN)) {
             return nullptr;
@@ -353,7 +636,7 @@ public:
             throw std::runtime_error("Expected parameter name at Line:" + std::to_string(type.line));
         }
         auto name = consume();
-        local_var_names.back()[name.lexeme] = -pos;
+        local_var_names.back()[name.lexeme] = LocalVar{ -pos, 0, declare(SymbolTable::Kind::Parameter, type, name) };
 
         return std::make_unique<TreeNode>(type, std::make_unique<TreeNode>(name), nullptr);
     }
@@ -444,6 +727,25 @@ public:
             return std::make_unique<TreeNode>(op, nullptr, std::move(operand));
         }
 
+        // "(int) x" and "(float) x", the type checker turns them into conversions.
+        if (match(TokenType::LEFT_PAREN) && (matchNext(TokenType::INT) || matchNext(TokenType::FLOAT))) {
+            advance(); // consume '('
+            auto type = consume();
+
+            if (!match(TokenType::RIGHT_PAREN)) {
+                throw std::runtime_error("Expected ')' after type in cast at line:" + std::to_string(type.line));
+            }
+            advance(); // consume ')'
+
+            Token cast_token{
+                .type = TokenType::CAST,
+                .lexeme = type.lexeme,
+                .line = type.line,
+                .column = type.column,
+            };
+            return std::make_unique<TreeNode>(cast_token, nullptr, parseUnary());
+        }
+
         return parsePrimary();
     }
 
@@ -459,6 +761,7 @@ public:
 
             // check if it's a function call
             if (match(TokenType::LEFT_PAREN)) {
+                use(token, -1);
                 advance();
 
                 Token call_token{
@@ -491,16 +794,52 @@ public:
                 return std::make_unique<TreeNode>(call_token, std::move(left), nullptr);
             }
 
-            if (auto val = tryGetVarId(token.lexeme)) {
-                token.lexeme = val.value();
+            auto name = token.lexeme;
+            long long length = 0;
+
+            if (auto var = tryGetVar(token.lexeme)) {
+                use(token, var->symbol);
+                token.lexeme = std::to_string(var->slot * 8);
+                length = var->length;
+                token.type = length ? TokenType::ARRAY : TokenType::IDENTIFIER;
+            } else if (auto global = global_var_names.find(token.lexeme); global != global_var_names.end()) {
+                use(token, -1);
+                length = global->second;
+                token.type = length ? TokenType::GLOBAL_ARRAY : TokenType::GLOBAL_VAR;
+            } else {
+                throw std::runtime_error("Variable '" + token.lexeme + "' not decleared in this scope. Line:" + std::to_string(token.line));
+            }
+
+            if (length == 0) {
+                if (match(TokenType::LEFT_BRACKET)) {
+                    throw std::runtime_error("'" + name + "' is not an array. Line:" + std::to_string(token.line));
+                }
                 return std::make_unique<TreeNode>(token);
             }
 
-            throw std::runtime_error("Variable '" + token.lexeme + "' not decleared in this scope. Line:" + std::to_string(token.line));
+            if (!match(TokenType::LEFT_BRACKET)) {
+                throw std::runtime_error("Array '" + name + "' can only be used with an index. Line:" + std::to_string(token.line));
+            }
+            auto bracket = consume();
+            auto index = parseExpression();
+
+            if (!match(TokenType::RIGHT_BRACKET)) {
+                throw std::runtime_error("Missing ']' for '[' at line:" + std::to_string(bracket.line));
+            }
+            advance(); // consume ']'
+
+            Token index_token{
+                .type = TokenType::INDEX,
+                .lexeme = "[]",
+                .line = bracket.line,
+            };
+            return std::make_unique<TreeNode>(index_token, std::make_unique<ArrayNode>(token, length), std::move(index));
+
         }
 
         switch (token.type) {
         case TokenType::INT_LIT:
+        case TokenType::FLOAT_LIT:
             advance();
             return std::make_unique<TreeNode>(token);
 
@@ -521,14 +860,28 @@ public:
     }
 
 private:
+    // A local's frame slot, negative for parameters, and the element count
+    // of arrays (0 for scalars). An array takes one slot per element.
+    struct LocalVar {
+        int slot;
+        long long length = 0;
+        int symbol = -1;    // index in symbols, when recording
+    };
+    using Scope = std::unordered_map<std::string, LocalVar>;
+
+    // Keeps a frame within 1 MiB of the default 8 MiB stack.
+    static constexpr long long max_local_array_length = 131072;
+
     std::vector<Token>& tokens;
-    std::vector<std::unordered_map<std::string, int>> local_var_names;
+    std::vector<Scope> local_var_names;
+    GlobalScope global_var_names;
     int max_local_vars_count = 0;
     int local_vars_count = 0;
     size_t curr;
+    size_t end;
 
     inline bool isAtEnd() {
-        return curr >= tokens.size() || tokens[curr].type == TokenType::EOF_TOKEN;
+        return curr >= end || tokens[curr].type == TokenType::EOF_TOKEN;
     }
 
     inline Token peek() {
@@ -556,7 +909,7 @@ private:
     }
 
     inline bool matchNext(TokenType token_type) {
-        if (curr + 1 >= tokens.size()) return false;
+        if (curr + 1 >= end) return false;
         return tokens[curr + 1].type == token_type;
     }
 
@@ -565,10 +918,60 @@ private:
         return match(TokenType::STRING) || match(TokenType::INT) || match(TokenType::FLOAT);
     }
 
-    std::optional<std::string> tryGetVarId(std::string var_name) {
+    // "[N];" after an array name, N a positive integer literal.
+    long long parseArrayLength(const Token& identifier) {
+        advance(); // consume '['
+
+        if (!match(TokenType::INT_LIT)) {
+            throw std::runtime_error("Array size must be an integer literal. line:" + std::to_string(identifier.line));
+        }
+        auto literal = consume();
+
+        long long length = 0;
+        try {
+            length = std::stoll(literal.lexeme);
+        }
+        catch (const std::out_of_range&) {
+        }
+        if (length <= 0 || length > INT_MAX / 8) {
+            throw std::runtime_error("Invalid size for array '" + identifier.lexeme + "'. line:" + std::to_string(identifier.line));
+        }
+
+        if (!match(TokenType::RIGHT_BRACKET)) {
+            throw std::runtime_error("Missing ']' after array size. line:" + std::to_string(identifier.line));
+        }
+        advance(); // consume ']'
+
+        if (!match(TokenType::SEMICOLON)) {
+            throw std::runtime_error("Expected ';' after array declaration, arrays can't be initialized. line:" + std::to_string(identifier.line));
+        }
+        advance(); // consume ';'
+
+        return length;
+    }
+
+    int declare(SymbolTable::Kind kind, const Token& type, const Token& name, long long length = 0) {
+        return symbols != nullptr ? symbols->declare(kind, type, name, length) : -1;
+    }
+
+    void use(const Token& name, int symbol) {
+        if (symbols != nullptr) {
+            symbols->uses.push_back(SymbolTable::Use{ name, symbol });
+        }
+    }
+
+    // Leaves a block, releasing the frame slots of its locals.
+    void popScope() {
+        for (auto& [name, var] : local_var_names.back()) {
+            local_vars_count -= var.length ? var.length : 1;
+        }
+        local_var_names.pop_back();
+    }
+
+    std::optional<LocalVar> tryGetVar(const std::string& var_name) {
         for (int i = local_var_names.size() - 1; i >= 0; --i) {
-            if (local_var_names[i].count(var_name)) {
-                return std::to_string(local_var_names[i][var_name] * 8);
+            if (auto it = local_var_names[i].find(var_name); it != local_var_names[i].end()) {
+                return it->second;
             }
         }
 
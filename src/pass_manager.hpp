@@ -0,0 +1,235 @@
+#pragma once
+
+#include "parser.hpp"
+#include "const_fold.hpp"
+#include "ctfe.hpp"
+#include "ipcp.hpp"
+#include "dce.hpp"
+#include "cse.hpp"
+#include "tree_verifier.hpp"
+#include "stats.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+// Runs an optimization pipeline: a list of pass names, in order, over the
+// tree between type checking and code generation. A pass may appear more
+// than once. "vectorize" and "layout" name generator features; listing
+// them turns them on, wherever they are in the list.
+//
+// Global initializers are evaluated before the pipeline whatever it holds,
+// since the generator needs them as literals.
+//
+// With a bisect limit only the first `bisect_limit` passes of the pipeline
+// run and the others are skipped, so searching for the smallest limit that
+// shows a miscompile or a slowdown finds the pass to blame.
+class PassManager {
+public:
+    static constexpr std::string_view pass_names[] = { "fold", "ctfe", "ipcp", "dce", "cse", "vectorize", "layout" };
+
+    struct PassTime {
+        std::string name;
+        double wall_ms = 0;
+        uint64_t nodes_before = 0;
+        uint64_t nodes_after = 0;
+    };
+
+    // Check the tree after every pass. On in builds without NDEBUG.
+#ifdef NDEBUG
+    bool verify = false;
+#else
+    bool verify = true;
+#endif
+    // Favor size: constant propagation makes no clones.
+    bool optimize_size = false;
+    // Pass runs allowed; negative runs the whole pipeline.
+    int bisect_limit = -1;
+    // Measure every pass, see times().
+    bool time_passes = false;
+    // Profile builds don't vectorize, which CSE has to know.
+    bool profile = false;
+
+    explicit PassManager(std::vector<std::string> pipeline) : pipeline(std::move(pipeline)) {}
+
+    // Pipelines of -O0, -O1, -O2 and -Os, by the letter after -O.
+    static std::vector<std::string> preset(const std::string& level) {
+        if (level == "0") return {};
+        if (level == "1") return { "fold", "dce", "layout" };
+        if (level == "2") return { "ctfe", "ipcp", "dce", "cse", "vectorize", "layout" };
+        if (level == "s") return { "ctfe", "ipcp", "dce", "cse", "layout" };
+        throw std::runtime_error("Unknown optimization level: -O" + level);
+    }
+
+    // A comma separated list of pass names. Throws on unknown names.
+    static std::vector<std::string> parse(const std::string& list) {
+        std::vector<std::string> pipeline;
+        std::stringstream ss(list);
+        std::string name;
+
+        while (std::getline(ss, name, ',')) {
+            if (name.empty()) continue;
+
+            if (std::find(std::begin(pass_names), std::end(pass_names), name) == std::end(pass_names)) {
+                throw std::runtime_error("Unknown pass: " + name + " (expected fold, ctfe, ipcp, dce, cse, vectorize or layout)");
+            }
+            pipeline.push_back(name);
+        }
+        return pipeline;
+    }
+
+    static std::string join(const std::vector<std::string>& pipeline) {
+        std::string list;
+        for (auto& name : pipeline) {
+            if (!list.empty()) list += ',';
+            list += name;
+        }
+        return list;
+    }
+
+    // Whether a pass runs at least once within the bisect limit.
+    bool runs(std::string_view name) const {
+        for (size_t i = 0; i < pipeline.size(); ++i) {
+            if (pipeline[i] == name && withinLimit(i)) return true;
+        }
+        return false;
+    }
+
+    // The pipeline with the passes past the bisect limit dropped.
+    std::vector<std::string> effectivePipeline() const {
+        std::vector<std::string> effective;
+        for (size_t i = 0; i < pipeline.size(); ++i) {
+            if (withinLimit(i)) effective.push_back(pipeline[i]);
+        }
+        return effective;
+    }
+
+    // Runs the tree passes. Pass reports, and bisect decisions, go to log.
+    void run(std::unique_ptr<TreeNode>& root, std::ostream& log) {
+        if (root == nullptr) return;
+
+        CompileTimeEvaluator globals(root);
+        globals.fold_function_bodies = false;
+        globals.run();
+        verifyAfter(root, "global evaluation");
+
+        for (size_t i = 0; i < pipeline.size(); ++i) {
+            auto& name = pipeline[i];
+
+            if (bisect_limit >= 0) {
+                log << "BISECT: " << (withinLimit(i) ? "running" : "NOT running") << " pass (" << i + 1 << ") " << name << "\n";
+            }
+            if (!withinLimit(i) || name == "vectorize" || name == "layout") continue;
+
+            PassTime time{ .name = name };
+            if (time_passes) time.nodes_before = CompileStats::countNodes(root.get());
+            auto start = std::chrono::steady_clock::now();
+
+            runPass(name, root, log);
+
+            if (time_passes) {
+                time.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                time.nodes_after = CompileStats::countNodes(root.get());
+                pass_times.push_back(time);
+            }
+            verifyAfter(root, name);
+        }
+    }
+
+    const std::vector<PassTime>& times() const { return pass_times; }
+
+    void printTimes(std::ostream& out) const {
+        auto flags = out.flags();
+        out << std::fixed << std::setprecision(3);
+
+        out << "Pass execution timing report:\n";
+        out << std::left << std::setw(12) << "pass" << std::right << std::setw(12) << "wall ms"
+            << std::setw(9) << "%" << std::setw(14) << "nodes before" << std::setw(14) << "nodes after" << "\n";
+
+        double total = 0;
+        for (auto& time : pass_times) total += time.wall_ms;
+
+        for (auto& time : pass_times) {
+            out << std::left << std::setw(12) << time.name << std::right << std::setw(12) << time.wall_ms
+                << std::setw(9) << std::setprecision(1) << (total > 0 ? 100 * time.wall_ms / total : 0) << std::setprecision(3)
+                << std::setw(14) << time.nodes_before << std::setw(14) << time.nodes_after << "\n";
+        }
+        out << std::left << std::setw(12) << "total" << std::right << std::setw(12) << total << "\n";
+
+        out.flags(flags);
+    }
+
+private:
+    std::vector<std::string> pipeline;
+    std::vector<PassTime> pass_times;
+
+    bool withinLimit(size_t index) const {
+        return bisect_limit < 0 || index < size_t(bisect_limit);
+    }
+
+    void verifyAfter(const std::unique_ptr<TreeNode>& root, const std::string& pass) const {
+        if (!verify) return;
+
+        try {
+            TreeVerifier::verify(root.get());
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error("Invalid tree after " + pass + ": " + e.what());
+        }
+    }
+
+    void runPass(const std::string& name, std::unique_ptr<TreeNode>& root, std::ostream& log) {
+        if (name == "fold") {
+            for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+                if (decl->left != nullptr && decl->left->token.type == TokenType::FUNCTION_DECL) {
+                    ConstantFolder::fold(decl->left->right);
+                }
+            }
+        }
+        else if (name == "ctfe") {
+            CompileTimeEvaluator ctfe(root);
+            ctfe.run();
+            log << "Evaluated at compile time: " << ctfe.evaluatedCalls() << " calls.\n";
+        }
+        else if (name == "ipcp") {
+            InterproceduralConstPropagator ipcp(root);
+            if (optimize_size) ipcp.max_growth_percent = 0;
+            ipcp.run();
+
+            for (auto& propagated : ipcp.propagated()) {
+                log << "Propagated constant " << propagated.value << " into parameter "
+                    << propagated.param_index + 1 << " of " << propagated.function << ".\n";
+            }
+
+            for (auto& clone : ipcp.clones()) {
+                log << "Specialized " << clone.function << "(";
+                for (size_t i = 0; i < clone.pattern.size(); ++i) {
+                    if (i > 0) log << ", ";
+                    if (clone.pattern[i]) log << clone.pattern[i].value();
+                    else log << "_";
+                }
+                log << ") as " << clone.clone_name << ": " << clone.call_sites << " call sites, "
+                    << clone.nodes << " nodes.\n";
+            }
+        }
+        else if (name == "dce") {
+            DeadCodeEliminator dce(root);
+            dce.run();
+            log << "Dead code removed: " << dce.removedFunctions() << " functions, "
+                << dce.removedStatements() << " statements, " << dce.removedStores() << " stores.\n";
+        }
+        else if (name == "cse") {
+            CommonSubexpressionEliminator cse(root);
+            cse.keep_vector_loops = runs("vectorize") && !profile;
+            cse.run();
+            log << "Common subexpressions eliminated: " << cse.eliminated() << ", using "
+                << cse.temporaries() << " temporaries.\n";
+        }
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "client.hpp"
+#include "driver.hpp"
+#include "thread_pool.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Keeps a Driver warm and compiles requests of hydro --client, each on its
+// own thread. Only processes of the server's user may connect.
+class CompileServer {
+public:
+    CompileServer(std::string socket_path, unsigned jobs) : socket_path(std::move(socket_path)) {
+        // -j 0 uses every core, like a single compilation.
+        if (jobs == 0) {
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        pool = std::make_unique<ThreadPool>(std::max(1u, jobs - 1));
+        driver = std::make_unique<Driver>(pool.get());
+    }
+
+    // Serves until SIGINT or SIGTERM. Returns only if the socket can't be set up.
+    int run() {
+        auto address = socketAddress(socket_path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "Unable to create socket: " << std::strerror(errno) << '\n';
+            return EXIT_FAILURE;
+        }
+
+        // A socket file nobody answers on is left over from a killed server.
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            std::cerr << "A server is already listening on " << socket_path << '\n';
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        unlink(socket_path.c_str());
+
+        auto old_mask = umask(0077);
+        bool bound = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        umask(old_mask);
+
+        if (!bound || listen(fd, 128) != 0) {
+            std::cerr << "Unable to listen on " << socket_path << ": " << std::strerror(errno) << '\n';
+            close(fd);
+            return EXIT_FAILURE;
+        }
+
+        removeSocketOnExit(socket_path);
+        std::clog << "hydro server listening on " << socket_path << " with " << pool->size() + 1 << " threads.\n";
+
+        while (true) {
+            int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                std::cerr << "accept: " << std::strerror(errno) << '\n';
+                continue;
+            }
+
+            std::thread([this, client] { serve(client); }).detach();
+        }
+    }
+
+private:
+    std::string socket_path;
+    std::unique_ptr<ThreadPool> pool;
+    std::unique_ptr<Driver> driver;
+
+    static inline char socket_to_remove[sizeof(sockaddr_un::sun_path)];
+
+    static void removeSocketOnExit(const std::string& path) {
+        std::memcpy(socket_to_remove, path.c_str(), path.size() + 1);
+
+        auto handler = [](int) {
+            unlink(socket_to_remove);
+            _exit(EXIT_SUCCESS);
+        };
+        std::signal(SIGINT, handler);
+        std::signal(SIGTERM, handler);
+    }
+
+    static bool sameUser(int fd) {
+        ucred credentials{};
+        socklen_t size = sizeof(credentials);
+        return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 && credentials.uid == getuid();
+    }
+
+    void serve(int fd) {
+        SocketStream stream(fd);
+        if (!sameUser(fd)) return;
+
+        auto header = stream.read();
+        if (header != compile_protocol::request_header) return;
+
+        auto cwd = stream.read();
+        auto env_cache_dir = stream.read();
+        auto arg_count = stream.readNumber();
+        if (!cwd || !env_cache_dir || !arg_count || arg_count.value() < 0) return;
+
+        std::vector<std::string> args;
+        for (long long i = 0; i < arg_count.value(); ++i) {
+            auto arg = stream.read();
+            if (!arg) return;
+            args.push_back(std::move(arg.value()));
+        }
+
+        auto file_count = stream.readNumber();
+        if (!file_count || file_count.value() < 0) return;
+
+        std::unordered_map<std::string, std::string> files;
+        for (long long i = 0; i < file_count.value(); ++i) {
+            auto path = stream.read();
+            auto content = stream.read();
+            if (!path || !content) return;
+            files[std::move(path.value())] = std::move(content.value());
+        }
+
+        std::stringstream out, err;
+        int exit_code = EXIT_FAILURE;
+
+        try {
+            auto command = CommandLine::parse(args, env_cache_dir->empty() ? nullptr : env_cache_dir->c_str());
+            if (command.lsp || command.server) {
+                throw std::runtime_error("--lsp and --server can't be run through the server");
+            }
+
+            Driver::Context context{
+                .cwd = std::filesystem::path(cwd.value()),
+                .out = out,
+                .err = err,
+                .log = err,
+                .files = &files,
+            };
+            exit_code = driver->run(command, context);
+        }
+        catch (const std::exception& e) {
+            err << e.what() << '\n';
+        }
+
+        stream.write(compile_protocol::response_header);
+        stream.write(std::to_string(exit_code));
+        stream.write(out.str());
+        stream.write(err.str());
+        stream.flush();
+    }
+};
+
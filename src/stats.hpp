@@ -0,0 +1,201 @@
+#pragma once
+
+#include "alloc_stats.hpp"
+#include "parser.hpp"
+#include "asm_buffer.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include <sys/resource.h>
+
+// Per-phase wall time, CPU time, allocations and peak RSS of one compilation,
+// plus the sizes of what the phases produced.
+//
+// CPU time, allocations and RSS are process-wide, so the numbers are only
+// meaningful when one file is compiled at a time.
+class CompileStats {
+public:
+    struct Phase {
+        std::string name;
+        double wall_ms = 0;
+        double cpu_ms = 0;
+        uint64_t allocations = 0;
+        uint64_t allocated_bytes = 0;
+        long peak_rss_kb = 0;
+    };
+
+    // Measures a phase from construction to destruction. A null stats does nothing.
+    class Scope {
+    public:
+        Scope(CompileStats* stats, std::string_view name) : stats(stats) {
+            if (stats == nullptr) return;
+
+            phase.name = name;
+            start_wall = std::chrono::steady_clock::now();
+            start_cpu = cpuMillis();
+            start_allocations = AllocationCounters::count.load(std::memory_order_relaxed);
+            start_bytes = AllocationCounters::bytes.load(std::memory_order_relaxed);
+        }
+
+        ~Scope() {
+            if (stats == nullptr) return;
+
+            phase.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_wall).count();
+            phase.cpu_ms = cpuMillis() - start_cpu;
+            phase.allocations = AllocationCounters::count.load(std::memory_order_relaxed) - start_allocations;
+            phase.allocated_bytes = AllocationCounters::bytes.load(std::memory_order_relaxed) - start_bytes;
+            phase.peak_rss_kb = peakRssKb();
+            stats->phases.push_back(std::move(phase));
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        CompileStats* stats;
+        Phase phase;
+        std::chrono::steady_clock::time_point start_wall;
+        double start_cpu = 0;
+        uint64_t start_allocations = 0;
+        uint64_t start_bytes = 0;
+    };
+
+    std::vector<Phase> phases;
+    uint64_t source_bytes = 0;
+    uint64_t tokens = 0;
+    uint64_t ast_nodes = 0;
+    uint64_t functions = 0;
+    uint64_t instructions = 0;
+    uint64_t output_bytes = 0;
+
+    static double cpuMillis() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        auto millis = [](const timeval& tv) { return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0; };
+        return millis(usage.ru_utime) + millis(usage.ru_stime);
+    }
+
+    static long peakRssKb() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    static uint64_t countNodes(const TreeNode* node) {
+        if (node == nullptr) return 0;
+
+        uint64_t count = 1 + countNodes(node->left.get()) + countNodes(node->right.get());
+        if (auto if_node = dynamic_cast<const IfNode*>(node)) {
+            count += countNodes(if_node->condition.get());
+        }
+        return count;
+    }
+
+    // Instruction lines of nasm source: not labels, comments, directives or data.
+    static uint64_t countInstructions(const AsmBuffer& asm_code) {
+        uint64_t count = 0;
+        asm_code.forEachLine([&](std::string_view line) {
+            if (isInstruction(line)) ++count;
+        });
+        return count;
+    }
+
+    static bool isInstruction(std::string_view line) {
+        if (auto comment = line.find(';'); comment != std::string_view::npos) {
+            line = line.substr(0, comment);
+        }
+
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string_view::npos) return false;
+        line = line.substr(first);
+        line = line.substr(0, line.find_last_not_of(" \t\r") + 1);
+
+        if (line.back() == ':') return false;
+
+        auto word = line.substr(0, line.find_first_of(" \t"));
+        if (word == "section" || word == "global" || word == "extern" || word == "align" || word == "alignb" || word == "default" || word == "%line") return false;
+
+        auto isData = [](std::string_view directive) {
+            return directive == "equ" || directive == "db" || directive == "dw" || directive == "dd" || directive == "dq"
+                || directive == "resb" || directive == "resw" || directive == "resd" || directive == "resq" || directive == "times";
+        };
+        if (isData(word)) return false;
+
+        auto rest = line.substr(word.size());
+        size_t directive = rest.find_first_not_of(" \t:");
+        if (directive != std::string_view::npos) {
+            auto next = rest.substr(directive, rest.find_first_of(" \t", directive) - directive);
+            if (isData(next)) return false;
+        }
+
+        return true;
+    }
+
+    void printText(std::ostream& out) const {
+        auto flags = out.flags();
+        out << std::fixed << std::setprecision(2);
+
+        out << std::left << std::setw(12) << "phase" << std::right
+            << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms"
+            << std::setw(12) << "allocs" << std::setw(14) << "alloc KiB"
+            << std::setw(14) << "peak RSS KiB" << "\n";
+
+        Phase total;
+        for (auto& phase : phases) {
+            out << std::left << std::setw(12) << phase.name << std::right
+                << std::setw(12) << phase.wall_ms << std::setw(12) << phase.cpu_ms
+                << std::setw(12) << phase.allocations << std::setw(14) << phase.allocated_bytes / 1024.0
+                << std::setw(14) << phase.peak_rss_kb << "\n";
+
+            total.wall_ms += phase.wall_ms;
+            total.cpu_ms += phase.cpu_ms;
+            total.allocations += phase.allocations;
+            total.allocated_bytes += phase.allocated_bytes;
+        }
+
+        out << std::left << std::setw(12) << "total" << std::right
+            << std::setw(12) << total.wall_ms << std::setw(12) << total.cpu_ms
+            << std::setw(12) << total.allocations << std::setw(14) << total.allocated_bytes / 1024.0
+            << std::setw(14) << peakRssKb() << "\n\n";
+
+        out << "source bytes: " << source_bytes << "\n"
+            << "tokens:       " << tokens << "\n"
+            << "AST nodes:    " << ast_nodes << "\n"
+            << "functions:    " << functions << "\n"
+            << "instructions: " << instructions << "\n"
+            << "output bytes: " << output_bytes << "\n";
+
+        out.flags(flags);
+    }
+
+    void printJson(std::ostream& out) const {
+        auto flags = out.flags();
+        out << std::fixed << std::setprecision(3);
+
+        out << "{\n  \"phases\": [\n";
+        for (size_t i = 0; i < phases.size(); ++i) {
+            auto& phase = phases[i];
+            out << "    {\"name\": \"" << phase.name << "\", \"wall_ms\": " << phase.wall_ms
+                << ", \"cpu_ms\": " << phase.cpu_ms << ", \"allocations\": " << phase.allocations
+                << ", \"allocated_bytes\": " << phase.allocated_bytes << ", \"peak_rss_kb\": " << phase.peak_rss_kb
+                << "}" << (i + 1 < phases.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n"
+            << "  \"peak_rss_kb\": " << peakRssKb() << ",\n"
+            << "  \"source_bytes\": " << source_bytes << ",\n"
+            << "  \"tokens\": " << tokens << ",\n"
+            << "  \"ast_nodes\": " << ast_nodes << ",\n"
+            << "  \"functions\": " << functions << ",\n"
+            << "  \"instructions\": " << instructions << ",\n"
+            << "  \"output_bytes\": " << output_bytes << "\n"
+            << "}\n";
+
+        out.flags(flags);
+    }
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned thread_count = std::thread::hardware_concurrency()) {
+        if (thread_count == 0) thread_count = 1;
+
+        for (unsigned i = 0; i < thread_count; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return workers.size(); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Runs body(0) .. body(count - 1) on the pool and the calling thread.
+    //
+    // The caller takes part in the work and never waits for a helper that
+    // hasn't started, so nested calls from inside pool tasks can't deadlock.
+    // If any call throws, the exception of the lowest index is rethrown once
+    // every index has finished.
+    template <typename Body>
+    void parallelFor(size_t count, Body&& body) {
+        if (count == 0) return;
+
+        struct State {
+            std::atomic<size_t> next{ 0 };
+            size_t done = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::vector<std::exception_ptr> errors;
+        };
+
+        auto state = std::make_shared<State>();
+        state->errors.resize(count);
+        auto body_ptr = &body;
+
+        auto work = [state, body_ptr, count] {
+            size_t completed = 0;
+
+            for (size_t i = state->next++; i < count; i = state->next++) {
+                try {
+                    (*body_ptr)(i);
+                }
+                catch (...) {
+                    state->errors[i] = std::current_exception();
+                }
+                ++completed;
+            }
+
+            if (completed == 0) return;
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->done += completed;
+            if (state->done == count) {
+                state->finished.notify_all();
+            }
+        };
+
+        size_t helpers = std::min<size_t>(size(), count - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            submit(work);
+        }
+
+        work();
+
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->finished.wait(lock, [&] { return state->done == count; });
+        }
+
+        for (auto& error : state->errors) {
+            if (error) std::rethrow_exception(error);
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+                if (stopping && tasks.empty()) return;
+
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+
+            task();
+        }
+    }
+};
@@ -2,11 +2,12 @@
 
 #include <string>
 #include <sstream>
+#include <ostream>
 
 enum TokenType {
     // Single-character tokens
-    LEFT_PAREN, RIGHT_PAREN, LEFT_BRACE, RIGHT_BRACE,
-    COMMA, SEMICOLON, AND, OR,
+    LEFT_PAREN, RIGHT_PAREN, LEFT_BRACE, RIGHT_BRACE, LEFT_BRACKET, RIGHT_BRACKET,
+    COMMA, SEMICOLON, COLON, AND, OR,
 
     // unary Oprators
     BANG,
@@ -24,65 +25,119 @@ enum TokenType {
     AND_AND_EQUAL, OR_OR_EQUAL,
 
     // Keywords
-    INT, FLOAT, STRING, RETURN, IF, ELSE, WHILE, FOR,
+    INT, FLOAT, STRING, RETURN, IF, ELSE, WHILE, FOR, SWITCH, CASE, DEFAULT,
 
     // Literals
-    PARAM, IDENTIFIER, INT_LIT,
+    PARAM, IDENTIFIER, GLOBAL_VAR, INT_LIT, FLOAT_LIT, ARRAY, GLOBAL_ARRAY,
 
     // misc
-    FUNCTION_DECL, FUNCTION_CALL, STATEMENT_LIST, DECL_LIST, ARG_LIST,
+    FUNCTION_DECL, FUNCTION_CALL, STATEMENT_LIST, DECL_LIST, ARG_LIST, INDEX, CAST,
+
+    // Float operations and conversions, made explicit by the type checker
+    FLOAT_PLUS, FLOAT_MINUS, FLOAT_STAR, FLOAT_SLASH,
+    FLOAT_LESS, FLOAT_LESS_EQUAL, FLOAT_GREATER, FLOAT_GREATER_EQUAL, FLOAT_EQUAL_EQUAL,
+    INT_TO_FLOAT, FLOAT_TO_INT,
 
     EOF_TOKEN,
 };
 
+inline bool isFloatArithmetic(TokenType type) {
+    return type == FLOAT_PLUS || type == FLOAT_MINUS || type == FLOAT_STAR || type == FLOAT_SLASH;
+}
+
+inline bool isFloatComparison(TokenType type) {
+    return type == FLOAT_LESS || type == FLOAT_LESS_EQUAL || type == FLOAT_GREATER
+        || type == FLOAT_GREATER_EQUAL || type == FLOAT_EQUAL_EQUAL;
+}
+
 struct Token {
     TokenType type;
     std::string lexeme;
     int line;
+    int column = 0;     // byte offset in the line, from 0
 
-    std::string toString() const {
-        std::stringstream ss;
-        ss << "Line " << line << ": ";
+    // Writes "Line <n>: <TYPE> '<lexeme>'" without building a string.
+    void print(std::ostream& out) const {
+        out << "Line " << line << ": ";
         
         switch(type) {
-            case TokenType::LEFT_PAREN: ss << "LEFT_PAREN"; break;
-            case TokenType::RIGHT_PAREN: ss << "RIGHT_PAREN"; break;
-            case TokenType::LEFT_BRACE: ss << "LEFT_BRACE"; break;
-            case TokenType::RIGHT_BRACE: ss << "RIGHT_BRACE"; break;
-            case TokenType::COMMA: ss << "COMMA"; break;
-            case TokenType::SEMICOLON: ss << "SEMICOLON"; break;
-            case TokenType::PLUS: ss << "PLUS"; break;
-            case TokenType::MINUS: ss << "MINUS"; break;
-            case TokenType::STAR: ss << "STAR"; break;
-            case TokenType::SLASH: ss << "SLASH"; break;
-            case TokenType::AND: ss << "AND"; break;
-            case TokenType::OR: ss << "OR"; break;
-            case TokenType::EQUAL: ss << "EQUAL"; break;
-            case TokenType::EQUAL_EQUAL: ss << "EQUAL_EQUAL"; break;
-            case TokenType::BANG: ss << "BANG"; break;
-            case TokenType::BANG_EQUAL: ss << "BANG_EQUAL"; break;
-            case TokenType::LESS: ss << "LESS"; break;
-            case TokenType::LESS_EQUAL: ss << "LESS_EQUAL"; break;
-            case TokenType::GREATER: ss << "GREATER"; break;
-            case TokenType::GREATER_EQUAL: ss << "GREATER_EQUAL"; break;
-            case TokenType::AND_AND: ss << "AND_AND"; break;
-            case TokenType::OR_OR: ss << "OR_OR"; break;
-            case TokenType::INT: ss << "INT"; break;
-            case TokenType::FLOAT: ss << "FLOAT"; break;
-            case TokenType::STRING: ss << "STRING"; break;
-            case TokenType::RETURN: ss << "RETURN"; break;
-            case TokenType::IF: ss << "IF"; break;
-            case TokenType::ELSE: ss << "ELSE"; break;
-            case TokenType::WHILE: ss << "WHILE"; break;
-            case TokenType::FOR: ss << "FOR"; break;
-            case TokenType::IDENTIFIER: ss << "IDENTIFIER"; break;
-            case TokenType::INT_LIT: ss << "INT_LIT"; break;
-            case TokenType::EOF_TOKEN: ss << "EOF"; break;
-            case TokenType::DECL_LIST: ss << "DECL_LIST"; break;
-            case TokenType::PERCENTAGE: ss << "PERCENTAGE"; break;
+            case TokenType::LEFT_PAREN: out << "LEFT_PAREN"; break;
+            case TokenType::RIGHT_PAREN: out << "RIGHT_PAREN"; break;
+            case TokenType::LEFT_BRACE: out << "LEFT_BRACE"; break;
+            case TokenType::RIGHT_BRACE: out << "RIGHT_BRACE"; break;
+            case TokenType::LEFT_BRACKET: out << "LEFT_BRACKET"; break;
+            case TokenType::RIGHT_BRACKET: out << "RIGHT_BRACKET"; break;
+            case TokenType::COMMA: out << "COMMA"; break;
+            case TokenType::SEMICOLON: out << "SEMICOLON"; break;
+            case TokenType::COLON: out << "COLON"; break;
+            case TokenType::PLUS: out << "PLUS"; break;
+            case TokenType::MINUS: out << "MINUS"; break;
+            case TokenType::STAR: out << "STAR"; break;
+            case TokenType::SLASH: out << "SLASH"; break;
+            case TokenType::AND: out << "AND"; break;
+            case TokenType::OR: out << "OR"; break;
+            case TokenType::EQUAL: out << "EQUAL"; break;
+            case TokenType::EQUAL_EQUAL: out << "EQUAL_EQUAL"; break;
+            case TokenType::BANG: out << "BANG"; break;
+            case TokenType::BANG_EQUAL: out << "BANG_EQUAL"; break;
+            case TokenType::LESS: out << "LESS"; break;
+            case TokenType::LESS_EQUAL: out << "LESS_EQUAL"; break;
+            case TokenType::GREATER: out << "GREATER"; break;
+            case TokenType::GREATER_EQUAL: out << "GREATER_EQUAL"; break;
+            case TokenType::AND_AND: out << "AND_AND"; break;
+            case TokenType::OR_OR: out << "OR_OR"; break;
+            case TokenType::INT: out << "INT"; break;
+            case TokenType::FLOAT: out << "FLOAT"; break;
+            case TokenType::STRING: out << "STRING"; break;
+            case TokenType::RETURN: out << "RETURN"; break;
+            case TokenType::IF: out << "IF"; break;
+            case TokenType::ELSE: out << "ELSE"; break;
+            case TokenType::WHILE: out << "WHILE"; break;
+            case TokenType::FOR: out << "FOR"; break;
+            case TokenType::SWITCH: out << "SWITCH"; break;
+            case TokenType::CASE: out << "CASE"; break;
+            case TokenType::DEFAULT: out << "DEFAULT"; break;
+            case TokenType::IDENTIFIER: out << "IDENTIFIER"; break;
+            case TokenType::GLOBAL_VAR: out << "GLOBAL_VAR"; break;
+            case TokenType::INT_LIT: out << "INT_LIT"; break;
+            case TokenType::FLOAT_LIT: out << "FLOAT_LIT"; break;
+            case TokenType::ARRAY: out << "ARRAY"; break;
+            case TokenType::GLOBAL_ARRAY: out << "GLOBAL_ARRAY"; break;
+            case TokenType::INDEX: out << "INDEX"; break;
+            case TokenType::PLUS_EQUAL: out << "PLUS_EQUAL"; break;
+            case TokenType::MINUS_EQUAL: out << "MINUS_EQUAL"; break;
+            case TokenType::STAR_EQUAL: out << "STAR_EQUAL"; break;
+            case TokenType::SLASH_EQUAL: out << "SLASH_EQUAL"; break;
+            case TokenType::AND_AND_EQUAL: out << "AND_AND_EQUAL"; break;
+            case TokenType::OR_OR_EQUAL: out << "OR_OR_EQUAL"; break;
+            case TokenType::PARAM: out << "PARAM"; break;
+            case TokenType::FUNCTION_DECL: out << "FUNCTION_DECL"; break;
+            case TokenType::FUNCTION_CALL: out << "FUNCTION_CALL"; break;
+            case TokenType::STATEMENT_LIST: out << "STATEMENT_LIST"; break;
+            case TokenType::ARG_LIST: out << "ARG_LIST"; break;
+            case TokenType::CAST: out << "CAST"; break;
+            case TokenType::FLOAT_PLUS: out << "FLOAT_PLUS"; break;
+            case TokenType::FLOAT_MINUS: out << "FLOAT_MINUS"; break;
+            case TokenType::FLOAT_STAR: out << "FLOAT_STAR"; break;
+            case TokenType::FLOAT_SLASH: out << "FLOAT_SLASH"; break;
+            case TokenType::FLOAT_LESS: out << "FLOAT_LESS"; break;
+            case TokenType::FLOAT_LESS_EQUAL: out << "FLOAT_LESS_EQUAL"; break;
+            case TokenType::FLOAT_GREATER: out << "FLOAT_GREATER"; break;
+            case TokenType::FLOAT_GREATER_EQUAL: out << "FLOAT_GREATER_EQUAL"; break;
+            case TokenType::FLOAT_EQUAL_EQUAL: out << "FLOAT_EQUAL_EQUAL"; break;
+            case TokenType::INT_TO_FLOAT: out << "INT_TO_FLOAT"; break;
+            case TokenType::FLOAT_TO_INT: out << "FLOAT_TO_INT"; break;
+            case TokenType::EOF_TOKEN: out << "EOF"; break;
+            case TokenType::DECL_LIST: out << "DECL_LIST"; break;
+            case TokenType::PERCENTAGE: out << "PERCENTAGE"; break;
         }
         
-        ss << " '" << lexeme << "'";
+        out << " '" << lexeme << "'";
+    }
+
+    std::string toString() const {
+        std::stringstream ss;
+        print(ss);
         return ss.str();
     }
 };
@@ -4,25 +4,92 @@
 
 #include <vector>
 #include <unordered_map>
+#include <stdexcept>
+
+// An error at a line of the input, kept apart so chunks lexed on their own
+// can move it to the line of the whole file.
+class LexError : public std::runtime_error {
+public:
+    std::string problem;
+    int line;
+
+    LexError(const std::string& problem, int line)
+        : std::runtime_error(problem + " at line:" + std::to_string(line)), problem(problem), line(line) {}
+};
 
 class Tokenizer {
 public:
-    Tokenizer(std::string& content) : content(content) {
-        keywords = {
-            { "int",    TokenType::INT },
-            { "float",  TokenType::FLOAT },
-            { "string",   TokenType::STRING },
-            { "return", TokenType::RETURN },
-            { "if",     TokenType::IF },
-            { "else",   TokenType::ELSE },
-            { "while",  TokenType::WHILE },
-            { "for",    TokenType::FOR },
-        };
-    }
+    Tokenizer(std::string& content) : content(content), end(content.size()) {}
+
+    // Result of lexing a newline-aligned slice of the input on its own.
+    struct Chunk {
+        std::vector<Token> tokens;
+        int lines = 0;                  // line numbers are relative to the chunk start
+        bool ends_in_comment = false;   // a block comment is still open at the end
+    };
 
     std::vector<Token> tokenize() {
         tokens = std::vector<Token>();
+        scan();
+
+        tokens.push_back(Token{
+            .type = TokenType::EOF_TOKEN,
+            .lexeme = "",
+            .line = line,
+        });
 
+        return tokens;
+    }
+
+    // Lexes content[begin, end) starting at first_line. The slice has to start
+    // right after a newline, which no token other than a comment can span.
+    Chunk tokenizeChunk(size_t begin, size_t end, bool starts_in_comment, int first_line = 0) {
+        tokens = std::vector<Token>();
+        curr = begin;
+        this->end = end;
+        line = first_line;
+        line_start = begin;
+
+        Chunk chunk;
+        chunk.ends_in_comment = starts_in_comment && !skipBlockComment();
+        if (!chunk.ends_in_comment) {
+            chunk.ends_in_comment = scan();
+        }
+
+        chunk.tokens = std::move(tokens);
+        chunk.lines = line - first_line;
+        return chunk;
+    }
+
+    // Offset just past the last character read, the offending one after an error.
+    size_t position() const {
+        return curr;
+    }
+
+private:
+    static inline const std::unordered_map<std::string, TokenType> keywords = {
+        { "int",    TokenType::INT },
+        { "float",  TokenType::FLOAT },
+        { "string",   TokenType::STRING },
+        { "return", TokenType::RETURN },
+        { "if",     TokenType::IF },
+        { "else",   TokenType::ELSE },
+        { "while",  TokenType::WHILE },
+        { "for",    TokenType::FOR },
+        { "switch", TokenType::SWITCH },
+        { "case",   TokenType::CASE },
+        { "default", TokenType::DEFAULT },
+    };
+    std::vector<Token> tokens;
+    std::string& content;
+    size_t start = 0;
+    size_t curr = 0;
+    size_t end;
+    int line = 1;
+    size_t line_start = 0;
+
+    // Lexes up to the end of the input. Returns true if it stopped inside a block comment.
+    bool scan() {
         while (!isAtEnd()) {
             start = curr;
             char c = consume();
@@ -33,8 +100,11 @@ public:
             case ')': addToken(TokenType::RIGHT_PAREN); break;
             case '{': addToken(TokenType::LEFT_BRACE); break;
             case '}': addToken(TokenType::RIGHT_BRACE); break;
+            case '[': addToken(TokenType::LEFT_BRACKET); break;
+            case ']': addToken(TokenType::RIGHT_BRACKET); break;
             case ',': addToken(TokenType::COMMA); break;
             case ';': addToken(TokenType::SEMICOLON); break;
+            case ':': addToken(TokenType::COLON); break;
             case '*': addToken(TokenType::STAR); break;
             case '%': addToken(TokenType::PERCENTAGE); break;
             
@@ -45,11 +115,9 @@ public:
                         advance();
                     }
                     ++line;
+                    line_start = curr;
                 } else if (match('*')) {
-                    while (!isAtEnd() && !(match('*') && match('/'))) {
-                        char ch = consume();
-                        if (ch == '\n') ++line;
-                    }
+                    if (!skipBlockComment()) return true;
                 } else {
                     addToken(TokenType::SLASH);
                 }
@@ -82,6 +150,7 @@ public:
                 // Whitespace
             case '\n':
                 line++;
+                line_start = curr;
             case ' ':
             case '\r':
             case '\t':
@@ -101,22 +170,22 @@ public:
             }
         }
 
-        tokens.push_back(Token{
-            .type = TokenType::EOF_TOKEN,
-            .lexeme = "",
-            .line = line,
-        });
-
-        return tokens;
+        return false;
     }
 
-private:
-    std::unordered_map<std::string, TokenType> keywords;
-    std::vector<Token> tokens;
-    std::string& content;
-    size_t start = 0;
-    size_t curr = 0;
-    int line = 1;
+    // Skips to the end of a block comment. Returns false if the input ends first.
+    bool skipBlockComment() {
+        while (!isAtEnd()) {
+            if (match('*') && match('/')) return true;
+
+            char ch = consume();
+            if (ch == '\n') {
+                ++line;
+                line_start = curr;
+            }
+        }
+        return false;
+    }
 
     inline void readIdentifier() {
         while (isAlphanumeric(peek())) {
@@ -135,15 +204,39 @@ private:
             .type = token_type,
             .lexeme = lexeme,
             .line = line,
+            .column = static_cast<int>(start - line_start),
         });
     }
 
+    // An integer, or a float with a fraction and an optional exponent: 1.5, 2.0e-3.
     inline void readNumber() {
         while (std::isdigit(peek())) {
             advance();
         }
 
-        addToken(TokenType::INT_LIT);
+        if (peek() != '.' || !std::isdigit(peekNext())) {
+            addToken(TokenType::INT_LIT);
+            return;
+        }
+
+        advance(); // consume '.'
+        while (std::isdigit(peek())) {
+            advance();
+        }
+
+        if (peek() == 'e' || peek() == 'E') {
+            advance();
+            if (peek() == '+' || peek() == '-') advance();
+
+            if (!std::isdigit(peek())) {
+                throw LexError("Expected digits in the exponent of a float", line);
+            }
+            while (std::isdigit(peek())) {
+                advance();
+            }
+        }
+
+        addToken(TokenType::FLOAT_LIT);
     }
 
     inline char peek() {
@@ -161,7 +254,7 @@ private:
     }
 
     inline char peekNext() {
-        if (curr + 1 >= content.size()) return '\0';
+        if (curr + 1 >= end) return '\0';
         return content[curr + 1];
     }
 
@@ -176,7 +269,7 @@ private:
     }
 
     inline bool isAtEnd() {
-        return curr >= content.size();
+        return curr >= end;
     }
 
     inline bool isAlphanumeric(char c) {
@@ -188,6 +281,7 @@ private:
             .type = token_type,
             .lexeme = content.substr(start, curr - start),
             .line = this->line,
+            .column = static_cast<int>(start - line_start),
         });
     }
 };
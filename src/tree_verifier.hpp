@@ -0,0 +1,309 @@
+#pragma once
+
+#include "parser.hpp"
+#include "runtime_lib.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <charconv>
+#include <cstdlib>
+#include <stdexcept>
+
+// Checks the invariants the generator relies on, so a pass that breaks the
+// tree is caught right after it runs instead of as wrong code later.
+//
+// Global initializers must be literals, locals must lie in their function's
+// frame, calls must match a function's parameter count or name a runtime
+// routine, and every operator must have the operands it needs. Casts and
+// other nodes the type checker replaces must be gone.
+class TreeVerifier {
+public:
+    // Throws std::runtime_error naming the first broken invariant.
+    static void verify(const TreeNode* root) {
+        TreeVerifier verifier;
+        verifier.collectDeclarations(root);
+
+        for (const TreeNode* decl = root; decl != nullptr; decl = decl->right.get()) {
+            if (decl->left != nullptr && decl->left->token.type == TokenType::FUNCTION_DECL) {
+                verifier.verifyFunction(decl->left.get());
+            }
+        }
+    }
+
+private:
+    std::unordered_map<std::string, size_t> param_counts;
+    std::unordered_set<std::string> global_vars;
+    std::unordered_set<std::string> global_arrays;
+    // Frame of the function being checked.
+    int local_slots = 0;
+    size_t param_count = 0;
+    // Where a missing operand is reported.
+    const TreeNode* statement = nullptr;
+
+    [[noreturn]] void fail(const std::string& problem, const TreeNode* node) const {
+        if (node == nullptr) node = statement;
+        throw std::runtime_error(problem + " at line:" + std::to_string(node != nullptr ? node->token.line : 0));
+    }
+
+    static size_t countParams(const TreeNode* params) {
+        if (params == nullptr) return 0;
+        if (params->token.type == TokenType::COMMA) return countParams(params->left.get()) + 1;
+        return 1;
+    }
+
+    void collectDeclarations(const TreeNode* root) {
+        for (const TreeNode* decl = root; decl != nullptr; decl = decl->right.get()) {
+            if (decl->token.type != TokenType::DECL_LIST || decl->left == nullptr) {
+                fail("Expected a declaration list entry, found '" + decl->token.lexeme + "'", decl);
+            }
+
+            auto item = decl->left.get();
+            if (item->token.type == TokenType::FUNCTION_DECL) {
+                auto fn_node = dynamic_cast<const FuncNode*>(item);
+                if (fn_node == nullptr || fn_node->left == nullptr) fail("Malformed function", item);
+
+                auto name = fn_node->token.lexeme.substr(1);
+                if (!param_counts.emplace(name, countParams(fn_node->left->right.get())).second) {
+                    fail("Function '" + name + "' is defined twice", item);
+                }
+                continue;
+            }
+
+            if (!isDeclaration(item) || item->left == nullptr) fail("Expected a global declaration", item);
+
+            auto& name = item->left->token.lexeme;
+            if (item->left->token.type == TokenType::GLOBAL_ARRAY) {
+                global_arrays.insert(name);
+                continue;
+            }
+
+            // A global's declaration keeps the name token of the parser.
+            if (item->left->token.type != TokenType::IDENTIFIER) fail("Global '" + name + "' isn't a variable", item);
+            global_vars.insert(name);
+
+            if (item->right != nullptr && item->right->token.type != TokenType::INT_LIT && item->right->token.type != TokenType::FLOAT_LIT) {
+                fail("Initializer of global '" + name + "' isn't a literal", item);
+            }
+        }
+    }
+
+    void verifyFunction(const TreeNode* fn_node) {
+        local_slots = dynamic_cast<const FuncNode*>(fn_node)->max_local_var_count;
+        param_count = countParams(fn_node->left->right.get());
+        verifyBlock(fn_node->right.get());
+    }
+
+    void verifyBlock(const TreeNode* block) {
+        for (const TreeNode* tmp = block; tmp != nullptr; tmp = tmp->right.get()) {
+            if (tmp->token.type != TokenType::STATEMENT_LIST) {
+                fail("Expected a statement list, found '" + tmp->token.lexeme + "'", tmp);
+            }
+            verifyStatement(tmp->left.get());
+        }
+    }
+
+    void verifyStatement(const TreeNode* node) {
+        if (node == nullptr) return;
+        statement = node;
+
+        switch (node->token.type) {
+        case TokenType::STATEMENT_LIST:
+            verifyBlock(node);
+            return;
+
+        case TokenType::RETURN:
+            if (node->right != nullptr) verifyExpr(node->right.get());
+            return;
+
+        case TokenType::IF: {
+            auto if_node = dynamic_cast<const IfNode*>(node);
+            if (if_node == nullptr || if_node->condition == nullptr) fail("If without a condition", node);
+            verifyExpr(if_node->condition.get());
+            verifyBlock(if_node->left.get());
+            verifyBlock(if_node->right.get());
+            return;
+        }
+
+        case TokenType::WHILE:
+            verifyExpr(node->left.get());
+            verifyBlock(node->right.get());
+            return;
+
+        case TokenType::SWITCH: {
+            verifyExpr(node->left.get());
+
+            bool has_default = false;
+            for (const TreeNode* arm = node->right.get(); arm != nullptr; arm = arm->right.get()) {
+                auto case_node = dynamic_cast<const CaseNode*>(arm);
+                if (case_node == nullptr) fail("Switch arm isn't a case", arm);
+                if (case_node->values.empty()) {
+                    if (has_default) fail("Switch with two defaults", arm);
+                    has_default = true;
+                }
+                verifyBlock(case_node->left.get());
+            }
+            return;
+        }
+
+        default:
+            if (isDeclaration(node)) {
+                if (node->left == nullptr) fail("Declaration without a variable", node);
+
+                if (node->left->token.type == TokenType::ARRAY) {
+                    verifyArray(node->left.get());
+                } else {
+                    verifyLocal(node->left.get());
+                    if (node->right != nullptr) verifyExpr(node->right.get());
+                }
+                return;
+            }
+
+            verifyExpr(node);
+            return;
+        }
+    }
+
+    // Locals are at [rbp - offset] inside the frame, parameters above the return address.
+    void verifyLocal(const TreeNode* node) {
+        if (node->token.type != TokenType::IDENTIFIER) fail("Expected a local variable", node);
+
+        int offset = 0;
+        auto& lexeme = node->token.lexeme;
+        auto result = std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), offset);
+        if (result.ec != std::errc() || result.ptr != lexeme.data() + lexeme.size() || offset % 8 != 0) {
+            fail("Bad frame offset '" + lexeme + "'", node);
+        }
+
+        bool is_local = offset >= 8 && offset <= 8 * local_slots;
+        bool is_param = offset <= -16 && size_t(-offset / 8 - 2) < param_count;
+        if (!is_local && !is_param) fail("Frame offset " + lexeme + " is outside the frame", node);
+    }
+
+    void verifyArray(const TreeNode* node) {
+        auto array = dynamic_cast<const ArrayNode*>(node);
+        if (array == nullptr || array->length <= 0) fail("Malformed array", node);
+
+        if (array->token.type == TokenType::GLOBAL_ARRAY) {
+            if (!global_arrays.count(array->token.lexeme)) fail("Unknown global array '" + array->token.lexeme + "'", node);
+            return;
+        }
+
+        // The first element takes the deepest slot, the others are above it.
+        int offset = std::atoi(array->token.lexeme.c_str());
+        if (offset < 8 * array->length || offset > 8 * local_slots) fail("Array is outside the frame", node);
+    }
+
+    static bool isRuntimeRoutine(const std::string& name) {
+        for (auto& routine : runtime_routines) {
+            if (routine.name == name) return true;
+        }
+        return false;
+    }
+
+    static bool isBinary(TokenType type) {
+        switch (type) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+        case TokenType::PERCENTAGE:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::AND:
+        case TokenType::OR:
+        case TokenType::AND_AND:
+        case TokenType::OR_OR:
+            return true;
+        default:
+            return isFloatArithmetic(type) || isFloatComparison(type);
+        }
+    }
+
+    void verifyExpr(const TreeNode* node) {
+        if (node == nullptr) fail("Missing expression", nullptr);
+
+        auto type = node->token.type;
+        auto& lexeme = node->token.lexeme;
+
+        switch (type) {
+        case TokenType::INT_LIT: {
+            long long value = 0;
+            auto result = std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+            if (result.ec != std::errc() || result.ptr != lexeme.data() + lexeme.size()) fail("Bad int literal '" + lexeme + "'", node);
+            return;
+        }
+
+        case TokenType::FLOAT_LIT: {
+            char* end = nullptr;
+            std::strtod(lexeme.c_str(), &end);
+            if (lexeme.empty() || *end != '\0') fail("Bad float literal '" + lexeme + "'", node);
+            return;
+        }
+
+        case TokenType::IDENTIFIER:
+            verifyLocal(node);
+            return;
+
+        case TokenType::GLOBAL_VAR:
+            if (!global_vars.count(lexeme)) fail("Unknown global '" + lexeme + "'", node);
+            return;
+
+        case TokenType::INDEX:
+            if (node->left == nullptr) fail("Index without an array", node);
+            verifyArray(node->left.get());
+            verifyExpr(node->right.get());
+            return;
+
+        case TokenType::FUNCTION_CALL: {
+            size_t args = 0;
+            for (const TreeNode* tmp = node->left.get(); tmp != nullptr; tmp = tmp->left.get(), ++args) {
+                if (tmp->token.type != TokenType::ARG_LIST) fail("Expected an argument list", tmp);
+                verifyExpr(tmp->right.get());
+            }
+
+            auto callee = param_counts.find(lexeme);
+            if (callee == param_counts.end()) {
+                if (!isRuntimeRoutine(lexeme)) fail("Call of undefined function '" + lexeme + "'", node);
+            } else if (callee->second != args) {
+                fail("Call of '" + lexeme + "' with " + std::to_string(args) + " arguments, it takes " + std::to_string(callee->second), node);
+            }
+            return;
+        }
+
+        case TokenType::EQUAL:
+        case TokenType::PLUS_EQUAL:
+        case TokenType::MINUS_EQUAL:
+            if (node->left == nullptr) fail("Store without a target", node);
+
+            if (node->left->token.type == TokenType::INDEX) {
+                verifyExpr(node->left.get());
+            } else if (node->left->token.type == TokenType::GLOBAL_VAR) {
+                verifyExpr(node->left.get());
+            } else {
+                verifyLocal(node->left.get());
+            }
+            verifyExpr(node->right.get());
+            return;
+
+        case TokenType::INT_TO_FLOAT:
+        case TokenType::FLOAT_TO_INT:
+        case TokenType::BANG:
+            if (node->left != nullptr) fail("Unary '" + lexeme + "' with two operands", node);
+            verifyExpr(node->right.get());
+            return;
+
+        default:
+            if (!isBinary(type)) fail("Unexpected '" + lexeme + "' in an expression", node);
+
+            // Minus is also unary.
+            bool may_be_unary = type == TokenType::MINUS || type == TokenType::FLOAT_MINUS;
+            if (node->left != nullptr || !may_be_unary) verifyExpr(node->left.get());
+            verifyExpr(node->right.get());
+            return;
+        }
+    }
+};
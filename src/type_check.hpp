@@ -0,0 +1,339 @@
+#pragma once
+
+#include "parser.hpp"
+#include "runtime_lib.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdexcept>
+
+// Return and parameter types of a function, as type keywords.
+struct FunctionType {
+    TokenType result = TokenType::INT;
+    std::vector<TokenType> params;
+};
+
+using FunctionTypes = std::unordered_map<std::string, FunctionType>;
+
+// Gives every expression a type, int or float, and makes float arithmetic,
+// comparisons and conversions explicit, so the passes after it and the
+// generator never look at types. Values of both types are 64 bits; a float
+// is an IEEE double.
+//
+// An int meeting a float in arithmetic or a comparison is converted to
+// float. Initializers, assignments, arguments and return values are
+// converted to the type they are stored as, a float to int by truncation.
+// "(int) x" and "(float) x" convert explicitly. Compound assignments convert
+// their right side to the variable's type first, and f += e becomes
+// f = f + e for a float f.
+class TypeChecker {
+public:
+    // Signatures of the functions that can be called. Those of functions in
+    // the tree and of the runtime are added by run(); others, like the
+    // functions an incremental build doesn't parse, can be added before.
+    FunctionTypes functions;
+
+    TypeChecker(std::unique_ptr<TreeNode>& root) : root(root) {}
+
+    void run() {
+        functions.try_emplace("print_int", FunctionType{ TokenType::INT, { TokenType::INT } });
+        functions.try_emplace("read_int", FunctionType{ TokenType::INT, {} });
+        functions.try_emplace("print_float", FunctionType{ TokenType::INT, { TokenType::FLOAT } });
+
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left != nullptr && decl->left->token.type == TokenType::FUNCTION_DECL) {
+                auto name = decl->left->token.lexeme.substr(1);
+                if (isRuntimeRoutine(name)) {
+                    throw std::runtime_error("Function '" + name + "' is part of the runtime and can't be defined. at line:" + std::to_string(decl->left->token.line));
+                }
+                functions[name] = signature(decl->left.get());
+            }
+        }
+
+        // Globals are checked in order, so an initializer only sees the globals before it.
+        for (TreeNode* decl = root.get(); decl != nullptr; decl = decl->right.get()) {
+            if (decl->left == nullptr) continue;
+
+            if (decl->left->token.type == TokenType::FUNCTION_DECL) {
+                checkFunction(decl->left.get());
+            } else {
+                locals.clear();
+                checkDeclaration(decl->left.get(), globals, decl->left->left->token.lexeme);
+            }
+        }
+    }
+
+    static FunctionType signature(const TreeNode* fn_node) {
+        FunctionType type;
+        type.result = fn_node->left->token.type;
+
+        std::vector<const TreeNode*> params;
+        flattenParams(fn_node->left->right.get(), params);
+        for (auto param : params) {
+            type.params.push_back(param->token.type);
+        }
+        return type;
+    }
+
+private:
+    // The runtime's labels share the namespace of the program's functions.
+    static bool isRuntimeRoutine(const std::string& name) {
+        for (auto& routine : runtime_routines) {
+            if (routine.name == name) return true;
+        }
+        return false;
+    }
+
+    std::unique_ptr<TreeNode>& root;
+    // Variable types by name for globals and by frame offset for locals.
+    std::unordered_map<std::string, TokenType> globals;
+    std::unordered_map<std::string, TokenType> locals;
+    TokenType return_type = TokenType::INT;
+
+    // Parameters in source order; the COMMA chain holds the last one on top.
+    static void flattenParams(const TreeNode* node, std::vector<const TreeNode*>& params) {
+        if (node == nullptr) return;
+
+        if (node->token.type == TokenType::COMMA) {
+            flattenParams(node->left.get(), params);
+            params.push_back(node->right.get());
+            return;
+        }
+        params.push_back(node);
+    }
+
+    static void checkSupported(const Token& type) {
+        if (type.type == TokenType::STRING) {
+            throw std::runtime_error("Type 'string' is not supported. at line:" + std::to_string(type.line));
+        }
+    }
+
+    void checkFunction(TreeNode* fn_node) {
+        auto& sign = fn_node->left;
+        checkSupported(sign->token);
+        return_type = sign->token.type;
+
+        std::vector<const TreeNode*> params;
+        flattenParams(sign->right.get(), params);
+
+        locals.clear();
+        for (size_t i = 0; i < params.size(); ++i) {
+            checkSupported(params[i]->token);
+            locals[std::to_string(-(int(i) + 2) * 8)] = params[i]->token.type;
+        }
+
+        checkStatement(fn_node->right);
+    }
+
+    // Locals are keyed by frame offset. A later block may reuse an offset
+    // for a variable of another type, but never while the first is in
+    // scope, so the latest declaration in source order is the one in effect.
+    void checkDeclaration(TreeNode* decl, std::unordered_map<std::string, TokenType>& scope, const std::string& key) {
+        checkSupported(decl->token);
+
+        if (dynamic_cast<const ArrayNode*>(decl->left.get()) != nullptr) {
+            if (decl->token.type != TokenType::INT) {
+                throw std::runtime_error("Arrays can only hold ints. at line:" + std::to_string(decl->token.line));
+            }
+            return;
+        }
+
+        if (decl->right != nullptr) {
+            convert(decl->right, check(decl->right), decl->token.type);
+        }
+        scope[key] = decl->token.type;
+    }
+
+    void checkStatement(std::unique_ptr<TreeNode>& node) {
+        if (node == nullptr) return;
+
+        switch (node->token.type) {
+        case TokenType::STATEMENT_LIST:
+            for (TreeNode* tmp = node.get(); tmp != nullptr; tmp = tmp->right.get()) {
+                checkStatement(tmp->left);
+            }
+            return;
+
+        case TokenType::RETURN:
+            convert(node->right, check(node->right), return_type);
+            return;
+
+        case TokenType::IF: {
+            auto if_node = dynamic_cast<IfNode*>(node.get());
+            checkCondition(if_node->condition, "if");
+            checkStatement(if_node->left);
+            checkStatement(if_node->right);
+            return;
+        }
+
+        case TokenType::WHILE:
+            checkCondition(node->left, "while");
+            checkStatement(node->right);
+            return;
+
+        case TokenType::SWITCH:
+            checkCondition(node->left, "switch");
+            for (TreeNode* arm = node->right.get(); arm != nullptr; arm = arm->right.get()) {
+                checkStatement(arm->left);
+            }
+            return;
+
+        default:
+            if (isDeclaration(node.get())) {
+                checkDeclaration(node.get(), locals, node->left->token.lexeme);
+                return;
+            }
+            check(node);
+            return;
+        }
+    }
+
+    void checkCondition(std::unique_ptr<TreeNode>& condition, const std::string& statement) {
+        if (check(condition) != TokenType::INT) {
+            throw std::runtime_error("The value of " + statement + " must be an int, compare the float instead. at line:" + std::to_string(condition->token.line));
+        }
+    }
+
+    // Wraps an expression of type from in a conversion to type to.
+    static void convert(std::unique_ptr<TreeNode>& link, TokenType from, TokenType to) {
+        if (link == nullptr || from == to) return;
+
+        Token token{
+            .type = to == TokenType::FLOAT ? TokenType::INT_TO_FLOAT : TokenType::FLOAT_TO_INT,
+            .lexeme = to == TokenType::FLOAT ? "float" : "int",
+            .line = link->token.line,
+        };
+        link = std::make_unique<TreeNode>(token, nullptr, std::move(link));
+    }
+
+    TokenType variableType(const TreeNode* node) {
+        auto& scope = node->token.type == TokenType::GLOBAL_VAR ? globals : locals;
+        auto it = scope.find(node->token.lexeme);
+        return it != scope.end() ? it->second : TokenType::INT;
+    }
+
+    void requireInt(TokenType type, const Token& op) {
+        if (type != TokenType::INT) {
+            throw std::runtime_error("Operator '" + op.lexeme + "' needs int operands. at line:" + std::to_string(op.line));
+        }
+    }
+
+    static TokenType floatOperation(TokenType type) {
+        switch (type) {
+        case TokenType::PLUS: return TokenType::FLOAT_PLUS;
+        case TokenType::MINUS: return TokenType::FLOAT_MINUS;
+        case TokenType::STAR: return TokenType::FLOAT_STAR;
+        case TokenType::SLASH: return TokenType::FLOAT_SLASH;
+        case TokenType::LESS: return TokenType::FLOAT_LESS;
+        case TokenType::LESS_EQUAL: return TokenType::FLOAT_LESS_EQUAL;
+        case TokenType::GREATER: return TokenType::FLOAT_GREATER;
+        case TokenType::GREATER_EQUAL: return TokenType::FLOAT_GREATER_EQUAL;
+        case TokenType::EQUAL_EQUAL: return TokenType::FLOAT_EQUAL_EQUAL;
+        default: return type;
+        }
+    }
+
+    // Returns the type of an expression, rewriting it for float operands.
+    TokenType check(std::unique_ptr<TreeNode>& link) {
+        TreeNode* node = link.get();
+        if (node == nullptr) return TokenType::INT;
+
+        auto& token = node->token;
+
+        switch (token.type) {
+        case TokenType::INT_LIT:
+            return TokenType::INT;
+
+        case TokenType::FLOAT_LIT:
+            return TokenType::FLOAT;
+
+        case TokenType::IDENTIFIER:
+        case TokenType::GLOBAL_VAR:
+            return variableType(node);
+
+        case TokenType::INDEX:
+            if (check(node->right) != TokenType::INT) {
+                throw std::runtime_error("Array index must be an int. at line:" + std::to_string(token.line));
+            }
+            return TokenType::INT;
+
+        case TokenType::FUNCTION_CALL: {
+            std::vector<std::unique_ptr<TreeNode>*> args;
+            for (TreeNode* tmp = node->left.get(); tmp != nullptr; tmp = tmp->left.get()) {
+                args.insert(args.begin(), &tmp->right);
+            }
+
+            auto callee = functions.find(token.lexeme);
+            for (size_t i = 0; i < args.size(); ++i) {
+                auto type = check(*args[i]);
+                if (callee != functions.end() && i < callee->second.params.size()) {
+                    convert(*args[i], type, callee->second.params[i]);
+                }
+            }
+            return callee != functions.end() ? callee->second.result : TokenType::INT;
+        }
+
+        case TokenType::CAST: {
+            auto type = token.lexeme == "float" ? TokenType::FLOAT : TokenType::INT;
+            auto operand = std::move(node->right);
+            auto operand_type = check(operand);
+
+            link = std::move(operand);
+            convert(link, operand_type, type);
+            return type;
+        }
+
+        case TokenType::EQUAL:
+        case TokenType::PLUS_EQUAL:
+        case TokenType::MINUS_EQUAL: {
+            if (node->left == nullptr) return TokenType::INT;
+
+            auto target_type = check(node->left);
+            convert(node->right, check(node->right), target_type);
+
+            if (token.type != TokenType::EQUAL && target_type == TokenType::FLOAT) {
+                Token op{
+                    .type = token.type == TokenType::PLUS_EQUAL ? TokenType::FLOAT_PLUS : TokenType::FLOAT_MINUS,
+                    .lexeme = token.type == TokenType::PLUS_EQUAL ? "+" : "-",
+                    .line = token.line,
+                };
+                node->right = std::make_unique<TreeNode>(op, node->left->clone(), std::move(node->right));
+                token.type = TokenType::EQUAL;
+                token.lexeme = "=";
+            }
+            return target_type;
+        }
+
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+        case TokenType::EQUAL_EQUAL: {
+            bool is_comparison = isFloatComparison(floatOperation(token.type));
+            auto left = node->left != nullptr ? check(node->left) : TokenType::INT;
+            auto right = check(node->right);
+
+            // Unary minus has no left operand and takes the type of the right one.
+            bool is_float = right == TokenType::FLOAT || (node->left != nullptr && left == TokenType::FLOAT);
+            if (!is_float) return TokenType::INT;
+
+            convert(node->left, left, TokenType::FLOAT);
+            convert(node->right, right, TokenType::FLOAT);
+            token.type = floatOperation(token.type);
+            return is_comparison ? TokenType::INT : TokenType::FLOAT;
+        }
+
+        default:
+            // %, &, |, &&, || and !.
+            if (node->left != nullptr) requireInt(check(node->left), token);
+            requireInt(check(node->right), token);
+            return TokenType::INT;
+        }
+    }
+};
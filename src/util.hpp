@@ -8,7 +8,7 @@
 #include <memory>
 #include <queue>
 
-std::string readFile(std::string filePath) {
+inline std::string readFile(std::string filePath) {
     std::stringstream ss;
 
     if (auto fin = std::ifstream(filePath)) {
@@ -21,7 +21,7 @@ std::string readFile(std::string filePath) {
     return ss.str();
 }
 
-void printTreeLevelOrder(std::unique_ptr<TreeNode>& root) {
+inline void printTreeLevelOrder(std::unique_ptr<TreeNode>& root, std::ostream& out = std::clog) {
     if (root == nullptr) {
         return;
     }
@@ -36,7 +36,7 @@ void printTreeLevelOrder(std::unique_ptr<TreeNode>& root) {
             TreeNode* current = q.front();
             q.pop();
             
-            std::clog << current->token.lexeme << '\t';
+            out << current->token.lexeme << '\t';
             
             if (current->left != nullptr) {
                 q.push(current->left.get());
@@ -46,16 +46,23 @@ void printTreeLevelOrder(std::unique_ptr<TreeNode>& root) {
             }
         }
         
-        std::clog << std::endl;
+        out << '\n';
     }
 }
 
-void printTreePreOrder(const std::unique_ptr<TreeNode>& root) {
+inline void printTreePreOrder(const std::unique_ptr<TreeNode>& root, std::ostream& out = std::clog) {
     if (root == nullptr) {
         return;
     }
 
-    std::clog << root->token.lexeme << ' ';
-    printTreePreOrder(root->left);
-    printTreePreOrder(root->right);
+    out << root->token.lexeme << ' ';
+    printTreePreOrder(root->left, out);
+    printTreePreOrder(root->right, out);
+}
+
+inline void printTokens(const std::vector<Token>& tokens, std::ostream& out = std::clog) {
+    for (auto& token : tokens) {
+        token.print(out);
+        out << '\n';
+    }
 }
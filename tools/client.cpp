@@ -0,0 +1,51 @@
+// Thin client of the compile server started with `hydro --server`.
+//
+// Usage: hydro_client [--socket PATH] <hydro arguments>
+//
+// Sends the arguments, the working directory and the named source files to
+// the server and prints what the compilation printed; the exit code is the
+// compilation's. It only links the socket code, so it starts faster than
+// `hydro --client`. Without a server listening it runs `hydro` itself,
+// found through HYDRO or PATH.
+
+#include "client.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    std::string socket_path;
+    if (args.size() >= 2 && args[0] == "--socket") {
+        socket_path = args[1];
+        args.erase(args.begin(), args.begin() + 2);
+    } else {
+        socket_path = defaultSocketPath();
+    }
+
+    try {
+        if (auto exit_code = CompileClient::run(socket_path, args)) {
+            return exit_code.value();
+        }
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    auto compiler = std::getenv("HYDRO");
+    std::vector<char*> compiler_argv{ const_cast<char*>(compiler != nullptr ? compiler : "hydro") };
+    for (auto& arg : args) {
+        compiler_argv.push_back(arg.data());
+    }
+    compiler_argv.push_back(nullptr);
+
+    execvp(compiler_argv[0], compiler_argv.data());
+    std::perror(compiler_argv[0]);
+    return EXIT_FAILURE;
+}
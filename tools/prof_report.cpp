@@ -0,0 +1,205 @@
+// Reports the counters of a program compiled with `hydro --profile`.
+//
+// Usage: hydro_prof [--weights] <program.asm> [hydro.prof] [source.hy]
+//
+// With --weights, branch and loop counts are printed in the format
+// `hydro --profile-use` reads instead of the report.
+//
+// The counter layout is read from the "; profile <index> <function> <kind>
+// <line>" map the compiler writes at the end of the assembly, the counts from
+// the file the program wrote on exit. With the source file, every line in
+// the report is printed next to its source text.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+
+struct Counter {
+    std::string function;
+    std::string kind;
+    int line = 0;
+    uint64_t count = 0;
+};
+
+struct Branch {
+    std::string function;
+    int line;
+    uint64_t executed;
+    uint64_t taken;
+};
+
+struct Loop {
+    std::string function;
+    int line;
+    uint64_t entries;
+    uint64_t iterations;
+};
+
+std::vector<Counter> readMap(const std::string& asm_path) {
+    std::ifstream fin(asm_path);
+    if (!fin) {
+        throw std::runtime_error("Unable to open " + asm_path);
+    }
+
+    std::vector<Counter> counters;
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.rfind("; profile ", 0) != 0) continue;
+
+        std::stringstream fields(line.substr(10));
+        size_t index;
+        Counter counter;
+        if (!(fields >> index >> counter.function >> counter.kind >> counter.line) || index != counters.size()) {
+            throw std::runtime_error("Malformed profile map line: " + line);
+        }
+        counters.push_back(counter);
+    }
+
+    if (counters.empty()) {
+        throw std::runtime_error(asm_path + " has no profile map, was it compiled with --profile?");
+    }
+    return counters;
+}
+
+void readCounts(const std::string& prof_path, std::vector<Counter>& counters) {
+    std::ifstream fin(prof_path, std::ios::binary);
+    if (!fin) {
+        throw std::runtime_error("Unable to open " + prof_path);
+    }
+
+    std::vector<uint64_t> counts(counters.size());
+    fin.read(reinterpret_cast<char*>(counts.data()), counts.size() * sizeof(uint64_t));
+    if (fin.gcount() != static_cast<std::streamsize>(counts.size() * sizeof(uint64_t)) || fin.peek() != EOF) {
+        throw std::runtime_error(prof_path + " doesn't match the profile map of the program");
+    }
+
+    for (size_t i = 0; i < counters.size(); ++i) {
+        counters[i].count = counts[i];
+    }
+}
+
+std::vector<std::string> readSource(const std::string& source_path) {
+    std::vector<std::string> lines;
+    if (source_path.empty()) return lines;
+
+    std::ifstream fin(source_path);
+    if (!fin) {
+        throw std::runtime_error("Unable to open " + source_path);
+    }
+
+    std::string line;
+    while (std::getline(fin, line)) {
+        line.erase(0, line.find_first_not_of(" \t"));
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+std::string sourceText(const std::vector<std::string>& source, int line) {
+    if (line < 1 || line > static_cast<int>(source.size())) return "";
+    return "  | " + source[line - 1];
+}
+
+}
+
+int main(int argc, char** argv) {
+    bool weights = argc > 1 && std::string(argv[1]) == "--weights";
+    if (weights) {
+        --argc;
+        ++argv;
+    }
+
+    if (argc < 2 || argc > 4) {
+        std::cerr << "Usage: hydro_prof [--weights] <program.asm> [hydro.prof] [source.hy]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Counter> counters;
+    std::vector<std::string> source;
+
+    try {
+        counters = readMap(argv[1]);
+        readCounts(argc > 2 ? argv[2] : "hydro.prof", counters);
+        source = readSource(argc > 3 ? argv[3] : "");
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    std::vector<const Counter*> entries;
+    std::vector<Branch> branches;
+    std::vector<Loop> loops;
+    std::vector<size_t> open_loops;
+
+    // Within a function a branch counter is directly followed by its taken
+    // counter, and loop and backedge counters nest like the loops do.
+    for (size_t i = 0; i < counters.size(); ++i) {
+        auto& counter = counters[i];
+
+        if (counter.kind == "entry") {
+            entries.push_back(&counter);
+        } else if (counter.kind == "branch" && i + 1 < counters.size() && counters[i + 1].kind == "taken") {
+            branches.push_back(Branch{ counter.function, counter.line, counter.count, counters[i + 1].count });
+            ++i;
+        } else if (counter.kind == "loop") {
+            open_loops.push_back(loops.size());
+            loops.push_back(Loop{ counter.function, counter.line, counter.count, 0 });
+        } else if (counter.kind == "backedge" && !open_loops.empty()) {
+            loops[open_loops.back()].iterations = counter.count;
+            open_loops.pop_back();
+        }
+    }
+
+    if (weights) {
+        for (auto& branch : branches) {
+            std::cout << "branch " << branch.function << " " << branch.line << " " << branch.executed << " " << branch.taken << "\n";
+        }
+        for (auto& loop : loops) {
+            std::cout << "loop " << loop.function << " " << loop.line << " " << loop.entries << " " << loop.iterations << "\n";
+        }
+        return EXIT_SUCCESS;
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](auto a, auto b) { return a->count > b->count; });
+    std::stable_sort(branches.begin(), branches.end(), [](auto& a, auto& b) { return a.executed > b.executed; });
+    std::stable_sort(loops.begin(), loops.end(), [](auto& a, auto& b) { return a.iterations > b.iterations; });
+
+    std::cout << std::fixed << std::setprecision(1);
+
+    std::cout << "Functions\n";
+    std::cout << std::setw(14) << "calls" << std::setw(8) << "line" << "  function\n";
+    for (auto entry : entries) {
+        std::cout << std::setw(14) << entry->count << std::setw(8) << entry->line << "  " << entry->function
+            << sourceText(source, entry->line) << "\n";
+    }
+
+    std::cout << "\nBranches\n";
+    std::cout << std::setw(14) << "executed" << std::setw(14) << "taken" << std::setw(14) << "not taken"
+        << std::setw(8) << "taken%" << std::setw(8) << "line" << "  function\n";
+    for (auto& branch : branches) {
+        double percent = branch.executed ? 100.0 * branch.taken / branch.executed : 0;
+        std::cout << std::setw(14) << branch.executed << std::setw(14) << branch.taken
+            << std::setw(14) << branch.executed - branch.taken << std::setw(8) << percent
+            << std::setw(8) << branch.line << "  " << branch.function << sourceText(source, branch.line) << "\n";
+    }
+
+    std::cout << "\nLoops\n";
+    std::cout << std::setw(14) << "entries" << std::setw(14) << "iterations" << std::setw(10) << "avg trips"
+        << std::setw(8) << "line" << "  function\n";
+    for (auto& loop : loops) {
+        double trips = loop.entries ? static_cast<double>(loop.iterations) / loop.entries : 0;
+        std::cout << std::setw(14) << loop.entries << std::setw(14) << loop.iterations << std::setw(10) << trips
+            << std::setw(8) << loop.line << "  " << loop.function << sourceText(source, loop.line) << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}